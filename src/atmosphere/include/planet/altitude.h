@@ -0,0 +1,371 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_ALTITUDE_H
+#define PLANET_ALTITUDE_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+#include "planet/planet_constants.h"
+#include "planet/interpolation_grid.h"
+
+//C++
+#include <vector>
+#include <string>
+#include <map>
+
+namespace Planet
+{
+  /*!\class Altitude
+   *
+   * Altitude grid of the column (km), nodes and their geometry computed
+   * once: radius r = R + z (km), gravity g(z) (m.s-2) and spacing
+   * z_{i+1} - z_i (km).
+   *
+   * Per node fields are stored as structure of arrays: a field has
+   * n_components components (species, reactions...) and each component
+   * is contiguous over the nodes,
+   *
+   *   field(f)[c * n_altitudes() + iz]
+   *
+   * so that a component is a plain array of the column (densities of
+   * one species, temperature, eddy coefficient, rate constant of one
+   * reaction) the evaluators index by node instead of searching the
+   * altitude.
+   */
+  template<typename CoeffType, typename VectorCoeffType>
+  class Altitude
+  {
+      private:
+        //! no default constructor
+        Altitude(){antioch_error();return;}
+
+        VectorCoeffType _altitudes;
+        VectorCoeffType _radius;
+        VectorCoeffType _gravity;
+        VectorCoeffType _spacing;
+        InterpolationGrid<CoeffType,VectorCoeffType> _grid;
+
+        //! fields, component major
+        std::vector<VectorCoeffType> _fields;
+        std::vector<unsigned int>    _n_components;
+        std::map<std::string,unsigned int> _field_names;
+
+        //! geometry of the nodes
+        void build_geometry();
+
+        //! z_min, z_min + step, ..., up to z_max included
+        static VectorCoeffType regular_altitudes(const CoeffType &z_min, const CoeffType &z_max, const CoeffType &step);
+
+      public:
+        Altitude(const VectorCoeffType &altitudes);
+        Altitude(const CoeffType &z_min, const CoeffType &z_max, const CoeffType &step);
+        ~Altitude();
+
+        //!\return number of nodes
+        unsigned int n_altitudes() const;
+
+        //!\return altitudes (km)
+        const VectorCoeffType &altitudes() const;
+
+        //!\return radius of the nodes, R + z (km)
+        const VectorCoeffType &radius() const;
+
+        //!\return gravity at the nodes (m.s-2)
+        const VectorCoeffType &gravity() const;
+
+        //!\return spacing, z_{i+1} - z_i (km), n_altitudes() - 1 values
+        const VectorCoeffType &spacing() const;
+
+        //!\return interval lookup of the grid
+        const InterpolationGrid<CoeffType,VectorCoeffType> &grid() const;
+
+        //!\return node of altitude z, n_altitudes() if z is not a node
+        template<typename StateType>
+        unsigned int node_index(const StateType &z) const;
+
+        //! new field of n_components components, zero, \return its index
+        unsigned int add_field(const std::string &name, unsigned int n_components = 1);
+
+        //!\return number of fields
+        unsigned int n_fields() const;
+
+        //!\return index of the field name
+        unsigned int field_index(const std::string &name) const;
+
+        //!\return true if the field exists
+        bool has_field(const std::string &name) const;
+
+        //!\return number of components of field f
+        unsigned int n_components(unsigned int f) const;
+
+        //!\return whole storage of field f, component major
+        VectorCoeffType &field(unsigned int f);
+
+        //!\return whole storage of field f, component major
+        const VectorCoeffType &field(unsigned int f) const;
+
+        //!\return component c of field f, n_altitudes() contiguous values
+        CoeffType *component(unsigned int f, unsigned int c = 0);
+
+        //!\return component c of field f, n_altitudes() contiguous values
+        const CoeffType *component(unsigned int f, unsigned int c = 0) const;
+
+        //!\return value of component c of field f at node iz
+        CoeffType &value(unsigned int f, unsigned int c, unsigned int iz);
+
+        //!\return value of component c of field f at node iz
+        const CoeffType &value(unsigned int f, unsigned int c, unsigned int iz) const;
+
+        //! copies the values of the nodes into component c of field f
+        template<typename VectorStateType>
+        void set_component(unsigned int f, unsigned int c, const VectorStateType &values);
+  };
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  Altitude<CoeffType,VectorCoeffType>::Altitude(const VectorCoeffType &altitudes):
+    _altitudes(altitudes),
+    _grid(altitudes)
+  {
+    this->build_geometry();
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  Altitude<CoeffType,VectorCoeffType>::Altitude(const CoeffType &z_min, const CoeffType &z_max, const CoeffType &step):
+    _altitudes(regular_altitudes(z_min,z_max,step)),
+    _grid(_altitudes)
+  {
+    this->build_geometry();
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  Altitude<CoeffType,VectorCoeffType>::~Altitude()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  VectorCoeffType Altitude<CoeffType,VectorCoeffType>::regular_altitudes(const CoeffType &z_min, const CoeffType &z_max, const CoeffType &step)
+  {
+    antioch_assert_greater(step,0.);
+    antioch_assert_greater(z_max,z_min);
+
+    // rounded number of intervals, the last node is z_max
+    const unsigned int n_intervals = static_cast<unsigned int>((z_max - z_min) / step + CoeffType(0.5L));
+    antioch_assert_greater(n_intervals,0);
+
+    VectorCoeffType altitudes(n_intervals + 1);
+    for(unsigned int iz = 0; iz <= n_intervals; iz++)
+    {
+      altitudes[iz] = z_min + CoeffType(iz) * step;
+    }
+    altitudes.back() = z_max;
+
+    return altitudes;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void Altitude<CoeffType,VectorCoeffType>::build_geometry()
+  {
+    const unsigned int n = _altitudes.size();
+    _radius.resize(n);
+    _gravity.resize(n);
+    _spacing.resize(n - 1);
+    for(unsigned int iz = 0; iz < n; iz++)
+    {
+      _radius[iz]  = Constants::Titan::radius<CoeffType>() + _altitudes[iz];
+      _gravity[iz] = Constants::g(Constants::Titan::radius<CoeffType>(), _altitudes[iz], Constants::Titan::mass<CoeffType>());
+      if(iz + 1 < n)_spacing[iz] = _altitudes[iz + 1] - _altitudes[iz];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int Altitude<CoeffType,VectorCoeffType>::n_altitudes() const
+  {
+    return _altitudes.size();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &Altitude<CoeffType,VectorCoeffType>::altitudes() const
+  {
+    return _altitudes;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &Altitude<CoeffType,VectorCoeffType>::radius() const
+  {
+    return _radius;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &Altitude<CoeffType,VectorCoeffType>::gravity() const
+  {
+    return _gravity;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &Altitude<CoeffType,VectorCoeffType>::spacing() const
+  {
+    return _spacing;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const InterpolationGrid<CoeffType,VectorCoeffType> &Altitude<CoeffType,VectorCoeffType>::grid() const
+  {
+    return _grid;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  unsigned int Altitude<CoeffType,VectorCoeffType>::node_index(const StateType &z) const
+  {
+    const unsigned int iz = _grid.floor_index(z);
+    if(_altitudes[iz] == z)return iz;
+    if(_altitudes[iz + 1] == z)return iz + 1;
+    return _altitudes.size();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int Altitude<CoeffType,VectorCoeffType>::add_field(const std::string &name, unsigned int n_components)
+  {
+    if(_field_names.count(name))antioch_error();
+    antioch_assert_greater(n_components,0);
+
+    _field_names[name] = _fields.size();
+    _fields.push_back(VectorCoeffType(n_components * _altitudes.size(),0.L));
+    _n_components.push_back(n_components);
+
+    return _fields.size() - 1;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int Altitude<CoeffType,VectorCoeffType>::n_fields() const
+  {
+    return _fields.size();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int Altitude<CoeffType,VectorCoeffType>::field_index(const std::string &name) const
+  {
+    if(!_field_names.count(name))antioch_error();
+    return _field_names.at(name);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  bool Altitude<CoeffType,VectorCoeffType>::has_field(const std::string &name) const
+  {
+    return (_field_names.count(name) != 0);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int Altitude<CoeffType,VectorCoeffType>::n_components(unsigned int f) const
+  {
+    antioch_assert_less(f,_fields.size());
+    return _n_components[f];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  VectorCoeffType &Altitude<CoeffType,VectorCoeffType>::field(unsigned int f)
+  {
+    antioch_assert_less(f,_fields.size());
+    return _fields[f];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &Altitude<CoeffType,VectorCoeffType>::field(unsigned int f) const
+  {
+    antioch_assert_less(f,_fields.size());
+    return _fields[f];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  CoeffType *Altitude<CoeffType,VectorCoeffType>::component(unsigned int f, unsigned int c)
+  {
+    antioch_assert_less(f,_fields.size());
+    antioch_assert_less(c,_n_components[f]);
+    return &_fields[f][c * _altitudes.size()];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const CoeffType *Altitude<CoeffType,VectorCoeffType>::component(unsigned int f, unsigned int c) const
+  {
+    antioch_assert_less(f,_fields.size());
+    antioch_assert_less(c,_n_components[f]);
+    return &_fields[f][c * _altitudes.size()];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  CoeffType &Altitude<CoeffType,VectorCoeffType>::value(unsigned int f, unsigned int c, unsigned int iz)
+  {
+    antioch_assert_less(iz,_altitudes.size());
+    return this->component(f,c)[iz];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const CoeffType &Altitude<CoeffType,VectorCoeffType>::value(unsigned int f, unsigned int c, unsigned int iz) const
+  {
+    antioch_assert_less(iz,_altitudes.size());
+    return this->component(f,c)[iz];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename VectorStateType>
+  inline
+  void Altitude<CoeffType,VectorCoeffType>::set_component(unsigned int f, unsigned int c, const VectorStateType &values)
+  {
+    antioch_assert_equal_to(values.size(),_altitudes.size());
+
+    CoeffType *data = this->component(f,c);
+    for(unsigned int iz = 0; iz < _altitudes.size(); iz++)data[iz] = values[iz];
+  }
+
+}
+
+#endif
@@ -0,0 +1,236 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_ALTITUDE_GRID_GENERATOR_H
+#define PLANET_ALTITUDE_GRID_GENERATOR_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+#include "planet/atmospheric_mixture.h"
+
+//C++
+#include <vector>
+#include <cmath>
+
+namespace Planet
+{
+  /*!\class AltitudeGridGenerator
+   *
+   * Non uniform altitude grid, nodes uniform in log-pressure: the hydrostatic
+   * pressure decreases as d ln P = - dz / Ha, so the nodes are placed with
+   * a density (nodes per km)
+   *
+   *   rho(z) = max(f(z) * n_H / Ha(z), 1 / dz_max)
+   *
+   * with n_H nodes per atmospheric scale height, Ha computed by the mixture
+   * with the temperature profile (bottom molar fractions), f(z) >= 1 the
+   * refinement of the layers that need it (homopause, production peaks...)
+   * and dz_max a largest step. The nodes equidistribute the integral of rho
+   * between z_min and z_max, both nodes of the grid.
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  class AltitudeGridGenerator
+  {
+      private:
+        //! no default constructor
+        AltitudeGridGenerator(){antioch_error();return;}
+
+        const AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType> &_mixture;
+
+        CoeffType    _nodes_per_scale_height;
+        CoeffType    _max_step;
+        unsigned int _n_samples;
+
+        //! refined layers [_refine_low, _refine_high], factor
+        VectorCoeffType _refine_low;
+        VectorCoeffType _refine_high;
+        VectorCoeffType _refine_factor;
+
+      public:
+        AltitudeGridGenerator(const AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType> &mixture,
+                              const CoeffType &nodes_per_scale_height = 4.L);
+        ~AltitudeGridGenerator();
+
+        //! nodes per atmospheric scale height
+        void set_nodes_per_scale_height(const CoeffType &nodes_per_scale_height);
+
+        //! largest step (km), none by default
+        void set_max_step(const CoeffType &max_step);
+
+        //! number of points of the integration of the node density (2000 by default)
+        void set_n_samples(unsigned int n_samples);
+
+        //! factor times more nodes between z_low and z_high
+        void add_refinement(const CoeffType &z_low, const CoeffType &z_high, const CoeffType &factor);
+
+        //! refinement of a layer of width (km) around a level, e.g. homopause or production peak
+        void add_refined_level(const CoeffType &z, const CoeffType &width, const CoeffType &factor);
+
+        //! removes the refinements
+        void clear_refinements();
+
+        //!\return node density at altitude z (km-1)
+        template<typename StateType>
+        const CoeffType node_density(const StateType &z) const;
+
+        //! nodes from z_min to z_max, increasing
+        template<typename VectorStateType>
+        void generate(const CoeffType &z_min, const CoeffType &z_max, VectorStateType &altitudes) const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::AltitudeGridGenerator(
+                                        const AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType> &mixture,
+                                        const CoeffType &nodes_per_scale_height):
+    _mixture(mixture),
+    _nodes_per_scale_height(nodes_per_scale_height),
+    _max_step(-1.L),
+    _n_samples(2000)
+  {
+    antioch_assert_greater(_nodes_per_scale_height,0.);
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::~AltitudeGridGenerator()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_nodes_per_scale_height(const CoeffType &nodes_per_scale_height)
+  {
+    antioch_assert_greater(nodes_per_scale_height,0.);
+    _nodes_per_scale_height = nodes_per_scale_height;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_max_step(const CoeffType &max_step)
+  {
+    antioch_assert_greater(max_step,0.);
+    _max_step = max_step;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_n_samples(unsigned int n_samples)
+  {
+    antioch_assert_greater(n_samples,1);
+    _n_samples = n_samples;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::add_refinement(const CoeffType &z_low, const CoeffType &z_high,
+                                                                                        const CoeffType &factor)
+  {
+    antioch_assert_greater(z_high,z_low);
+    antioch_assert_greater_equal(factor,1.);
+    _refine_low.push_back(z_low);
+    _refine_high.push_back(z_high);
+    _refine_factor.push_back(factor);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::add_refined_level(const CoeffType &z, const CoeffType &width,
+                                                                                           const CoeffType &factor)
+  {
+    this->add_refinement(z - width / CoeffType(2.L), z + width / CoeffType(2.L), factor);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::clear_refinements()
+  {
+    _refine_low.clear();
+    _refine_high.clear();
+    _refine_factor.clear();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType>
+  inline
+  const CoeffType AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::node_density(const StateType &z) const
+  {
+// overlapping layers: the finest wins
+    CoeffType factor(1.L);
+    for(unsigned int i = 0; i < _refine_factor.size(); i++)
+    {
+      if(z >= _refine_low[i] && z <= _refine_high[i] && _refine_factor[i] > factor)factor = _refine_factor[i];
+    }
+
+    CoeffType density = factor * _nodes_per_scale_height
+                        / (CoeffType(1e-3L) * _mixture.atmospheric_scale_height(_mixture.neutral_molar_fraction_bottom(),z)); // m -> km
+    if(_max_step > CoeffType(0.L) && density < CoeffType(1.L) / _max_step)density = CoeffType(1.L) / _max_step;
+
+    return density;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AltitudeGridGenerator<CoeffType,VectorCoeffType,MatrixCoeffType>::generate(const CoeffType &z_min, const CoeffType &z_max,
+                                                                                  VectorStateType &altitudes) const
+  {
+    antioch_assert_greater(z_max,z_min);
+
+// cumulative number of nodes on the samples, trapezoidal rule
+    const CoeffType dz = (z_max - z_min) / CoeffType(_n_samples - 1);
+    VectorCoeffType z(_n_samples);
+    VectorCoeffType cumulated(_n_samples);
+    z[0] = z_min;
+    cumulated[0] = 0.L;
+    CoeffType previous = this->node_density(z_min);
+    for(unsigned int i = 1; i < _n_samples; i++)
+    {
+      z[i] = (i == _n_samples - 1)?z_max:z_min + CoeffType(i) * dz;
+      const CoeffType density = this->node_density(z[i]);
+      cumulated[i] = cumulated[i - 1] + (previous + density) / CoeffType(2.L) * (z[i] - z[i - 1]);
+      previous = density;
+    }
+
+// equal increments of the cumulative number
+    const unsigned int n_intervals = std::max(1,static_cast<int>(std::ceil(cumulated.back())));
+    const CoeffType increment = cumulated.back() / CoeffType(n_intervals);
+    altitudes.resize(n_intervals + 1);
+    altitudes[0] = z_min;
+    unsigned int is(0);
+    for(unsigned int iz = 1; iz < n_intervals; iz++)
+    {
+      const CoeffType target = CoeffType(iz) * increment;
+      while(cumulated[is + 1] < target)is++;
+      altitudes[iz] = z[is] + (target - cumulated[is]) / (cumulated[is + 1] - cumulated[is]) * (z[is + 1] - z[is]);
+    }
+    altitudes[n_intervals] = z_max;
+  }
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_ALTITUDE_STATE_H
+#define PLANET_ALTITUDE_STATE_H
+
+namespace Planet
+{
+  /*!\struct AltitudeState
+   *
+   * Thermodynamic state at one point of the column, filled once by
+   * AtmosphericMixture::altitude_state and shared by the evaluators
+   * (diffusion, kinetics, photon flux) instead of each of them
+   * interpolating the temperature and computing the gravity again.
+   *
+   * The composition part (nTot, P, Mm, Ha) is only valid for the
+   * concentrations it was computed with.
+   */
+  template<typename CoeffType, typename VectorCoeffType>
+  struct AltitudeState
+  {
+    //! altitude (km)
+    CoeffType z;
+    //! neutral temperature (K) and its derivative (K.km-1)
+    CoeffType T;
+    CoeffType dT_dz;
+    //! gravity (m.s-2)
+    CoeffType g;
+    //! species scale heights (m)
+    VectorCoeffType Hs;
+
+    //! total concentration (cm-3), pressure (Pa)
+    CoeffType nTot;
+    CoeffType P;
+    //! mean molar mass and atmospheric scale height (m)
+    CoeffType Mm;
+    CoeffType Ha;
+
+    AltitudeState():z(0),T(0),dT_dz(0),g(0),nTot(0),P(0),Mm(0),Ha(0){}
+  };
+}
+
+#endif
@@ -29,12 +29,20 @@
 #include "antioch/cmath_shims.h"
 
 //Planet
+#include "planet/altitude_state.h"
 #include "planet/atmospheric_temperature.h"
 #include "planet/planet_constants.h"
 #include "planet/math_constants.h"
+#include "planet/contiguous_matrix.h"
+
+//eigen
+#include <Eigen/Dense>
 
 //C++
 #include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 
 namespace Planet
 {
@@ -59,7 +67,13 @@ namespace Planet
         VectorCoeffType _hard_sphere_radius;
 
 // neutral only, precomputations
-        MatrixCoeffType _mean_free_path_precompute;
+        ContiguousMatrix<CoeffType> _mean_free_path_precompute; //row-major, mapped by the batched products
+
+// first guess column, uniform nodes from _zmin to _zmax
+        CoeffType _column_resolution;
+        VectorCoeffType _column_density;
+        VectorCoeffType _column_cumulated;
+        unsigned int _column_temperature_version; //temperature profiles tabulated
 
 ////dependencies
         AtmosphericTemperature<CoeffType,VectorCoeffType> &_temperature;
@@ -67,6 +81,13 @@ namespace Planet
 
         void precompute_mean_free_path();
 
+        //! \return mean molar mass with molar fractions at bottom (kg/mol)
+        const CoeffType first_guess_molar_mass() const;
+
+        //! \return total first guess density at altitude z
+        template<typename StateType>
+        const CoeffType first_guess_total_density(const StateType &z, const CoeffType &Mm) const;
+
         //! \return scale height of species s at altitude z, H = kb*T/(g*Ms)
         template<typename StateType>
         ANTIOCH_AUTO(StateType)
@@ -123,6 +144,12 @@ namespace Planet
         template <typename VectorStateType>
         void mean_free_path(const VectorStateType &densities, VectorStateType &mean_free_path) const;
 
+        //!\return the mean free paths at many altitudes, rows are altitudes
+        //
+        // One matrix product densities * collisions^T for the whole column,
+        // the contiguous matrices are mapped, no copy.
+        void mean_free_paths(const ContiguousMatrix<CoeffType> &densities, ContiguousMatrix<CoeffType> &mean_free_paths) const;
+
         //! \return Jeans' escape flux (*density*.m.s-1)
         //
         // \param ms: mass of molecule (kg)
@@ -145,10 +172,26 @@ namespace Planet
         template <typename StateType, typename VectorStateType>
         void first_guess_densities(const StateType &z, VectorStateType &densities) const;
 
-        //!use isobaric equation, molar fractions at bottom and zstep = 10
+        //!column of first_guess_densities from z to zmax, molar fractions at bottom
         template <typename StateType, typename VectorStateType>
         void first_guess_densities_sum(const StateType &z, VectorStateType &sum_densities) const;
 
+        //!\return column of the total first guess density from z to zmax
+        //
+        // The density is exponential between the nodes of the table,
+        // with the local scale height of the node values, the column
+        // is exact for this profile. Answered from the cumulated table
+        // from the top, in O(1).
+        template <typename StateType>
+        const CoeffType first_guess_column(const StateType &z) const;
+
+        //!sets the largest step of the column table (km), 1 km by default
+        void set_column_resolution(const CoeffType &resolution);
+
+        //!tabulates the first guess column, to be called after any change of the
+        //!temperature (setters, resample, interpolation), first_guess_column checks it
+        void update_column_table();
+
         //!lower boundary concentrations
         template <typename VectorStateType>
         void lower_boundary_concentrations(VectorStateType &low_densities) const;
@@ -169,6 +212,35 @@ namespace Planet
         template<typename StateType, typename VectorStateType>
         const CoeffType atmospheric_scale_height(const VectorStateType &molar_densities,const StateType &z) const;
 
+        //! altitude part of the state: z, temperature and derivative, gravity, scale heights
+        template<typename StateType>
+        void altitude_state(const StateType &z, AltitudeState<CoeffType,VectorCoeffType> &state) const;
+
+        //! whole state: altitude part, then total concentration, pressure,
+        //! mean molar mass and atmospheric scale height of molar_densities
+        template<typename StateType, typename VectorStateType>
+        void altitude_state(const VectorStateType &molar_densities, const StateType &z,
+                            AltitudeState<CoeffType,VectorCoeffType> &state) const;
+
+        //! neutral temperatures and derivatives at sorted altitudes, one pass over the profile,
+        //! to be given to the altitude_state below
+        template<typename VectorStateType>
+        void neutral_temperatures_and_dz(const VectorStateType &z, VectorCoeffType &T, VectorCoeffType &dT_dz) const;
+
+        //! altitude part of the state, temperature and derivative already computed
+        template<typename StateType>
+        void altitude_state(const StateType &z, const CoeffType &T, const CoeffType &dT_dz,
+                            AltitudeState<CoeffType,VectorCoeffType> &state) const;
+
+        //! whole state, temperature and derivative already computed
+        template<typename StateType, typename VectorStateType>
+        void altitude_state(const VectorStateType &molar_densities, const StateType &z,
+                            const CoeffType &T, const CoeffType &dT_dz,
+                            AltitudeState<CoeffType,VectorCoeffType> &state) const;
+
+        //!\return a of the state (needs its atmospheric scale height)
+        const CoeffType a(const AltitudeState<CoeffType,VectorCoeffType> &state) const;
+
         //!
         const CoeffType total_bottom_density() const;
 
@@ -187,6 +259,8 @@ namespace Planet
   _zmax(0.L),
   _neutral_composition(neutral),
   _ionic_composition(ion),
+  _column_resolution(1.L),
+  _column_temperature_version(0),
   _temperature(temp)
   {
     return;
@@ -264,6 +338,7 @@ namespace Planet
     _zmin = zmin;
     _zmax = zmax;   
 
+    this->update_column_table();
   }
 
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
@@ -303,6 +378,92 @@ namespace Planet
     return (this->H(Mm,_temperature.neutral_temperature(z),z));
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::altitude_state(const StateType &z,
+                                                                                     AltitudeState<CoeffType,VectorCoeffType> &state) const
+  {
+    CoeffType T, dT_dz;
+    _temperature.neutral_temperature_and_dz(z,T,dT_dz);
+    this->altitude_state(z,T,dT_dz,state);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::neutral_temperatures_and_dz(const VectorStateType &z,
+                                                                                                  VectorCoeffType &T, VectorCoeffType &dT_dz) const
+  {
+    _temperature.neutral_temperature_and_dz(z,T,dT_dz);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::altitude_state(const StateType &z, const CoeffType &T, const CoeffType &dT_dz,
+                                                                                     AltitudeState<CoeffType,VectorCoeffType> &state) const
+  {
+    state.z     = z;
+    state.T     = T;
+    state.dT_dz = dT_dz;
+    state.g     = Constants::g(Constants::Titan::radius<CoeffType>(), CoeffType(z), Constants::Titan::mass<CoeffType>());
+
+    // H = kb*T/(g*Ms), gravity once for all species
+    const CoeffType RT = Constants::Universal::kb<CoeffType>() * Antioch::Constants::Avogadro<CoeffType>() * state.T;
+    state.Hs.resize(_neutral_composition.n_species(),0.L);
+    for(unsigned int s = 0; s < _neutral_composition.n_species(); s++)
+    {
+      state.Hs[s] = RT / (CoeffType(1e-3L) * _neutral_composition.M(s) * state.g);
+    }
+
+    Antioch::set_zero(state.nTot);
+    Antioch::set_zero(state.P);
+    Antioch::set_zero(state.Mm);
+    Antioch::set_zero(state.Ha);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::altitude_state(const VectorStateType &molar_densities, const StateType &z,
+                                                                                     AltitudeState<CoeffType,VectorCoeffType> &state) const
+  {
+    CoeffType T, dT_dz;
+    _temperature.neutral_temperature_and_dz(z,T,dT_dz);
+    this->altitude_state(molar_densities,z,T,dT_dz,state);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::altitude_state(const VectorStateType &molar_densities, const StateType &z,
+                                                                                     const CoeffType &T, const CoeffType &dT_dz,
+                                                                                     AltitudeState<CoeffType,VectorCoeffType> &state) const
+  {
+    antioch_assert_equal_to(molar_densities.size(),_neutral_composition.n_species());
+
+    this->altitude_state(z,T,dT_dz,state);
+
+    for(unsigned int s = 0; s < _neutral_composition.n_species(); s++)
+    {
+      state.Mm   += molar_densities[s] * _neutral_composition.M(s);
+      state.nTot += molar_densities[s];
+    }
+    state.Mm /= state.nTot;
+    state.P   = state.nTot * CoeffType(1e6L) //cm-3 -> m-3
+                * Constants::Universal::kb<CoeffType>() * state.T;
+    state.Ha  = Constants::Universal::kb<CoeffType>() * Antioch::Constants::Avogadro<CoeffType>() * state.T /
+                (CoeffType(1e-3L) * state.Mm * state.g);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const CoeffType AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::a(const AltitudeState<CoeffType,VectorCoeffType> &state) const
+  {
+     return (Constants::Titan::radius<CoeffType>() + state.z) / state.Ha * CoeffType(1e3); // to m
+  }
+
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   inline
   const CoeffType AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::total_bottom_density() const
@@ -334,9 +495,9 @@ namespace Planet
      antioch_assert(!_mean_free_path_precompute.empty());
 
      mean_free_path.resize(densities.size(),0.L);
-     CoeffType out(0.L);
      for(unsigned int s = 0; s < densities.size(); s++)
      {
+       CoeffType out(0.L);
        for(unsigned int n = 0; n < densities.size(); n++)
        {
           out += densities[n] * _mean_free_path_precompute[s][n];
@@ -345,6 +506,27 @@ namespace Planet
      }
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::mean_free_paths(const ContiguousMatrix<CoeffType> &densities,
+                                                                                     ContiguousMatrix<CoeffType> &mean_free_paths) const
+  {
+     antioch_assert(!_mean_free_path_precompute.empty());
+     antioch_assert_equal_to(densities.n_cols(),_neutral_composition.n_species());
+
+     typedef Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMajorMatrix;
+
+     mean_free_paths.resize(densities.n_rows());
+     mean_free_paths.resize_columns(densities.n_cols());
+     if(densities.empty())return;
+
+     Eigen::Map<const RowMajorMatrix> n(densities.data(),densities.n_rows(),densities.n_cols());
+     Eigen::Map<const RowMajorMatrix> collisions(_mean_free_path_precompute.data(),_mean_free_path_precompute.n_rows(),_mean_free_path_precompute.n_cols());
+     Eigen::Map<RowMajorMatrix> out(mean_free_paths.data(),mean_free_paths.n_rows(),mean_free_paths.n_cols());
+     out.noalias() = n * collisions.transpose();
+     out = out.cwiseInverse();
+  }
+
   
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   inline
@@ -352,10 +534,10 @@ namespace Planet
   {
      antioch_assert(!_hard_sphere_radius.empty());
      _mean_free_path_precompute.resize(_hard_sphere_radius.size());
+     _mean_free_path_precompute.resize_columns(_hard_sphere_radius.size());
 
      for(unsigned int s = 0; s < _hard_sphere_radius.size(); s++)
      {
-        _mean_free_path_precompute[s].resize(_hard_sphere_radius.size());
         for(unsigned int n = 0; n < _hard_sphere_radius.size(); n++)
         {
             _mean_free_path_precompute[s][n] = Constants::pi<CoeffType>() * (_hard_sphere_radius[s] + _hard_sphere_radius[n]) 
@@ -365,6 +547,27 @@ namespace Planet
      }
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const CoeffType AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::first_guess_molar_mass() const
+  {
+      CoeffType Mm(0.L);
+      for(unsigned int s = 0; s < _neutral_composition.n_species(); s++)
+      {
+         Mm += _neutral_molar_fraction_bottom[s] * _neutral_composition.M(s);
+      }
+
+      return Mm * 1e-3L; //to kg
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template <typename StateType>
+  inline
+  const CoeffType AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::first_guess_total_density(const StateType &z, const CoeffType &Mm) const
+  {
+      return this->barometry_density(CoeffType(z), _zmin, _total_bottom_density, _temperature.neutral_temperature(z), Mm);
+  }
+
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   template <typename StateType, typename VectorStateType>
   inline
@@ -373,20 +576,85 @@ namespace Planet
       antioch_assert_equal_to(densities.size(),_neutral_composition.n_species());
       antioch_assert(!_neutral_molar_fraction_bottom.empty());
 
-      CoeffType Mm(0.L);
+      CoeffType nTot = this->first_guess_total_density(z,this->first_guess_molar_mass());
+
       for(unsigned int s = 0; s < _neutral_composition.n_species(); s++)
       {
-         Mm += _neutral_molar_fraction_bottom[s] * _neutral_composition.M(s);
+         densities[s] = _neutral_molar_fraction_bottom[s] * nTot;
       }
+  }
 
-      Mm *= 1e-3L; //to kg
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::set_column_resolution(const CoeffType &resolution)
+  {
+      antioch_assert_greater(resolution,0.);
+      _column_resolution = resolution;
+      if(!_neutral_molar_fraction_bottom.empty())this->update_column_table();
+  }
 
-      CoeffType nTot = this->barometry_density(z, _zmin, _total_bottom_density, _temperature.neutral_temperature(z), Mm);
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::update_column_table()
+  {
+      antioch_assert(!_neutral_molar_fraction_bottom.empty());
+      antioch_assert_greater(_zmax,_zmin);
 
-      for(unsigned int s = 0; s < _neutral_composition.n_species(); s++)
+      const unsigned int n_intervals = std::max(1,static_cast<int>(std::ceil((_zmax - _zmin) / _column_resolution)));
+      const CoeffType dz = (_zmax - _zmin) / CoeffType(n_intervals);
+      const CoeffType Mm = this->first_guess_molar_mass();
+
+      _column_density.resize(n_intervals + 1);
+      _column_cumulated.resize(n_intervals + 1);
+      for(unsigned int i = 0; i <= n_intervals; i++)
       {
-         densities[s] = _neutral_molar_fraction_bottom[s] * nTot;
+         const CoeffType z = (i == n_intervals)?_zmax:_zmin + CoeffType(i) * dz;
+         _column_density[i] = this->first_guess_total_density(z,Mm);
+      }
+
+// from the top, exact column of n_i * exp(-(z - z_i) / h_i), h_i = dz / ln(n_i/n_{i+1})
+      _column_cumulated[n_intervals] = 0.L;
+      for(unsigned int i = n_intervals; i > 0; i--)
+      {
+         const CoeffType ratio = _column_density[i - 1] / _column_density[i];
+         const CoeffType segment = (Antioch::ant_abs(ratio - CoeffType(1.L)) < std::numeric_limits<CoeffType>::epsilon())?
+                                        _column_density[i - 1] * dz:
+                                        (_column_density[i - 1] - _column_density[i]) * dz / Antioch::ant_log(ratio);
+         _column_cumulated[i - 1] = _column_cumulated[i] + segment;
+      }
+      _column_temperature_version = _temperature.version();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template <typename StateType>
+  inline
+  const CoeffType AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::first_guess_column(const StateType &z) const
+  {
+      antioch_assert(!_column_cumulated.empty());
+      antioch_assert_equal_to(_column_temperature_version,_temperature.version());
+
+      if(!(z < _zmax))return 0.L;
+
+// segment of z, the first one below the table
+      const unsigned int last = _column_density.size() - 2;
+      const CoeffType dz = (_zmax - _zmin) / CoeffType(last + 1);
+      const CoeffType position = (z - _zmin) / dz;
+      const unsigned int iz = (position > CoeffType(0.L))?std::min(static_cast<unsigned int>(position),last):0;
+
+// from z to the top of the segment
+      const CoeffType ratio = _column_density[iz] / _column_density[iz + 1];
+      const CoeffType t = z - (_zmin + CoeffType(iz) * dz);
+      CoeffType partial;
+      if(Antioch::ant_abs(ratio - CoeffType(1.L)) < std::numeric_limits<CoeffType>::epsilon())
+      {
+         partial = _column_density[iz] * (dz - t);
+      }else
+      {
+         const CoeffType h = dz / Antioch::ant_log(ratio);
+         partial = (_column_density[iz] * Antioch::ant_exp(- t / h) - _column_density[iz + 1]) * h;
       }
+
+      return partial + _column_cumulated[iz + 1];
   }
 
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
@@ -397,17 +665,10 @@ namespace Planet
       antioch_assert_equal_to(sum_densities.size(),_neutral_composition.n_species());
       antioch_assert(!_neutral_molar_fraction_bottom.empty());
 
-      CoeffType z_tmp_step(10.L);
-      Antioch::set_zero(sum_densities);
-      VectorCoeffType densities_z = Antioch::zero_clone(sum_densities);
-
-      for(CoeffType z_tmp = z; z_tmp <= _zmax - z_tmp_step; z_tmp += z_tmp_step) //integration is ns_{i} = n_{i} * (z_{i+1} - z_{i}), i from bottom to top
+      const CoeffType column = this->first_guess_column(z);
+      for(unsigned int s = 0; s < sum_densities.size(); s++)
       {
-         this->first_guess_densities(z_tmp,densities_z);
-         for(unsigned int s = 0; s < sum_densities.size(); s++)
-         {
-            sum_densities[s] += densities_z[s]* z_tmp_step;;
-         }
+         sum_densities[s] = _neutral_molar_fraction_bottom[s] * column;
       }
   }
 
@@ -416,7 +677,7 @@ namespace Planet
   inline
   void AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType>::lower_boundary_concentrations(VectorStateType &low_densities) const
   {
-      antioch_assedrt_equal_to(low_densities.size(),_neutral_composition.n_species());
+      antioch_assert_equal_to(low_densities.size(),_neutral_composition.n_species());
       for(unsigned int s = 0; s < _neutral_composition.n_species(); s++)
       {
           low_densities[s] = _neutral_molar_fraction_bottom[s] * _total_bottom_density;
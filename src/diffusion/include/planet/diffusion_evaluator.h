@@ -69,6 +69,27 @@ namespace Planet{
                       const VectorStateType &dmolar_concentrations_dz,
                       const StateType &z, VectorStateType &omegas) const;
 
+       //! omegas at a state computed from molar_concentrations
+       template<typename VectorStateType>
+       void diffusion(const VectorStateType &molar_concentrations,
+                      const VectorStateType &dmolar_concentrations_dz,
+                      const AltitudeState<CoeffType,VectorCoeffType> &state, VectorStateType &omegas) const;
+
+       //! omegas and derivatives, wrt the concentrations domegas_dn[s][j]
+       //! and wrt the concentration gradients, which is diagonal: domegas_ddn_dz[s]
+       template<typename StateType, typename VectorStateType, typename MatrixStateType>
+       void diffusion_and_derivs(const VectorStateType &molar_concentrations,
+                                 const VectorStateType &dmolar_concentrations_dz,
+                                 const StateType &z, VectorStateType &omegas,
+                                 MatrixStateType &domegas_dn, VectorStateType &domegas_ddn_dz) const;
+
+       //! omegas and derivatives at a state computed from molar_concentrations
+       template<typename VectorStateType, typename MatrixStateType>
+       void diffusion_and_derivs(const VectorStateType &molar_concentrations,
+                                 const VectorStateType &dmolar_concentrations_dz,
+                                 const AltitudeState<CoeffType,VectorCoeffType> &state, VectorStateType &omegas,
+                                 MatrixStateType &domegas_dn, VectorStateType &domegas_ddn_dz) const;
+
   };
 
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
@@ -100,30 +121,35 @@ namespace Planet{
                                                                  const VectorStateType &dmolar_concentrations_dz,
                                                                  const StateType &z, VectorStateType &omegas) const
   {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _mixture.altitude_state(molar_concentrations,z,state);
+     this->diffusion(molar_concentrations,dmolar_concentrations_dz,state,omegas);
+
+     return;
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void DiffusionEvaluator<CoeffType, VectorCoeffType,MatrixCoeffType>::diffusion(const VectorStateType &molar_concentrations,
+                                                                 const VectorStateType &dmolar_concentrations_dz,
+                                                                 const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                 VectorStateType &omegas) const
+  {
 
      antioch_assert_equal_to(molar_concentrations.size(),_mixture.neutral_composition().n_species());
      antioch_assert_equal_to(dmolar_concentrations_dz.size(),_mixture.neutral_composition().n_species());
 
 // Dtilde
      VectorCoeffType molecular;
-     _molecular_diffusion.Dtilde(molar_concentrations,z,molecular);// Dtilde
-
-// nTot
-     CoeffType nTot(0.L);
-     for(unsigned int s = 0; s < molar_concentrations.size(); s++)
-     {
-        nTot += molar_concentrations[s];
-     }
-
-// scale heights
-     VectorCoeffType Hs;
-     _mixture.scale_heights(z,Hs);
-     //mean
-     CoeffType Ha = _mixture.atmospheric_scale_height(molar_concentrations,z);
+     _molecular_diffusion.Dtilde(molar_concentrations,state,molecular);// Dtilde
 
-// temperature
-     CoeffType T = _temperature.neutral_temperature(z);
-     CoeffType dT_dz = _temperature.dneutral_temperature_dz(z);
+// nTot, scale heights, temperature
+     const CoeffType &nTot = state.nTot;
+     const VectorCoeffType &Hs = state.Hs;
+     const CoeffType &Ha = state.Ha;
+     const CoeffType &T = state.T;
+     const CoeffType &dT_dz = state.dT_dz;
 
      omegas.resize(_mixture.neutral_composition().n_species(),0.L);
 // eddy diff
@@ -149,6 +175,83 @@ namespace Planet{
      return;
   }
 
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  inline
+  void DiffusionEvaluator<CoeffType, VectorCoeffType,MatrixCoeffType>::diffusion_and_derivs(const VectorStateType &molar_concentrations,
+                                                                 const VectorStateType &dmolar_concentrations_dz,
+                                                                 const StateType &z, VectorStateType &omegas,
+                                                                 MatrixStateType &domegas_dn, VectorStateType &domegas_ddn_dz) const
+  {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _mixture.altitude_state(molar_concentrations,z,state);
+     this->diffusion_and_derivs(molar_concentrations,dmolar_concentrations_dz,state,omegas,domegas_dn,domegas_ddn_dz);
+
+     return;
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void DiffusionEvaluator<CoeffType, VectorCoeffType,MatrixCoeffType>::diffusion_and_derivs(const VectorStateType &molar_concentrations,
+                                                                 const VectorStateType &dmolar_concentrations_dz,
+                                                                 const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                 VectorStateType &omegas,
+                                                                 MatrixStateType &domegas_dn, VectorStateType &domegas_ddn_dz) const
+  {
+     antioch_assert_equal_to(molar_concentrations.size(),_mixture.neutral_composition().n_species());
+     antioch_assert_equal_to(dmolar_concentrations_dz.size(),_mixture.neutral_composition().n_species());
+
+     const unsigned int n_species = _mixture.neutral_composition().n_species();
+
+// Dtilde
+     VectorCoeffType molecular;
+     MatrixCoeffType dmolecular_dn;
+     _molecular_diffusion.Dtilde_and_derivs(molar_concentrations,state,molecular,dmolecular_dn);
+
+// nTot, mean molar mass, scale heights (1/Ha is proportional to the mean molar mass), temperature
+     const CoeffType &nTot = state.nTot;
+     const CoeffType &Mm = state.Mm;
+     const VectorCoeffType &Hs = state.Hs;
+     const CoeffType &Ha = state.Ha;
+     const CoeffType &T = state.T;
+     const CoeffType &dT_dz = state.dT_dz;
+
+// eddy diff, K in 1/sqrt(nTot)
+     CoeffType eddy_K = _eddy_diffusion.K(nTot);
+     CoeffType deddy_K_dn = - eddy_K / (CoeffType(2.L) * nTot);
+
+     omegas.resize(n_species,0.L);
+     domegas_ddn_dz.resize(n_species,0.L);
+     domegas_dn.resize(n_species);
+     for(unsigned int s = 0; s < n_species; s++)
+     {
+        const CoeffType xs = molar_concentrations[s] / nTot;
+        const CoeffType grad = dmolar_concentrations_dz[s]/molar_concentrations[s];
+        const CoeffType molecular_term = grad + CoeffType(1.L)/Hs[s] 
+                                       + dT_dz/T * (CoeffType(1.L) + (CoeffType(1.L) - xs) * _mixture.thermal_coefficient()[s]);
+        const CoeffType eddy_term = grad + CoeffType(1.L)/Ha + dT_dz/T;
+
+        omegas[s] = - molecular[s] * molecular_term - eddy_K * eddy_term;
+        domegas_ddn_dz[s] = - (molecular[s] + eddy_K) / molar_concentrations[s];
+
+        domegas_dn[s].resize(n_species,0.L);
+        for(unsigned int j = 0; j < n_species; j++)
+        {
+           // d(1 - xs)/dnj = (xs - delta_sj) / nTot
+           CoeffType dmolecular_term = dT_dz/T * _mixture.thermal_coefficient()[s] * xs / nTot;
+           CoeffType deddy_term = (_mixture.neutral_composition().M(j) - Mm) / (nTot * Mm * Ha);
+           if(j == s)
+           {
+             dmolecular_term += - grad / molar_concentrations[s] - dT_dz/T * _mixture.thermal_coefficient()[s] / nTot;
+             deddy_term      += - grad / molar_concentrations[s];
+           }
+           domegas_dn[s][j] = - dmolecular_dn[s][j] * molecular_term - molecular[s] * dmolecular_term
+                              - deddy_K_dn * eddy_term - eddy_K * deddy_term;
+        }
+     }
+     return;
+  }
 
 }
 
@@ -90,6 +90,22 @@ namespace Planet
         void Dtilde(const VectorStateType &molar_concentrations, const StateType &z,
                     VectorStateType &Dtilde) const;// Dtilde
 
+        //! Dtilde at a state computed from molar_concentrations
+        template<typename VectorStateType>
+        void Dtilde(const VectorStateType &molar_concentrations, const AltitudeState<CoeffType,VectorCoeffType> &state,
+                    VectorStateType &Dtilde) const;
+
+        //! Dtilde and its derivatives wrt the concentrations, dDtilde_dn[s][j]
+        //! (binary coefficients in 1/P, P = nTot kb T)
+        template<typename StateType, typename VectorStateType, typename MatrixStateType>
+        void Dtilde_and_derivs(const VectorStateType &molar_concentrations, const StateType &z,
+                               VectorStateType &Dtilde, MatrixStateType &dDtilde_dn) const;
+
+        //! Dtilde and its derivatives at a state computed from molar_concentrations
+        template<typename VectorStateType, typename MatrixStateType>
+        void Dtilde_and_derivs(const VectorStateType &molar_concentrations, const AltitudeState<CoeffType,VectorCoeffType> &state,
+                               VectorStateType &Dtilde, MatrixStateType &dDtilde_dn) const;
+
         //!
         template<typename StateType>
         ANTIOCH_AUTO(StateType)
@@ -157,18 +173,27 @@ namespace Planet
   inline
   void MolecularDiffusionEvaluator<CoeffType, VectorCoeffType,MatrixCoeffType>::Dtilde(const VectorStateType &molar_concentrations, 
                                                                        const StateType &z,VectorStateType &Dtilde) const
+  {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _mixture.altitude_state(molar_concentrations,z,state);
+     this->Dtilde(molar_concentrations,state,Dtilde);
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void MolecularDiffusionEvaluator<CoeffType, VectorCoeffType,MatrixCoeffType>::Dtilde(const VectorStateType &molar_concentrations,
+                                                                       const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                       VectorStateType &Dtilde) const
   {
      antioch_assert_equal_to(molar_concentrations.size(),_mixture.neutral_composition().n_species());
 
      Dtilde.resize(molar_concentrations.size(),0.L);
-     CoeffType nTot(0.L);
-     for(unsigned int s = 0; s < molar_concentrations.size(); s++)
-     {
-        nTot += molar_concentrations[s];
-     }
-     CoeffType T = _temperature.neutral_temperature(z);
-     CoeffType p = nTot * 1e6 //cm-3 -> m-3
-                   * Constants::Universal::kb<CoeffType>() * T;
+     const CoeffType &nTot = state.nTot;
+     const CoeffType &T    = state.T;
+     const CoeffType &p    = state.P;
      for(unsigned int s = 0; s < _mixture.neutral_composition().n_species(); s++)
      {
 //M_{/=}
@@ -197,6 +222,81 @@ namespace Planet
        return;
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  inline
+  void MolecularDiffusionEvaluator<CoeffType, VectorCoeffType,MatrixCoeffType>::Dtilde_and_derivs(const VectorStateType &molar_concentrations,
+                                                                                  const StateType &z, VectorStateType &Dtilde,
+                                                                                  MatrixStateType &dDtilde_dn) const
+  {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _mixture.altitude_state(molar_concentrations,z,state);
+     this->Dtilde_and_derivs(molar_concentrations,state,Dtilde,dDtilde_dn);
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void MolecularDiffusionEvaluator<CoeffType, VectorCoeffType,MatrixCoeffType>::Dtilde_and_derivs(const VectorStateType &molar_concentrations,
+                                                                                  const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                                  VectorStateType &Dtilde,
+                                                                                  MatrixStateType &dDtilde_dn) const
+  {
+     antioch_assert_equal_to(molar_concentrations.size(),_mixture.neutral_composition().n_species());
+
+     const unsigned int n_species = molar_concentrations.size();
+     this->Dtilde(molar_concentrations,state,Dtilde);
+
+     dDtilde_dn.resize(n_species);
+     const CoeffType &nTot = state.nTot;
+     const CoeffType &T    = state.T;
+     const CoeffType &p    = state.P;
+
+// Dtilde = A / (n_D * F), A = ntot - ns, F = 1 - ns/ntot + Ms ns A / (ntot Q), Q = sum_{i/=s} Mi ni,
+// n_D = sum_m nm / D_{m,s} with D_{m,s} in 1/ntot: d ln Dtilde = d ln A - d ln n_D - d ln F
+     for(unsigned int s = 0; s < n_species; s++)
+     {
+        dDtilde_dn[s].resize(n_species,0.L);
+
+        const CoeffType A = nTot - molar_concentrations[s];
+        CoeffType Q;
+        Antioch::set_zero(Q);
+        for(unsigned int i = 0; i < n_species; i++)
+        {
+          if(i == s)continue;
+          Q += _mixture.neutral_composition().M(i) * molar_concentrations[i];
+        }
+        VectorCoeffType inv_D;
+        inv_D.resize(n_species,0.L);
+        CoeffType n_D;
+        Antioch::set_zero(n_D);
+        for(unsigned int i = 0; i < _n_medium; i++)
+        {
+          if(_i_medium[i] == s)continue;
+          inv_D[_i_medium[i]] = CoeffType(1.L) / this->binary_coefficient(_i_medium[i],s,T,p);
+          n_D += molar_concentrations[_i_medium[i]] * inv_D[_i_medium[i]];
+        }
+        const CoeffType Ms = _mixture.neutral_composition().M(s);
+        const CoeffType G = molar_concentrations[s] * A / (nTot * Q);
+        const CoeffType F = CoeffType(1.L) - molar_concentrations[s] / nTot + Ms * G;
+
+        for(unsigned int j = 0; j < n_species; j++)
+        {
+          const CoeffType dA = (j == s)?CoeffType(0.L):CoeffType(1.L);
+          const CoeffType dQ = (j == s)?CoeffType(0.L):_mixture.neutral_composition().M(j);
+          const CoeffType dln_nD = inv_D[j] / n_D + CoeffType(1.L) / nTot;
+          CoeffType dG = G * (dA / A - CoeffType(1.L) / nTot - dQ / Q);
+          if(j == s)dG += A / (nTot * Q);
+          const CoeffType dF = molar_concentrations[s] / (nTot * nTot) - ((j == s)?CoeffType(1.L) / nTot:CoeffType(0.L)) + Ms * dG;
+
+          dDtilde_dn[s][j] = Dtilde[s] * (dA / A - dln_nD - dF / F);
+        }
+     }
+     return;
+  }
+
 }
 
 #endif
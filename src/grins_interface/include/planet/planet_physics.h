@@ -37,6 +37,11 @@ namespace GRINS
 #include "planet/planet_physics_helper.h"
 
 // libMesh
+#include "libmesh/threads.h"
+
+// C++
+#include <iostream>
+
 class GetPot;
 namespace libMesh
 {
@@ -76,6 +81,10 @@ namespace Planet
 				      AssemblyContext& /*context*/,
 				      CachedValues& /*cache*/ );
 
+    //! Number of element evaluations serialized in a threaded assembly: kinetics
+    //! not thread safe (ionic coupling, backend or diagnostics) or altitude grid not fixed
+    unsigned int n_serialized_elements() const;
+
   protected:
 
     //! Number of species
@@ -95,6 +104,28 @@ namespace Planet
 
     PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType> _helper;
 
+    typedef typename PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::EvaluationContext EvaluationContext;
+
+    //! evaluation contexts, one per concurrent element assembly
+    std::vector<EvaluationContext*> _contexts;
+
+    //! contexts not in use
+    std::vector<EvaluationContext*> _free_contexts;
+
+    libMesh::Threads::spin_mutex    _contexts_mutex;
+
+    //! serializes the evaluations on the shared buffers of the helper
+    libMesh::Threads::spin_mutex    _serial_mutex;
+
+    //! element evaluations of a threaded assembly that took the serial fallback
+    unsigned int                    _n_serialized_elements;
+
+    //! takes a free context, creates one if none
+    EvaluationContext & acquire_context();
+
+    //! gives back a context
+    void release_context(EvaluationContext & evaluation_context);
+
   private:
 
     PlanetPhysics();
@@ -107,7 +138,8 @@ namespace Planet
     : GRINS::Physics(physics_name,input), 
       _n_species( input.vector_variable_size("Physics/Chemistry/species") ),
       _species_FE_family( libMesh::Utility::string_to_enum<libMeshEnums::FEFamily>( input("Physics/Planet/species_FE_family", "LAGRANGE") ) ),
-      _species_order( libMesh::Utility::string_to_enum<libMeshEnums::Order>( input("Physics/Planet/species_order", "FIRST") ) )
+      _species_order( libMesh::Utility::string_to_enum<libMeshEnums::Order>( input("Physics/Planet/species_order", "FIRST") ) ),
+      _n_serialized_elements(0)
   {
      _species_var_names.reserve(this->_n_species);
     for( unsigned int i = 0; i < this->_n_species; i++ )
@@ -123,6 +155,7 @@ namespace Planet
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   PlanetPhysics<CoeffType,VectorCoeffType,MatrixCoeffType>::~PlanetPhysics()
   {
+    for(unsigned int i = 0; i < _contexts.size(); i++)delete _contexts[i];
     return;
   }
 
@@ -139,6 +172,35 @@ namespace Planet
     return;
   }
 
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  typename PlanetPhysics<CoeffType,VectorCoeffType,MatrixCoeffType>::EvaluationContext &
+  PlanetPhysics<CoeffType,VectorCoeffType,MatrixCoeffType>::acquire_context()
+  {
+    libMesh::Threads::spin_mutex::scoped_lock lock(_contexts_mutex);
+    if(_free_contexts.empty())
+      {
+        _contexts.push_back(new EvaluationContext);
+        _helper.init_evaluation_context(*_contexts.back());
+        return *_contexts.back();
+      }
+    EvaluationContext * evaluation_context = _free_contexts.back();
+    _free_contexts.pop_back();
+    return *evaluation_context;
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  void PlanetPhysics<CoeffType,VectorCoeffType,MatrixCoeffType>::release_context(EvaluationContext & evaluation_context)
+  {
+    libMesh::Threads::spin_mutex::scoped_lock lock(_contexts_mutex);
+    _free_contexts.push_back(&evaluation_context);
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  unsigned int PlanetPhysics<CoeffType,VectorCoeffType,MatrixCoeffType>::n_serialized_elements() const
+  {
+    return _n_serialized_elements;
+  }
+
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   void PlanetPhysics<CoeffType,VectorCoeffType,MatrixCoeffType>::set_time_evolving_vars( libMesh::FEMSystem* system )
   {
@@ -187,43 +249,123 @@ namespace Planet
     const std::vector<libMesh::Point>& s_qpoint = 
       context.get_element_fe(var)->get_xyz();
 
+    // quadrature points numbered by element for the column cache lookups
+    const unsigned int first_point = context.get_elem().id() * n_qpoints;
+
+    // all the points of the element at once, flattened point by point
+    std::vector<libMesh::Number> molar_concentrations(n_qpoints * this->_n_species, 0);
+    std::vector<libMesh::Number> dmolar_concentrations_dz(n_qpoints * this->_n_species, 0);
+    std::vector<libMesh::Number> altitudes(n_qpoints, 0);
     for (unsigned int qp=0; qp != n_qpoints; qp++)
       {
-        const libMesh::Number r = s_qpoint[qp](0);
-        
-        libMesh::Real jac = r*r*JxW[qp];
-
-        std::vector<libMesh::Number> molar_concentrations(this->_n_species, 0);
-        std::vector<libMesh::Number> dmolar_concentrations_dz(this->_n_species, 0);
+        altitudes[qp] = s_qpoint[qp](0) - Constants::Titan::radius<double>(); // z
         for(unsigned int s=0; s < this->_n_species; s++ )
           {
-            molar_concentrations[s] = context.interior_value(this->_species_vars[s],qp);
-            dmolar_concentrations_dz[s] = context.interior_gradient(this->_species_vars[s],qp)(0);
+            molar_concentrations[qp * this->_n_species + s] = context.interior_value(this->_species_vars[s],qp);
+            dmolar_concentrations_dz[qp * this->_n_species + s] = context.interior_gradient(this->_species_vars[s],qp)(0);
+          }
+      }
+
+    std::vector<libMesh::Number> omegas;
+    std::vector<libMesh::Number> omegas_dot;
+
+    // derivatives at each point, photolysis lagged
+    std::vector<MatrixCoeffType> domegas_dn;
+    std::vector<VectorCoeffType> domegas_ddn_dz;
+    std::vector<MatrixCoeffType> domegas_dot_dn;
+
+    if( compute_jacobian )
+      {
+        // Antioch evaluators and shared derivative buffers, the threads take turns
+        libMesh::Threads::spin_mutex::scoped_lock lock(_serial_mutex);
+        omegas.resize(n_qpoints * this->_n_species);
+        omegas_dot.resize(n_qpoints * this->_n_species);
+        domegas_dn.resize(n_qpoints);
+        domegas_ddn_dz.resize(n_qpoints);
+        domegas_dot_dn.resize(n_qpoints);
+        VectorCoeffType n(this->_n_species);
+        VectorCoeffType dn_dz(this->_n_species);
+        for (unsigned int qp=0; qp != n_qpoints; qp++)
+          {
+            for(unsigned int s=0; s < this->_n_species; s++ )
+              {
+                n[s]     = molar_concentrations[qp * this->_n_species + s];
+                dn_dz[s] = dmolar_concentrations_dz[qp * this->_n_species + s];
+              }
+            _helper.compute_and_derivs(n, dn_dz, altitudes[qp], first_point + qp,
+                                       domegas_dn[qp], domegas_ddn_dz[qp], domegas_dot_dn[qp]);
+            for(unsigned int s=0; s < this->_n_species; s++ )
+              {
+                omegas[qp * this->_n_species + s]     = _helper.diffusion_term(s);
+                omegas_dot[qp * this->_n_species + s] = _helper.chemical_term(s);
+              }
           }
+      }else if(_helper.thread_safe())
+      {
+        // the column cache is updated out of the assembly, see PlanetPhysicsHelper::update_column
+        EvaluationContext & evaluation_context = this->acquire_context();
+        _helper.compute_element(evaluation_context, first_point, n_qpoints, molar_concentrations, dmolar_concentrations_dz, altitudes,
+                                omegas, omegas_dot);
+        {
+          // nodes are shared with the neighbouring elements
+          libMesh::Threads::spin_mutex::scoped_lock lock(_serial_mutex);
+          _helper.publish_evaluation_context(evaluation_context);
+        }
+        this->release_context(evaluation_context);
+      }else
+      {
+        // shared buffers, the threads take turns
+        libMesh::Threads::spin_mutex::scoped_lock lock(_serial_mutex);
+        if(libMesh::n_threads() > 1)_n_serialized_elements++;
+        _helper.compute_element(first_point, n_qpoints, molar_concentrations, dmolar_concentrations_dz, altitudes,
+                                omegas, omegas_dot);
+      }
+
+    for (unsigned int qp=0; qp != n_qpoints; qp++)
+      {
+        const libMesh::Number r = s_qpoint[qp](0);
+        
+        libMesh::Real jac = r*r*JxW[qp];
 
         for(unsigned int s=0; s < this->_n_species; s++ )
           {
-            const libMesh::Real n_s = context.interior_value(this->_species_vars[s],qp);
+            const libMesh::Real n_s = molar_concentrations[qp * this->_n_species + s];
 
             libMesh::DenseSubVector<libMesh::Number> &Fs = 
               context.get_elem_residual(this->_species_vars[s]); // R_{s}
 
-            _helper.compute(molar_concentrations, dmolar_concentrations_dz, // {n}_s, {dn_dz}_s
-                            r - Constants::Titan::radius<double>() ) ; // z
-
-            libMesh::Real omega = _helper.diffusion_term(s);
+            libMesh::Real omega = omegas[qp * this->_n_species + s];
 
-            libMesh::Real omega_dot = _helper.chemical_term(s);
+            libMesh::Real omega_dot = omegas_dot[qp * this->_n_species + s];
 
             for(unsigned int i=0; i != n_s_dofs; i++)
               {
                 Fs(i) += (  omega_dot*s_phi[i][qp] 
  //                         + 2*omega*n_s*s_phi[i][qp] 
                             - omega*n_s*s_grad_phi[i][qp](0) )*jac;
+              }
 
-                if( compute_jacobian )
+            if( compute_jacobian )
+              {
+                // d(omega n_s)/dn_j = domega/dn_j n_s + omega delta_sj,
+                // d(omega n_s)/d(dn_s/dz) = domega/d(dn_s/dz) n_s
+                for(unsigned int j=0; j < this->_n_species; j++ )
                   {
-                    libmesh_not_implemented();
+                    libMesh::DenseSubMatrix<libMesh::Number> &Ksj = 
+                      context.get_elem_jacobian(this->_species_vars[s],this->_species_vars[j]); // R_{s},{j}
+
+                    const libMesh::Real dflux_dn = domegas_dn[qp][s][j] * n_s + ((j == s)?omega:0.);
+                    const libMesh::Real dflux_ddn = (j == s)?domegas_ddn_dz[qp][s] * n_s:0.;
+
+                    for(unsigned int i=0; i != n_s_dofs; i++)
+                      {
+                        for(unsigned int k=0; k != n_s_dofs; k++)
+                          {
+                            Ksj(i,k) += (  domegas_dot_dn[qp][s][j]*s_phi[k][qp]*s_phi[i][qp]
+                                         - ( dflux_dn*s_phi[k][qp] + dflux_ddn*s_grad_phi[k][qp](0) )*s_grad_phi[i][qp](0)
+                                        )*jac*context.get_elem_solution_derivative();
+                          }
+                      }
                   }
               }
 
@@ -266,18 +408,27 @@ namespace Planet
 
         for(unsigned int s=0; s < this->_n_species; s++ )
           {
-            const libMesh::Real n_s_dot = context.interior_value(this->_species_vars[s],qp);
+            const libMesh::Real n_s_dot = context.interior_rate(this->_species_vars[s],qp);
 
             libMesh::DenseSubVector<libMesh::Number> &Fs = 
               context.get_elem_residual(this->_species_vars[s]); // R_{s}
 
             for(unsigned int i=0; i != n_s_dofs; i++)
               {
-                Fs(i) += ( n_s_dot*phi[i][qp] )*jac;
+                Fs(i) += ( n_s_dot*s_phi[i][qp] )*jac;
+              }
+
+            if( compute_jacobian )
+              {
+                libMesh::DenseSubMatrix<libMesh::Number> &Kss = 
+                  context.get_elem_jacobian(this->_species_vars[s],this->_species_vars[s]); // R_{s},{s}
 
-                if( compute_jacobian )
+                for(unsigned int i=0; i != n_s_dofs; i++)
                   {
-                    libmesh_not_implemented();
+                    for(unsigned int k=0; k != n_s_dofs; k++)
+                      {
+                        Kss(i,k) += s_phi[k][qp]*s_phi[i][qp]*jac*context.get_elem_solution_rate_derivative();
+                      }
                   }
               }
           }
@@ -30,9 +30,18 @@
 //Planet
 #include "planet/diffusion_evaluator.h"
 #include "planet/atmospheric_kinetics.h"
+#include "planet/chemistry_integrator.h"
+#include "planet/column_density_integrator.h"
 
 // libMesh
 #include "libmesh/libmesh_common.h"
+#include "libmesh/threads.h"
+
+//C++
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 
 namespace Planet
 {
@@ -42,6 +51,33 @@ namespace Planet
   {
   public:
 
+    /*! mutable state of one evaluation, one per thread.
+     *
+     * The evaluators, the tables and the column cache are shared, everything
+     * an evaluation writes lives here, but the composition rows of the column
+     * cache: each point is written by the only element it belongs to.
+     */
+    struct EvaluationContext
+    {
+      VectorCoeffType omegas;
+      VectorCoeffType point_molar;
+      VectorCoeffType point_dmolar;
+      VectorCoeffType T;
+      VectorCoeffType dT_dz;
+      std::vector<VectorCoeffType> miss_sums;
+      std::vector<const VectorCoeffType*> sums;
+      std::vector<AltitudeState<CoeffType,VectorCoeffType> > states;
+      std::vector<unsigned int> element_indices;
+      //! compositions at the cache hits, not yet in the column cache (see publish_evaluation_context)
+      std::vector<unsigned int>    cached_indices;
+      std::vector<VectorCoeffType> cached_compositions;
+      unsigned int    n_hits;
+      unsigned int    n_misses;
+      typename AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::Workspace kinetics;
+
+      EvaluationContext():n_hits(0),n_misses(0){}
+    };
+
     PlanetPhysicsHelper(AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType> &compo,
                         AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType > *kinetics = NULL,
                         DiffusionEvaluator <CoeffType,VectorCoeffType,MatrixCoeffType > *diffusion = NULL);
@@ -58,16 +94,185 @@ namespace Planet
 
     libMesh::Real chemical_term(unsigned int s)  const;
 
+    //!\return diffusion terms of all species, from the last compute
+    const VectorCoeffType &diffusion_terms() const;
+
+    //!\return chemical terms of all species, from the last compute
+    const VectorCoeffType &chemical_terms() const;
+
     //computes omega_dot and omega
     template<typename StateType, typename VectorStateType>
     void compute(const VectorStateType & molar_concentrations,
                  const VectorStateType & dmolar_concentrations_dz,
                  const StateType & z);
 
-    //!fills molar_concentrations_first_guess with barometric equation
+    //computes omega_dot and omega at altitude index iz of the column cache
+    template<typename StateType, typename VectorStateType>
+    void compute(const VectorStateType & molar_concentrations,
+                 const VectorStateType & dmolar_concentrations_dz,
+                 const StateType & z, unsigned int iz);
+
+    //!computes omega_dot and omega, and their derivatives wrt the concentrations
+    //!and the concentration gradients (diagonal), the photon flux is lagged:
+    //!the column above is not differentiated
+    template<typename StateType, typename VectorStateType, typename MatrixStateType>
+    void compute_and_derivs(const VectorStateType & molar_concentrations,
+                            const VectorStateType & dmolar_concentrations_dz,
+                            const StateType & z,
+                            MatrixStateType & ddiffusion_dn,
+                            VectorStateType & ddiffusion_ddn_dz,
+                            MatrixStateType & dchemical_dn);
+
+    //!compute_and_derivs at quadrature point `point` (numbered by element, see compute_element)
+    template<typename StateType, typename VectorStateType, typename MatrixStateType>
+    void compute_and_derivs(const VectorStateType & molar_concentrations,
+                            const VectorStateType & dmolar_concentrations_dz,
+                            const StateType & z, unsigned int point,
+                            MatrixStateType & ddiffusion_dn,
+                            VectorStateType & ddiffusion_ddn_dz,
+                            MatrixStateType & dchemical_dn);
+
+    //!omega and its derivatives at any altitude, the column cache is not involved
+    template<typename StateType, typename VectorStateType, typename MatrixStateType>
+    void diffusion_and_derivs(const VectorStateType & molar_concentrations,
+                              const VectorStateType & dmolar_concentrations_dz,
+                              const StateType & z,
+                              VectorStateType & diffusion_terms,
+                              MatrixStateType & ddiffusion_dn,
+                              VectorStateType & ddiffusion_ddn_dz) const;
+
+    //!omega at any altitude, the column cache is not involved
+    template<typename StateType, typename VectorStateType>
+    void diffusion(const VectorStateType & molar_concentrations,
+                   const VectorStateType & dmolar_concentrations_dz,
+                   const StateType & z,
+                   VectorStateType & diffusion_terms) const;
+
+    //!omega_dot at node iz of the altitude grid, no lookup, no derivatives
+    template<typename StateType, typename VectorStateType>
+    void chemical(const VectorStateType & molar_concentrations,
+                  const StateType & z, unsigned int iz,
+                  VectorStateType & chemical_terms);
+
+    //!omega_dot and its derivatives wrt the concentrations, the column cache is used
+    //!and updated as in compute, photon flux lagged
+    template<typename StateType, typename VectorStateType, typename MatrixStateType>
+    void chemical_and_derivs(const VectorStateType & molar_concentrations,
+                             const StateType & z,
+                             VectorStateType & chemical_terms,
+                             MatrixStateType & dchemical_dn);
+
+    //!omega_dot and its derivatives at node iz of the altitude grid, no lookup
+    template<typename StateType, typename VectorStateType, typename MatrixStateType>
+    void chemical_and_derivs(const VectorStateType & molar_concentrations,
+                             const StateType & z, unsigned int iz,
+                             VectorStateType & chemical_terms,
+                             MatrixStateType & dchemical_dn);
+
+    //!omega_dot and its derivatives at a state computed from the concentrations,
+    //!the column cache is used and updated as in compute
+    template<typename VectorStateType, typename MatrixStateType>
+    void chemical_and_derivs(const VectorStateType & molar_concentrations,
+                             const AltitudeState<CoeffType,VectorCoeffType> & state,
+                             VectorStateType & chemical_terms,
+                             MatrixStateType & dchemical_dn);
+
+    //!computes omega and omega_dot at all the points of an element,
+    //!arrays are flattened point by point: value of species s at point p is [p * n_species + s].
+    //!The points are numbered first_point + p (element id * number of quadrature points),
+    //!their index in the column cache is looked up once and then read from a table.
+    //!The temperatures of the element are computed in one pass, the kinetics are per point
+    template<typename VectorStateType>
+    void compute_element(unsigned int first_point,
+                         unsigned int n_points,
+                         const VectorStateType & molar_concentrations,
+                         const VectorStateType & dmolar_concentrations_dz,
+                         const VectorStateType & z,
+                         VectorStateType & diffusion_terms,
+                         VectorStateType & chemical_terms);
+
+    //!sizes the buffers of an evaluation context
+    void init_evaluation_context(EvaluationContext &context) const;
+
+    //!thread safe compute_element, the altitude grid must be fixed, the column
+    //!is not recomputed (see update_column). Temperatures, rate constants and
+    //!rates of progress are computed in one pass over the element. The compositions
+    //!at the cache hits are kept in the context until publish_evaluation_context
+    template<typename VectorStateType>
+    void compute_element(EvaluationContext & context,
+                         unsigned int first_point,
+                         unsigned int n_points,
+                         const VectorStateType & molar_concentrations,
+                         const VectorStateType & dmolar_concentrations_dz,
+                         const VectorStateType & z,
+                         VectorStateType & diffusion_terms,
+                         VectorStateType & chemical_terms);
+
+    //!stores in the column cache the compositions at the cache hits of the context,
+    //!the cache is shared: serialize the calls (one lock for all the contexts)
+    void publish_evaluation_context(EvaluationContext & context);
+
+    //!recomputes the column cache from the last compositions, to be called out of threaded regions
+    void update_column();
+
+    //!recomputes the column cache from the nodal densities on the altitude grid,
+    //!flattened: density of species s at node iz is [iz * n_species + s]
+    template<typename VectorStateType>
+    void update_column(const VectorStateType &nodal_densities);
+
+    //!frozen column: the compositions are still stored, the column above
+    //!(photolysis) is recomputed only by update_column
+    void freeze_column(bool freeze);
+
+    //!\return true if the column is frozen
+    bool column_frozen() const;
+
+    //!\return true if the context compute_element can run concurrently:
+    //! fixed altitude grid and thread safe kinetics
+    bool thread_safe() const;
+
+    //!fixes the altitudes of the column cache, any other altitude is a cache miss
+    template<typename VectorStateType>
+    void set_altitude_grid(const VectorStateType &altitudes);
+
+    //!\return index of z in the column cache, n_altitudes() if not in it,
+    //!z is in the cache if within a 1e-6 fraction of the local spacing of a node
+    template<typename StateType>
+    unsigned int altitude_index(const StateType &z) const;
+
+    //!\return number of altitudes in the column cache
+    unsigned int n_altitudes() const;
+
+    //!\return column above altitude index iz
+    const VectorCoeffType &column_sum(unsigned int iz) const;
+
+    //!\return column table, read only
+    const ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &column() const;
+
+    //!\return number of evaluations out of the fixed altitude grid
+    unsigned int n_cache_misses() const;
+
+    //!\return number of evaluations on a node of the column cache
+    unsigned int n_cache_hits() const;
+
+    //!fills molar_concentrations_first_guess with the relaxed guess if z is a relaxed node, barometric equation otherwise
     template<typename StateType, typename VectorStateType>
     void first_guess(VectorStateType & molar_concentrations_first_guess, const StateType z) const;
 
+    //!first guess at node iz of the altitude grid, no lookup
+    template<typename StateType, typename VectorStateType>
+    void first_guess(VectorStateType & molar_concentrations_first_guess, const StateType z, unsigned int iz) const;
+
+    //!relaxes the barometric guess towards photochemical equilibrium at the nodes of the altitude grid,
+    //!nodes are independent (column above from the barometric guess) and relaxed concurrently if the
+    //!kinetics are thread safe, a failure keeps the barometric guess
+    //!\return number of nodes that were relaxed
+    unsigned int relax_first_guess(const ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &integrator);
+
+    //!\return true if the last relax_first_guess relaxed the nodes serially,
+    //!the kinetics not being thread safe (ionic coupling, backend or diagnostics)
+    bool relaxed_serially() const;
+
     //!fills lower boundary conditions
     template<typename VectorStateType>
     void lower_boundary_dirichlet(VectorStateType & lower_boundary) const;
@@ -80,23 +285,91 @@ namespace Planet
 
   private:
 
+    //! relaxes a range of nodes, one kinetics workspace per call
+    class RelaxNodes
+    {
+    public:
+      RelaxNodes(const ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &integrator,
+                 const VectorCoeffType &altitudes, const MatrixCoeffType &sum_densities,
+                 MatrixCoeffType &densities, std::vector<unsigned int> &relaxed):
+        _integrator(integrator),_altitudes(altitudes),_sum_densities(sum_densities),
+        _densities(densities),_relaxed(relaxed){}
+
+      void operator()(const libMesh::Threads::BlockedRange<unsigned int> &range) const;
+
+    private:
+      const ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &_integrator;
+      const VectorCoeffType           &_altitudes;
+      const MatrixCoeffType           &_sum_densities;
+      MatrixCoeffType                 &_densities;
+      std::vector<unsigned int>       &_relaxed;
+    };
+
     AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType> *_kinetics;
     DiffusionEvaluator <CoeffType,VectorCoeffType,MatrixCoeffType> *_diffusion;
 
-    template<typename VectorStateType, typename StateType>
-    void update_cache(const VectorStateType &molar_concentrations, const StateType &z);
+    template<typename VectorStateType>
+    void update_cache(const VectorStateType &molar_concentrations, unsigned int iz);
+
+    //! index of point in the column cache, from the point table if already looked up
+    //! and still at z (the mesh may have been refined or renumbered since)
+    template <typename StateType>
+    unsigned int point_altitude_index(unsigned int point, const StateType &z);
+
+    //! true if z is node iz of the column cache, within a 1e-6 fraction of the local spacing
+    template <typename StateType>
+    bool node_at(const StateType &z, unsigned int iz) const;
+
+    //! index of z in the column cache, the miss path is taken if not in it, hits are counted
+    template <typename StateType>
+    unsigned int cache_lookup(const StateType &z);
+
+    //! omega_dot and its derivatives with the column of index iz (miss column if n_altitudes())
+    template<typename VectorStateType, typename MatrixStateType>
+    void chemical_and_derivs(const VectorStateType & molar_concentrations,
+                             const AltitudeState<CoeffType,VectorCoeffType> & state,
+                             unsigned int iz,
+                             VectorStateType & chemical_terms,
+                             MatrixStateType & dchemical_dn);
 
     void cache_recompute();
 
-    //! uses compo.barometric_density(z);
+    //! miss path, z not in the cache: new altitude if the grid is not fixed,
+    //! barometric column in _miss_sum otherwise, index n_altitudes() returned
     template <typename StateType>
-    const VectorCoeffType get_cache(const StateType &z) const;
+    unsigned int cache_miss(const StateType &z);
 
     VectorCoeffType _omegas;
     VectorCoeffType _omegas_dots;
-    MatrixCoeffType _cache_composition;
-    VectorCoeffType _cache_altitudes;
-    std::map<CoeffType,VectorCoeffType> _cache;
+
+    //! state of the point being computed, shared by diffusion and kinetics
+    AltitudeState<CoeffType,VectorCoeffType> _state;
+
+    //! one point of an element, compute_element scratch
+    VectorCoeffType _point_molar;
+    VectorCoeffType _point_dmolar;
+    std::vector<unsigned int> _element_indices;
+    VectorCoeffType _element_T;
+    VectorCoeffType _element_dT_dz;
+
+    //! column cache, altitudes in increasing order, one row per altitude,
+    //! columns integrated from the compositions
+    ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> _column;
+    MatrixCoeffType   _cache_composition;
+    std::vector<bool> _cache_filled;
+    bool              _cache_fixed;
+    bool              _column_frozen;
+    unsigned int      _cache_updates;
+    unsigned int      _cache_misses;
+    unsigned int      _cache_hits;
+    VectorCoeffType   _miss_sum;
+    //! index in the column cache of the quadrature points already looked up,
+    //! libMesh::invalid_uint if not yet
+    std::vector<unsigned int> _point_index;
+    //! relaxed first guesses, one row per node of the altitude grid
+    MatrixCoeffType   _relaxed_guess;
+    std::vector<bool> _relaxed;
+    bool              _relaxed_serially;
 
     AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType> &_composition;//for first guess
 
@@ -108,14 +381,165 @@ namespace Planet
                                                                const VectorStateType & dmolar_concentrations_dz,
                                                                const StateType & z)
   {
-   _diffusion->diffusion(molar_concentrations,dmolar_concentrations_dz,z,_omegas);
-   _kinetics->chemical_rate(molar_concentrations,this->get_cache(z),z,_omegas_dots);
+   const unsigned int iz = this->cache_lookup(z);
+
+   if(iz == this->n_altitudes())
+   {
+     _composition.altitude_state(molar_concentrations,z,_state);
+     _diffusion->diffusion(molar_concentrations,dmolar_concentrations_dz,_state,_omegas);
+     _kinetics->chemical_rate(molar_concentrations,_miss_sum,_state,_omegas_dots);
+   }else
+   {
+     this->compute(molar_concentrations,dmolar_concentrations_dz,z,iz);
+   }
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::compute(const VectorStateType & molar_concentrations,
+                                                               const VectorStateType & dmolar_concentrations_dz,
+                                                               const StateType & z, unsigned int iz)
+  {
+   antioch_assert_less(iz,this->n_altitudes());
+
+   _composition.altitude_state(molar_concentrations,z,_state);
+   _diffusion->diffusion(molar_concentrations,dmolar_concentrations_dz,_state,_omegas);
+   _kinetics->chemical_rate(molar_concentrations,_column.column(iz),_state,_omegas_dots);
+
+   this->update_cache(molar_concentrations,iz);
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_and_derivs(const VectorStateType & molar_concentrations,
+                                                                                          const VectorStateType & dmolar_concentrations_dz,
+                                                                                          const StateType & z,
+                                                                                          MatrixStateType & ddiffusion_dn,
+                                                                                          VectorStateType & ddiffusion_ddn_dz,
+                                                                                          MatrixStateType & dchemical_dn)
+  {
+   _composition.altitude_state(molar_concentrations,z,_state);
+   _diffusion->diffusion_and_derivs(molar_concentrations,dmolar_concentrations_dz,_state,_omegas,ddiffusion_dn,ddiffusion_ddn_dz);
+   this->chemical_and_derivs(molar_concentrations,_state,_omegas_dots,dchemical_dn);
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_and_derivs(const VectorStateType & molar_concentrations,
+                                                                                          const VectorStateType & dmolar_concentrations_dz,
+                                                                                          const StateType & z, unsigned int point,
+                                                                                          MatrixStateType & ddiffusion_dn,
+                                                                                          VectorStateType & ddiffusion_ddn_dz,
+                                                                                          MatrixStateType & dchemical_dn)
+  {
+   unsigned int iz = this->point_altitude_index(point,z);
+   if(iz == this->n_altitudes())
+   {
+     iz = this->cache_miss(z);
+   }else
+   {
+     _cache_hits++;
+   }
 
-   this->update_cache(molar_concentrations,z);
+   _composition.altitude_state(molar_concentrations,z,_state);
+   _diffusion->diffusion_and_derivs(molar_concentrations,dmolar_concentrations_dz,_state,_omegas,ddiffusion_dn,ddiffusion_ddn_dz);
+   this->chemical_and_derivs(molar_concentrations,_state,iz,_omegas_dots,dchemical_dn);
 
     return;
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::diffusion_and_derivs(const VectorStateType & molar_concentrations,
+                                                                                            const VectorStateType & dmolar_concentrations_dz,
+                                                                                            const StateType & z,
+                                                                                            VectorStateType & diffusion_terms,
+                                                                                            MatrixStateType & ddiffusion_dn,
+                                                                                            VectorStateType & ddiffusion_ddn_dz) const
+  {
+   _diffusion->diffusion_and_derivs(molar_concentrations,dmolar_concentrations_dz,z,diffusion_terms,ddiffusion_dn,ddiffusion_ddn_dz);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::diffusion(const VectorStateType & molar_concentrations,
+                                                                                 const VectorStateType & dmolar_concentrations_dz,
+                                                                                 const StateType & z,
+                                                                                 VectorStateType & diffusion_terms) const
+  {
+   _diffusion->diffusion(molar_concentrations,dmolar_concentrations_dz,z,diffusion_terms);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical(const VectorStateType & molar_concentrations,
+                                                                                const StateType & z, unsigned int iz,
+                                                                                VectorStateType & chemical_terms)
+  {
+   antioch_assert_less(iz,this->n_altitudes());
+   _cache_hits++;
+
+   _composition.altitude_state(molar_concentrations,z,_state);
+   _kinetics->chemical_rate(molar_concentrations,_column.column(iz),_state,chemical_terms);
+
+   this->update_cache(molar_concentrations,iz);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_and_derivs(const VectorStateType & molar_concentrations,
+                                                                                           const StateType & z,
+                                                                                           VectorStateType & chemical_terms,
+                                                                                           MatrixStateType & dchemical_dn)
+  {
+   _composition.altitude_state(molar_concentrations,z,_state);
+   this->chemical_and_derivs(molar_concentrations,_state,chemical_terms,dchemical_dn);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_and_derivs(const VectorStateType & molar_concentrations,
+                                                                                           const StateType & z, unsigned int iz,
+                                                                                           VectorStateType & chemical_terms,
+                                                                                           MatrixStateType & dchemical_dn)
+  {
+   antioch_assert_less(iz,this->n_altitudes());
+   _cache_hits++;
+
+   _composition.altitude_state(molar_concentrations,z,_state);
+   this->chemical_and_derivs(molar_concentrations,_state,iz,chemical_terms,dchemical_dn);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_and_derivs(const VectorStateType & molar_concentrations,
+                                                                                           const AltitudeState<CoeffType,VectorCoeffType> & state,
+                                                                                           VectorStateType & chemical_terms,
+                                                                                           MatrixStateType & dchemical_dn)
+  {
+   this->chemical_and_derivs(molar_concentrations,state,this->cache_lookup(state.z),chemical_terms,dchemical_dn);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_and_derivs(const VectorStateType & molar_concentrations,
+                                                                                           const AltitudeState<CoeffType,VectorCoeffType> & state,
+                                                                                           unsigned int iz,
+                                                                                           VectorStateType & chemical_terms,
+                                                                                           MatrixStateType & dchemical_dn)
+  {
+   const VectorCoeffType &sum = (iz == this->n_altitudes())?_miss_sum:_column.column(iz);
+   _kinetics->chemical_rate_and_derivs(molar_concentrations,sum,state,chemical_terms,dchemical_dn);
+
+   if(iz != this->n_altitudes())this->update_cache(molar_concentrations,iz);
+  }
+
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   template <typename StateType, typename VectorStateType, typename MatrixStateType>
   void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::set_kinetics(AtmosphericKinetics<StateType,VectorStateType,MatrixStateType> *kinetics)
@@ -136,10 +560,18 @@ namespace Planet
                                                         DiffusionEvaluator <CoeffType,VectorCoeffType,MatrixCoeffType > *diffusion):
         _kinetics(kinetics),
         _diffusion(diffusion),
+        _column(kinetics->neutral_kinetics().reaction_set().n_species()),
+        _cache_fixed(false),
+        _column_frozen(false),
+        _cache_updates(0),
+        _cache_misses(0),
+        _cache_hits(0),
+        _relaxed_serially(false),
         _composition(compo)
   {
     _omegas.resize(_kinetics->neutral_kinetics().reaction_set().n_species());
     _omegas_dots.resize(_kinetics->neutral_kinetics().reaction_set().n_species());
+    _miss_sum.resize(_kinetics->neutral_kinetics().reaction_set().n_species());
     return;
   }
 
@@ -161,71 +593,480 @@ namespace Planet
     return _omegas_dots[s];
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_element(unsigned int first_point,
+                                                                                       unsigned int n_points,
+                                                                                       const VectorStateType & molar_concentrations,
+                                                                                       const VectorStateType & dmolar_concentrations_dz,
+                                                                                       const VectorStateType & z,
+                                                                                       VectorStateType & diffusion_terms,
+                                                                                       VectorStateType & chemical_terms)
+  {
+    const unsigned int n_species = _omegas.size();
+    antioch_assert_equal_to(molar_concentrations.size(),n_points * n_species);
+    antioch_assert_equal_to(dmolar_concentrations_dz.size(),n_points * n_species);
+    antioch_assert_equal_to(z.size(),n_points);
+
+    diffusion_terms.resize(n_points * n_species);
+    chemical_terms.resize(n_points * n_species);
+    _point_molar.resize(n_species);
+    _point_dmolar.resize(n_species);
+
+    // cache lookups of the element first, new altitudes are inserted
+    // before any index is taken as insertions shift them
+    if(!_cache_fixed)
+    {
+      for(unsigned int p = 0; p < n_points; p++)
+      {
+        if(this->point_altitude_index(first_point + p,z[p]) == this->n_altitudes())this->cache_miss(z[p]);
+      }
+    }
+    _element_indices.resize(n_points);
+    for(unsigned int p = 0; p < n_points; p++)_element_indices[p] = this->point_altitude_index(first_point + p,z[p]);
+
+    _composition.neutral_temperatures_and_dz(z,_element_T,_element_dT_dz);
+
+    for(unsigned int p = 0; p < n_points; p++)
+    {
+      const unsigned int offset = p * n_species;
+      for(unsigned int s = 0; s < n_species; s++)
+      {
+        _point_molar[s]  = molar_concentrations[offset + s];
+        _point_dmolar[s] = dmolar_concentrations_dz[offset + s];
+      }
+
+      const unsigned int iz = _element_indices[p];
+      if(iz == this->n_altitudes())this->cache_miss(z[p]);
+      else _cache_hits++;
+
+      _composition.altitude_state(_point_molar,z[p],_element_T[p],_element_dT_dz[p],_state);
+      _diffusion->diffusion(_point_molar,_point_dmolar,_state,_omegas);
+      _kinetics->chemical_rate(_point_molar,(iz == this->n_altitudes())?_miss_sum:_column.column(iz),_state,_omegas_dots);
+
+      if(iz != this->n_altitudes())this->update_cache(_point_molar,iz);
+
+      for(unsigned int s = 0; s < n_species; s++)
+      {
+        diffusion_terms[offset + s] = _omegas[s];
+        chemical_terms[offset + s]  = _omegas_dots[s];
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::init_evaluation_context(EvaluationContext &context) const
+  {
+    const unsigned int n_species = _omegas.size();
+    context.omegas.resize(n_species,0.L);
+    context.point_molar.resize(n_species,0.L);
+    context.point_dmolar.resize(n_species,0.L);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_element(EvaluationContext & context,
+                                                                                       unsigned int first_point,
+                                                                                       unsigned int n_points,
+                                                                                       const VectorStateType & molar_concentrations,
+                                                                                       const VectorStateType & dmolar_concentrations_dz,
+                                                                                       const VectorStateType & z,
+                                                                                       VectorStateType & diffusion_terms,
+                                                                                       VectorStateType & chemical_terms)
+  {
+    antioch_assert(this->thread_safe()); // no insertion in a shared cache
+
+    const unsigned int n_species = _omegas.size();
+    antioch_assert_equal_to(molar_concentrations.size(),n_points * n_species);
+    antioch_assert_equal_to(dmolar_concentrations_dz.size(),n_points * n_species);
+    antioch_assert_equal_to(z.size(),n_points);
+
+    if(context.omegas.size() != n_species)this->init_evaluation_context(context);
+
+    diffusion_terms.resize(n_points * n_species);
+    chemical_terms.resize(n_points * n_species);
+
+    // the point table is only read here, it is filled by the serial evaluations
+    context.element_indices.resize(n_points);
+    for(unsigned int p = 0; p < n_points; p++)
+    {
+      const unsigned int point = first_point + p;
+      context.element_indices[p] = (point < _point_index.size() && this->node_at(z[p],_point_index[point]))?
+                                   _point_index[point]:this->altitude_index(z[p]);
+    }
+
+    _composition.neutral_temperatures_and_dz(z,context.T,context.dT_dz);
+
+    context.states.resize(n_points);
+    context.sums.resize(n_points);
+    if(context.miss_sums.size() < n_points)context.miss_sums.resize(n_points,context.omegas);
+    const unsigned int n_cached = context.cached_indices.size();
+    if(context.cached_compositions.size() < n_cached + n_points)context.cached_compositions.resize(n_cached + n_points,context.omegas);
+
+    for(unsigned int p = 0; p < n_points; p++)
+    {
+      const unsigned int offset = p * n_species;
+      for(unsigned int s = 0; s < n_species; s++)
+      {
+        context.point_molar[s]  = molar_concentrations[offset + s];
+        context.point_dmolar[s] = dmolar_concentrations_dz[offset + s];
+      }
+
+      const unsigned int iz = context.element_indices[p];
+      if(iz == this->n_altitudes())
+      {
+        _composition.first_guess_densities_sum(z[p],context.miss_sums[p]);
+        context.n_misses++;
+        context.sums[p] = &context.miss_sums[p];
+      }else
+      {
+        context.n_hits++;
+        context.sums[p] = &_column.column(iz);
+        VectorCoeffType &cached = context.cached_compositions[context.cached_indices.size()];
+        for(unsigned int s = 0; s < n_species; s++)cached[s] = context.point_molar[s];
+        context.cached_indices.push_back(iz);
+      }
+
+      _composition.altitude_state(context.point_molar,z[p],context.T[p],context.dT_dz[p],context.states[p]);
+      _diffusion->diffusion(context.point_molar,context.point_dmolar,context.states[p],context.omegas);
+
+      for(unsigned int s = 0; s < n_species; s++)diffusion_terms[offset + s] = context.omegas[s];
+    }
+
+    _kinetics->chemical_rates(n_points,molar_concentrations,context.sums,context.states,chemical_terms,context.kinetics);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::publish_evaluation_context(EvaluationContext &context)
+  {
+    const unsigned int n_species = _omegas.size();
+    for(unsigned int i = 0; i < context.cached_indices.size(); i++)
+    {
+      const unsigned int iz = context.cached_indices[i];
+      for(unsigned int s = 0; s < n_species; s++)_cache_composition[iz][s] = context.cached_compositions[i][s];
+    }
+    context.cached_indices.clear();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::update_column()
+  {
+    if(this->n_altitudes() == 0)return;
+    std::fill(_cache_filled.begin(),_cache_filled.end(),true);
+    this->cache_recompute();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::update_column(const VectorStateType &nodal_densities)
+  {
+    if(this->n_altitudes() == 0)return;
+    _column.integrate_flattened(nodal_densities);
+    _cache_updates = 0;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::freeze_column(bool freeze)
+  {
+    _column_frozen = freeze;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  bool PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::column_frozen() const
+  {
+    return _column_frozen;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  bool PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::thread_safe() const
+  {
+    return (_cache_fixed && _kinetics->thread_safe());
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  const VectorCoeffType &PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::diffusion_terms() const
+  {
+    return _omegas;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  const VectorCoeffType &PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_terms() const
+  {
+    return _omegas_dots;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template <typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::set_altitude_grid(const VectorStateType &altitudes)
+  {
+     const unsigned int n_species = _miss_sum.size();
+
+     _column.set_altitudes(altitudes);
+
+     _cache_composition.resize(this->n_altitudes());
+     _cache_filled.assign(this->n_altitudes(),false);
+     for(unsigned int iz = 0; iz < this->n_altitudes(); iz++)
+     {
+       _cache_composition[iz].assign(n_species,0.L);
+       _composition.first_guess_densities_sum(_column.altitudes()[iz],_miss_sum);
+       _column.set_column(iz,_miss_sum);
+     }
+
+     _relaxed_guess.clear();
+     _relaxed.clear();
+     _point_index.clear();
+
+     _cache_fixed   = true;
+     _cache_updates = 0;
+     _cache_misses  = 0;
+     _cache_hits    = 0;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template <typename StateType>
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::altitude_index(const StateType &z) const
+  {
+     const VectorCoeffType &altitudes = _column.altitudes();
+     const unsigned int n_nodes = altitudes.size();
+     if(n_nodes == 0)return 0;
+
+     // nearest node
+     unsigned int iz = std::lower_bound(altitudes.begin(),altitudes.end(),z) - altitudes.begin();
+     if(iz == n_nodes || (iz > 0 && z - altitudes[iz - 1] < altitudes[iz] - z))iz--;
+
+     return this->node_at(z,iz)?iz:n_nodes;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template <typename StateType>
+  bool PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::node_at(const StateType &z, unsigned int iz) const
+  {
+     const VectorCoeffType &altitudes = _column.altitudes();
+     const unsigned int n_nodes = altitudes.size();
+     if(iz >= n_nodes)return false; // also libMesh::invalid_uint
+
+     const CoeffType spacing = (n_nodes == 1)?std::abs(altitudes[0]):
+                               (iz + 1 < n_nodes)?altitudes[iz + 1] - altitudes[iz]:altitudes[iz] - altitudes[iz - 1];
+
+     return (std::abs(z - altitudes[iz]) <= CoeffType(1e-6L) * spacing);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::n_altitudes() const
+  {
+     return _column.n_altitudes();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  const VectorCoeffType &PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::column_sum(unsigned int iz) const
+  {
+     return _column.column(iz);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  const ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::column() const
+  {
+     return _column;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::n_cache_misses() const
+  {
+     return _cache_misses;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::n_cache_hits() const
+  {
+     return _cache_hits;
+  }
+
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   template <typename StateType>
-  const VectorCoeffType PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::get_cache(const StateType &z) const
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::point_altitude_index(unsigned int point, const StateType &z)
   {
-     if(!_cache.count(z))
+     // the table is keyed by element id, an entry is stale once the mesh changed
+     if(point < _point_index.size() && this->node_at(z,_point_index[point]))return _point_index[point];
+
+     // off grid points are left unset, they may be inserted later
+     const unsigned int iz = this->altitude_index(z);
+     if(point >= _point_index.size())_point_index.resize(point + 1,libMesh::invalid_uint);
+     _point_index[point] = (iz == this->n_altitudes())?libMesh::invalid_uint:iz;
+
+     return iz;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template <typename StateType>
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::cache_lookup(const StateType &z)
+  {
+     const unsigned int iz = this->altitude_index(z);
+     if(iz == this->n_altitudes())return this->cache_miss(z);
+
+     _cache_hits++;
+     return iz;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template <typename StateType>
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::cache_miss(const StateType &z)
+  {
+     _composition.first_guess_densities_sum(z,_miss_sum);
+
+     if(_cache_fixed)
      {
-        VectorCoeffType first_sum_guess = Antioch::zero_clone(_composition.neutral_molar_fraction_bottom());
-        _composition.first_guess_densities_sum(z,first_sum_guess);
-        return first_sum_guess;
-     }else
+       _cache_misses++;
+       return this->n_altitudes();
+     }
+
+     // the grid is being discovered, indices are shifted
+     const unsigned int iz = _column.insert_altitude(z,_miss_sum);
+     const unsigned int n_species = _miss_sum.size();
+     _cache_composition.resize(this->n_altitudes(),Antioch::zero_clone(_miss_sum));
+     for(unsigned int jz = this->n_altitudes() - 1; jz > iz; jz--)
      {
-        return _cache.at(z);
+       for(unsigned int s = 0; s < n_species; s++)_cache_composition[jz][s] = _cache_composition[jz - 1][s];
      }
+     for(unsigned int s = 0; s < n_species; s++)_cache_composition[iz][s] = 0.L;
+     _cache_filled.insert(_cache_filled.begin() + iz,false);
+     _cache_updates = 0;
+     _point_index.clear(); // shifted indices
+
+     return iz;
   }
 
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
-  template <typename VectorStateType, typename StateType>
-  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::update_cache(const VectorStateType &molar_concentrations, const StateType &z)
+  template <typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::update_cache(const VectorStateType &molar_concentrations, unsigned int iz)
   {
-    bool recompute(true);
-    if(!_cache.count(z))
-    {
-        recompute = false;
-       _cache[z] = get_cache(z);
-    }
+     for(unsigned int s = 0; s < molar_concentrations.size(); s++)_cache_composition[iz][s] = molar_concentrations[s];
+     _cache_filled[iz] = true;
+     _cache_updates++;
 
-     _cache_composition.push_back(molar_concentrations);
-     _cache_altitudes.push_back(z);
-     if(recompute && _cache_composition.size() == _cache.size())this->cache_recompute();
+     // a whole sweep since the last update
+     if(!_column_frozen && _cache_updates >= this->n_altitudes() &&
+        std::find(_cache_filled.begin(),_cache_filled.end(),false) == _cache_filled.end())this->cache_recompute();
   }
 
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::cache_recompute()
   {
-   //from highest altitude to lowest altitude
-   unsigned int istart(0);
-   int istep(1);
-   if(_cache_altitudes.back() > _cache_altitudes.front())
-   {
-      istep = -1;
-      istart = _cache_altitudes.size() - 1;
-   }
- 
+   //from highest altitude to lowest altitude, top one is kept
+   _column.integrate(_cache_composition);
 
-   //sum densities are sdens_{i} = n(z_{i+1}) * (z_{i+1} - z_{i}), top composition is useless
-   for(unsigned int i = 1; i < _cache_altitudes.size(); i++)
-   {
-      unsigned int j = istart + istep * i;
-      unsigned int jbottom = istart + istep * (i - 1);
-      for(unsigned int s = 0; s < _cache_composition[j].size(); s++)
+   _cache_updates = 0;
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::first_guess(VectorStateType & molar_concentrations_first_guess, const StateType z) const
+  {
+      this->first_guess(molar_concentrations_first_guess,z,this->altitude_index(z));
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::first_guess(VectorStateType & molar_concentrations_first_guess,
+                                                                                   const StateType z, unsigned int iz) const
+  {
+      if(iz < _relaxed.size() && _relaxed[iz])
+      {
+        for(unsigned int s = 0; s < molar_concentrations_first_guess.size(); s++)
+                molar_concentrations_first_guess[s] = _relaxed_guess[iz][s];
+      }else
       {
-        _cache.at(_cache_altitudes[j])[s] = _cache.at(_cache_altitudes[jbottom])[s] + 
-                                           _cache_composition[j][s] * (_cache_altitudes[j] - _cache_altitudes[jbottom]);
+        _composition.first_guess_densities(z,molar_concentrations_first_guess);
       }
-   }
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  unsigned int PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::relax_first_guess(const ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &integrator)
+  {
+      antioch_assert(_cache_fixed); // nodes of the altitude grid
 
-    _cache_composition.clear();
-    _cache_altitudes.clear();
+      const unsigned int n_nodes = this->n_altitudes();
+      const VectorCoeffType &altitudes = _column.altitudes();
+
+      // barometric guesses, serial
+      const unsigned int n_species = _miss_sum.size();
+      VectorCoeffType densities = Antioch::zero_clone(_miss_sum);
+      MatrixCoeffType sum_densities;
+      sum_densities.resize(n_nodes);
+      _relaxed_guess.resize(n_nodes);
+      for(unsigned int iz = 0; iz < n_nodes; iz++)
+      {
+        _relaxed_guess[iz].resize(n_species,0.L);
+        sum_densities[iz].resize(n_species,0.L);
+        _composition.first_guess_densities(altitudes[iz],densities);
+        for(unsigned int s = 0; s < n_species; s++)_relaxed_guess[iz][s] = densities[s];
+        _composition.first_guess_densities_sum(altitudes[iz],_miss_sum);
+        for(unsigned int s = 0; s < n_species; s++)sum_densities[iz][s] = _miss_sum[s];
+      }
+
+      std::vector<unsigned int> relaxed(n_nodes,0);
+      RelaxNodes relax_nodes(integrator,altitudes,sum_densities,_relaxed_guess,relaxed);
+      _relaxed_serially = !_kinetics->thread_safe();
+      if(!_relaxed_serially)
+      {
+        libMesh::Threads::parallel_for(libMesh::Threads::BlockedRange<unsigned int>(0,n_nodes),relax_nodes);
+      }else
+      {
+        VectorCoeffType sum = Antioch::zero_clone(_miss_sum);
+        for(unsigned int iz = 0; iz < n_nodes; iz++)
+        {
+          for(unsigned int s = 0; s < n_species; s++)
+          {
+            densities[s] = _relaxed_guess[iz][s];
+            sum[s]       = sum_densities[iz][s];
+          }
+          relaxed[iz] = integrator.relax(densities,sum,altitudes[iz]);
+          if(relaxed[iz])
+          {
+            for(unsigned int s = 0; s < n_species; s++)_relaxed_guess[iz][s] = densities[s];
+          }
+        }
+      }
+
+      // a failure keeps the barometric guess
+      _relaxed.assign(n_nodes,false);
+      unsigned int n_relaxed(0);
+      for(unsigned int iz = 0; iz < n_nodes; iz++)
+      {
+        _relaxed[iz] = relaxed[iz];
+        if(relaxed[iz])n_relaxed++;
+      }
+
+      return n_relaxed;
   }
 
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
-  template<typename StateType, typename VectorStateType>
-  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::first_guess(VectorStateType & molar_concentrations_first_guess, const StateType z) const
+  bool PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::relaxed_serially() const
   {
-      _composition.first_guess_densities(z,molar_concentrations_first_guess);
+      return _relaxed_serially;
+  }
+
+  template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  void PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType>::RelaxNodes::operator()(const libMesh::Threads::BlockedRange<unsigned int> &range) const
+  {
+      typename AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::Workspace workspace;
+      VectorCoeffType densities;
+      VectorCoeffType sum;
+      for(unsigned int iz = range.begin(); iz != range.end(); iz++)
+      {
+        const unsigned int n_species = _densities[iz].size();
+        densities.resize(n_species);
+        sum.resize(n_species);
+        for(unsigned int s = 0; s < n_species; s++)
+        {
+          densities[s] = _densities[iz][s];
+          sum[s]       = _sum_densities[iz][s];
+        }
+        _relaxed[iz] = _integrator.relax(densities,sum,_altitudes[iz],workspace);
+        if(_relaxed[iz])
+        {
+          for(unsigned int s = 0; s < n_species; s++)_densities[iz][s] = densities[s];
+        }
+      }
   }
 
   template <typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
@@ -26,22 +26,48 @@
 
 //Antioch
 #include "antioch/kinetics_evaluator.h"
+#include "antioch/photochemical_rate.h"
 
 //Planet
 #include "planet/atmospheric_temperature.h"
 #include "planet/atmospheric_mixture.h"
+#include "planet/altitude_state.h"
 #include "planet/photon_evaluator.h"
+#include "planet/neutral_kinetics_backend.h"
+#include "planet/kinetics_diagnostics.h"
+#include "planet/sparse_kinetics.h"
 
 //eigen
 #include <Eigen/Dense>
 
 //C++
+#include <vector>
+#include <iostream>
+#include <algorithm>
 
 namespace Planet
 {
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   class AtmosphericKinetics
   {
+      public:
+        //! buffers of the thread safe chemical_rate, one per thread
+        struct Workspace
+        {
+          Antioch::ParticleFlux<VectorCoeffType> photon_flux;
+          VectorCoeffType                        k;
+          VectorCoeffType                        q;
+          VectorCoeffType                        dk_dn;
+          VectorCoeffType                        dq_dn;
+          //! element evaluations: one point, and the element in the batched layout
+          VectorCoeffType                        concentrations;
+          VectorCoeffType                        batch_concentrations;
+          VectorCoeffType                        batch_sources;
+          //! backend evaluations copied in another matrix type
+          VectorCoeffType                        sources;
+          MatrixCoeffType                        dmole_dn;
+        };
+
       private:
         //! no default constructor
         AtmosphericKinetics() {antioch_error();return;}
@@ -51,11 +77,63 @@ namespace Planet
 
         bool _ionic_coupling;
         std::vector<Antioch::Species> _ions_species;
+
+        //! alternative neutral chemistry, Antioch if NULL
+        NeutralKineticsBackend<CoeffType,VectorCoeffType,MatrixCoeffType> *_neutral_backend;
+
+        //! records the rates of progress if not NULL
+        KineticsDiagnostics<CoeffType,VectorCoeffType>               *_diagnostics;
+
+        //! neutral system for the thread safe evaluation, photolysis rates from a given flux
+        SparseKinetics<CoeffType,VectorCoeffType>                     _sparse_neutral;
+        std::vector<bool>                                             _photolysis;
+
+        //! buffers of the Antioch derivatives, reused by the non thread safe
+        //! evaluations as the Antioch evaluators reuse theirs
+        mutable VectorCoeffType                                       _h_RT_minus_s_R;
+        mutable VectorCoeffType                                       _dh_RT_minus_s_R_dT;
+        mutable VectorCoeffType                                       _dmole_dT;
+        mutable VectorCoeffType                                       _antioch_concentrations;
+        mutable VectorCoeffType                                       _antioch_sources;
+        mutable std::vector<VectorCoeffType>                          _antioch_dmole_dn;
+        //! buffers of the non thread safe evaluations, given no workspace
+        mutable Workspace                                             _workspace;
         
 //
         AtmosphericTemperature<CoeffType,VectorCoeffType>             &_temperature;
         PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType>    &_photon;
         AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType> &_composition;
+
+        //! photolysis rate constant of reaction ir from the photon flux of the workspace
+        CoeffType photolysis_rate(unsigned int ir, const Workspace &workspace) const;
+
+        //! Antioch derivatives, written in its own type (vector of rows)
+        void mole_sources_and_derivs(Antioch::KineticsEvaluator<CoeffType> &reactions, const CoeffType &T,
+                                     const VectorCoeffType &molar_concentrations,
+                                     VectorCoeffType &mole_sources, std::vector<VectorCoeffType> &dmole_dn) const;
+
+        //! Antioch derivatives copied in any other matrix type (contiguous), through the buffers
+        template<typename VectorStateType, typename MatrixStateType>
+        void mole_sources_and_derivs(Antioch::KineticsEvaluator<CoeffType> &reactions, const CoeffType &T,
+                                     const VectorStateType &molar_concentrations,
+                                     VectorStateType &mole_sources, MatrixStateType &dmole_dn) const;
+
+        //! Newton solver for the ions of the ionic system, the neutrals are fixed. The ionic
+        //! concentrations, sources and derivatives of the last Newton evaluation are given back
+        template<typename VectorStateType>
+        void solve_ionic_system(const VectorStateType &neutral_concentrations, const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                VectorCoeffType &molar_concentrations, VectorCoeffType &mole_sources, MatrixCoeffType &dmole_dX_s) const;
+
+        //! backend derivatives, in the matrix type of the backend, no buffer needed
+        void backend_sources_and_derivs(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                        VectorCoeffType &mole_sources, MatrixCoeffType &dmole_dn,
+                                        Workspace &workspace) const;
+
+        //! backend derivatives copied in any other matrix type, through the workspace
+        template<typename VectorStateType, typename MatrixStateType>
+        void backend_sources_and_derivs(const CoeffType &T, const VectorStateType &molar_concentrations,
+                                        VectorStateType &mole_sources, MatrixStateType &dmole_dn,
+                                        Workspace &workspace) const;
       public:
         //!
         AtmosphericKinetics(Antioch::KineticsEvaluator<CoeffType>                         &neu,
@@ -72,14 +150,90 @@ namespace Planet
         //!\return ionic kinetics system, writable reference
         Antioch::KineticsEvaluator<CoeffType> &ionic_kinetics();
 
+        //! delegates the neutral chemistry to another backend, NULL to go back to Antioch,
+        //! not with diagnostics: they compute the neutral chemistry themselves
+        void set_neutral_backend(NeutralKineticsBackend<CoeffType,VectorCoeffType,MatrixCoeffType> *backend);
+
+        //! diagnostics mode, the neutral chemistry is computed by diagnostics, NULL to stop,
+        //! not with a backend
+        void set_diagnostics(KineticsDiagnostics<CoeffType,VectorCoeffType> *diagnostics);
+
         //! compute chemical net rate and provide them in kin_rates
         template<typename StateType, typename VectorStateType>
         void chemical_rate(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations, 
                            const StateType &z, VectorStateType &kin_rates) const;
 
+        //! chemical net rates, thread safe: the photon flux and the buffers are in the workspace
+        template<typename StateType, typename VectorStateType>
+        void chemical_rate(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations, 
+                           const StateType &z, VectorStateType &kin_rates, Workspace &workspace) const;
+
+        //! chemical net rates at a state computed from the concentrations
+        template<typename VectorStateType>
+        void chemical_rate(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations, 
+                           const AltitudeState<CoeffType,VectorCoeffType> &state, VectorStateType &kin_rates) const;
+
+        //! chemical net rates at a state computed from the concentrations, thread safe
+        template<typename VectorStateType>
+        void chemical_rate(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations, 
+                           const AltitudeState<CoeffType,VectorCoeffType> &state, VectorStateType &kin_rates, Workspace &workspace) const;
+
+        //! chemical net rates of the n_points points of an element, thread safe. Concentrations
+        //! and rates are flattened point by point ([p * n_species + s]), one column and one state
+        //! per point. The rate constants of the element are put in the batched layout of
+        //! SparseKinetics (k[r * n_points + p]), rates of progress and sources are then one pass
+        //! over the element; photolysis rates use the photon flux of each point, it depends on
+        //! the column above the point
+        template<typename VectorStateType>
+        void chemical_rates(unsigned int n_points, const VectorStateType &molar_concentrations,
+                            const std::vector<const VectorCoeffType*> &sum_concentrations,
+                            const std::vector<AltitudeState<CoeffType,VectorCoeffType> > &states,
+                            VectorStateType &kin_rates, Workspace &workspace) const;
+
+        //!\return true if the workspace chemical_rate can be called concurrently:
+        //! no ionic coupling (Antioch evaluator buffers), no backend nor diagnostics
+        bool thread_safe() const;
+
+        //! chemical net rates and derivatives wrt the concentrations, the ions are at equilibrium
+        //! with the neutrals (see add_ionic_contribution_and_derivs)
+        template<typename StateType, typename VectorStateType, typename MatrixStateType>
+        void chemical_rate_and_derivs(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations,
+                                      const StateType &z, VectorStateType &kin_rates, MatrixStateType &dkin_rates_dn) const;
+
+        //! chemical net rates and derivatives at a state computed from the concentrations
+        template<typename VectorStateType, typename MatrixStateType>
+        void chemical_rate_and_derivs(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations,
+                                      const AltitudeState<CoeffType,VectorCoeffType> &state, 
+                                      VectorStateType &kin_rates, MatrixStateType &dkin_rates_dn) const;
+
+        //! chemical net rates and derivatives, thread safe: the photon flux and the buffers are in the workspace
+        template<typename StateType, typename VectorStateType, typename MatrixStateType>
+        void chemical_rate_and_derivs(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations,
+                                      const StateType &z, VectorStateType &kin_rates, MatrixStateType &dkin_rates_dn,
+                                      Workspace &workspace) const;
+
+        //! chemical net rates and derivatives at a state computed from the concentrations, thread safe
+        template<typename VectorStateType, typename MatrixStateType>
+        void chemical_rate_and_derivs(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations,
+                                      const AltitudeState<CoeffType,VectorCoeffType> &state, 
+                                      VectorStateType &kin_rates, MatrixStateType &dkin_rates_dn,
+                                      Workspace &workspace) const;
+
         //! Newton solver for the ionic system
         template<typename StateType, typename VectorStateType>
         void add_ionic_contribution(const VectorStateType &molar_concentrations, const StateType &z, VectorStateType &kin_rates) const;
+
+        //! Newton solver for the ionic system, at the temperature of the state
+        template<typename VectorStateType>
+        void add_ionic_contribution(const VectorStateType &molar_concentrations, const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                    VectorStateType &kin_rates) const;
+
+        //! ionic contribution and its derivatives wrt the neutral concentrations. The ions x(n)
+        //! solve F_I(n,x) = 0, so dx/dn = - (dF_I/dx)^-1 dF_I/dn (implicit function theorem on the
+        //! converged Newton Jacobian) and d/dn of the neutral sources g(n,x(n)) is dg/dn + dg/dx dx/dn
+        template<typename VectorStateType, typename MatrixStateType>
+        void add_ionic_contribution_and_derivs(const VectorStateType &molar_concentrations, const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                               VectorStateType &kin_rates, MatrixStateType &dkin_rates_dn) const;
   };
 
 
@@ -92,6 +246,9 @@ namespace Planet
                                                                       AtmosphericMixture<CoeffType,VectorCoeffType,MatrixCoeffType> &composition):
    _neutral_reactions(neu),
    _ionic_reactions(ion),
+   _neutral_backend(NULL),
+   _diagnostics(NULL),
+   _sparse_neutral(neu.reaction_set()),
    _temperature(temperature),
    _photon(photon),
    _composition(composition)
@@ -106,6 +263,19 @@ namespace Planet
        }
        if(_ions_species.empty())_ionic_coupling = false;
     }
+
+    _photolysis.resize(neu.n_reactions(),false);
+    for(unsigned int ir = 0; ir < neu.n_reactions(); ir++)
+    {
+       _photolysis[ir] = (neu.reaction_set().reaction(ir).kinetics_model() == Antioch::KineticsModel::PHOTOCHEM);
+       // photolysis_rate reads the rate from the workspace photon flux
+       if(_photolysis[ir] &&
+          !dynamic_cast<const Antioch::PhotochemicalRate<CoeffType,VectorCoeffType>*>(&neu.reaction_set().reaction(ir).forward_rate(0)))
+       {
+          std::cerr << "Photochemical reaction " << ir << " has no photochemical rate" << std::endl;
+          antioch_error();
+       }
+    }
     
     return;
   }
@@ -131,6 +301,30 @@ namespace Planet
      return _ionic_reactions;
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::set_neutral_backend(NeutralKineticsBackend<CoeffType,VectorCoeffType,MatrixCoeffType> *backend)
+  {
+     if(backend && _diagnostics)
+     {
+       std::cerr << "A neutral backend can't be used with diagnostics, the diagnostics compute the neutral chemistry" << std::endl;
+       antioch_error();
+     }
+     _neutral_backend = backend;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::set_diagnostics(KineticsDiagnostics<CoeffType,VectorCoeffType> *diagnostics)
+  {
+     if(diagnostics && _neutral_backend)
+     {
+       std::cerr << "Diagnostics can't be used with a neutral backend, the diagnostics compute the neutral chemistry" << std::endl;
+       antioch_error();
+     }
+     _diagnostics = diagnostics;
+  }
+
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   template<typename StateType, typename VectorStateType>
   inline
@@ -138,19 +332,350 @@ namespace Planet
                                                                      const VectorStateType &sum_concentrations, 
                                                                      const StateType &z,
                                                                      VectorStateType &kin_rates) const
+  {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _composition.altitude_state(molar_concentrations,z,state);
+     this->chemical_rate(molar_concentrations,sum_concentrations,state,kin_rates);
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rate(const VectorStateType &molar_concentrations, 
+                                                                     const VectorStateType &sum_concentrations, 
+                                                                     const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                     VectorStateType &kin_rates) const
   {
      kin_rates.resize(_composition.neutral_composition().n_species(),0.L);
-     VectorCoeffType dummy;
-     dummy.resize(_composition.neutral_composition().n_species(),0.L); //everything is irreversible
-     _photon.update_photon_flux(molar_concentrations, sum_concentrations, z);
-     _neutral_reactions.compute_mole_sources(_temperature.neutral_temperature(z),
-                                             molar_concentrations,dummy,kin_rates);
+     _photon.update_photon_flux(sum_concentrations, state);
+     if(_diagnostics)
+     {
+       _diagnostics->compute_mole_sources(state.z,state.T,
+                                          molar_concentrations,kin_rates);
+     }else if(_neutral_backend)
+     {
+       _neutral_backend->compute_mole_sources(state.T,
+                                              molar_concentrations,kin_rates);
+     }else
+     {
+       VectorCoeffType dummy;
+       dummy.resize(_composition.neutral_composition().n_species(),0.L); //everything is irreversible
+       _neutral_reactions.compute_mole_sources(state.T,
+                                               molar_concentrations,dummy,kin_rates);
+     }
+
+     this->add_ionic_contribution(molar_concentrations,state,kin_rates);
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rate(const VectorStateType &molar_concentrations, 
+                                                                     const VectorStateType &sum_concentrations, 
+                                                                     const StateType &z,
+                                                                     VectorStateType &kin_rates,
+                                                                     Workspace &workspace) const
+  {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _composition.altitude_state(molar_concentrations,z,state);
+     this->chemical_rate(molar_concentrations,sum_concentrations,state,kin_rates,workspace);
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rate(const VectorStateType &molar_concentrations, 
+                                                                     const VectorStateType &sum_concentrations, 
+                                                                     const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                     VectorStateType &kin_rates,
+                                                                     Workspace &workspace) const
+  {
+     antioch_assert(this->thread_safe());
+
+     _photon.update_photon_flux(sum_concentrations, state, workspace.photon_flux);
+
+     const CoeffType T = state.T;
+     const Antioch::ReactionSet<CoeffType> &reaction_set = _neutral_reactions.reaction_set();
+     workspace.k.resize(_photolysis.size(),0.L);
+     for(unsigned int ir = 0; ir < _photolysis.size(); ir++)
+     {
+       if(_photolysis[ir])
+       {
+         workspace.k[ir] = this->photolysis_rate(ir,workspace);
+       }else
+       {
+         workspace.k[ir] = reaction_set.reaction(ir).compute_forward_rate_coefficient(molar_concentrations,T);
+       }
+     }
+
+     _sparse_neutral.rates_of_progress(workspace.k,molar_concentrations,workspace.q);
+     _sparse_neutral.species_sources(workspace.q,kin_rates);
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rates(unsigned int n_points,
+                                                                                      const VectorStateType &molar_concentrations,
+                                                                                      const std::vector<const VectorCoeffType*> &sum_concentrations,
+                                                                                      const std::vector<AltitudeState<CoeffType,VectorCoeffType> > &states,
+                                                                                      VectorStateType &kin_rates,
+                                                                                      Workspace &workspace) const
+  {
+     antioch_assert(this->thread_safe());
+
+     const unsigned int n_species   = _composition.neutral_composition().n_species();
+     const unsigned int n_reactions = _photolysis.size();
+     antioch_assert_equal_to(molar_concentrations.size(),n_points * n_species);
+     antioch_assert_equal_to(sum_concentrations.size(),n_points);
+     antioch_assert_equal_to(states.size(),n_points);
+
+     const Antioch::ReactionSet<CoeffType> &reaction_set = _neutral_reactions.reaction_set();
+     workspace.concentrations.resize(n_species,0.L);
+     workspace.batch_concentrations.resize(n_points * n_species,0.L);
+     workspace.k.resize(n_points * n_reactions,0.L);
+     for(unsigned int p = 0; p < n_points; p++)
+     {
+       for(unsigned int s = 0; s < n_species; s++)
+       {
+         workspace.concentrations[s] = molar_concentrations[p * n_species + s];
+         workspace.batch_concentrations[s * n_points + p] = workspace.concentrations[s];
+       }
+
+       _photon.update_photon_flux(*sum_concentrations[p], states[p], workspace.photon_flux);
+       for(unsigned int ir = 0; ir < n_reactions; ir++)
+       {
+         workspace.k[ir * n_points + p] = (_photolysis[ir])?this->photolysis_rate(ir,workspace):
+                                          reaction_set.reaction(ir).compute_forward_rate_coefficient(workspace.concentrations,states[p].T);
+       }
+     }
+
+     _sparse_neutral.rates_of_progress(n_points,workspace.k,workspace.batch_concentrations,workspace.q);
+     _sparse_neutral.species_sources(n_points,workspace.q,workspace.batch_sources);
+
+     kin_rates.resize(n_points * n_species);
+     for(unsigned int p = 0; p < n_points; p++)
+     {
+       for(unsigned int s = 0; s < n_species; s++)kin_rates[p * n_species + s] = workspace.batch_sources[s * n_points + p];
+     }
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  CoeffType AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::photolysis_rate(unsigned int ir, const Workspace &workspace) const
+  {
+     // the rate type is checked at construction
+     return static_cast<const Antioch::PhotochemicalRate<CoeffType,VectorCoeffType>&>
+                (_neutral_reactions.reaction_set().reaction(ir).forward_rate(0)).rate(workspace.photon_flux);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  bool AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::thread_safe() const
+  {
+     return (!_ionic_coupling && !_neutral_backend && !_diagnostics);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rate_and_derivs(const VectorStateType &molar_concentrations, 
+                                                                                                const VectorStateType &sum_concentrations, 
+                                                                                                const StateType &z,
+                                                                                                VectorStateType &kin_rates,
+                                                                                                MatrixStateType &dkin_rates_dn) const
+  {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _composition.altitude_state(molar_concentrations,z,state);
+     this->chemical_rate_and_derivs(molar_concentrations,sum_concentrations,state,kin_rates,dkin_rates_dn);
+
+     return;
+  }
 
-     this->add_ionic_contribution(molar_concentrations,z,kin_rates);
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rate_and_derivs(const VectorStateType &molar_concentrations, 
+                                                                                                const VectorStateType &sum_concentrations, 
+                                                                                                const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                                                VectorStateType &kin_rates,
+                                                                                                MatrixStateType &dkin_rates_dn) const
+  {
+     const unsigned int n_species = _composition.neutral_composition().n_species();
+
+     kin_rates.resize(n_species,0.L);
+     dkin_rates_dn.resize(n_species);
+     for(unsigned int s = 0; s < n_species; s++)dkin_rates_dn[s].resize(n_species,0.L);
+
+     _photon.update_photon_flux(sum_concentrations, state);
+
+     if(_neutral_backend)
+     {
+       this->backend_sources_and_derivs(state.T,molar_concentrations,kin_rates,dkin_rates_dn,_workspace);
+     }else
+     {
+       this->mole_sources_and_derivs(_neutral_reactions,state.T,molar_concentrations,kin_rates,dkin_rates_dn);
+     }
+
+     this->add_ionic_contribution_and_derivs(molar_concentrations,state,kin_rates,dkin_rates_dn);
 
      return;
   }
 
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType, typename MatrixStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rate_and_derivs(const VectorStateType &molar_concentrations, 
+                                                                                                const VectorStateType &sum_concentrations, 
+                                                                                                const StateType &z,
+                                                                                                VectorStateType &kin_rates,
+                                                                                                MatrixStateType &dkin_rates_dn,
+                                                                                                Workspace &workspace) const
+  {
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _composition.altitude_state(molar_concentrations,z,state);
+     this->chemical_rate_and_derivs(molar_concentrations,sum_concentrations,state,kin_rates,dkin_rates_dn,workspace);
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::chemical_rate_and_derivs(const VectorStateType &molar_concentrations, 
+                                                                                                const VectorStateType &sum_concentrations, 
+                                                                                                const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                                                VectorStateType &kin_rates,
+                                                                                                MatrixStateType &dkin_rates_dn,
+                                                                                                Workspace &workspace) const
+  {
+     antioch_assert(this->thread_safe());
+
+     const unsigned int n_species = _composition.neutral_composition().n_species();
+
+     kin_rates.resize(n_species,0.L);
+     dkin_rates_dn.resize(n_species);
+     for(unsigned int s = 0; s < n_species; s++)
+     {
+       kin_rates[s] = 0.L;
+       dkin_rates_dn[s].resize(n_species,0.L);
+       for(unsigned int j = 0; j < n_species; j++)dkin_rates_dn[s][j] = 0.L;
+     }
+     workspace.dk_dn.resize(n_species,0.L);
+     workspace.dq_dn.resize(n_species,0.L);
+
+     _photon.update_photon_flux(sum_concentrations, state, workspace.photon_flux);
+
+     const Antioch::ReactionSet<CoeffType> &reaction_set = _neutral_reactions.reaction_set();
+     CoeffType kfwd, dkfwd_dT;
+     for(unsigned int ir = 0; ir < _photolysis.size(); ir++)
+     {
+       std::fill(workspace.dk_dn.begin(),workspace.dk_dn.end(),0.L);
+       if(_photolysis[ir])
+       {
+         kfwd = this->photolysis_rate(ir,workspace);
+       }else
+       {
+         reaction_set.reaction(ir).compute_forward_rate_coefficient_and_derivatives(molar_concentrations,state.T,kfwd,dkfwd_dT,workspace.dk_dn);
+       }
+       _sparse_neutral.add_reaction_sources_and_derivs(ir,kfwd,workspace.dk_dn,molar_concentrations,kin_rates,dkin_rates_dn,workspace.dq_dn);
+     }
+
+     return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::mole_sources_and_derivs(Antioch::KineticsEvaluator<CoeffType> &reactions,
+                                                                                               const CoeffType &T,
+                                                                                               const VectorCoeffType &molar_concentrations,
+                                                                                               VectorCoeffType &mole_sources,
+                                                                                               std::vector<VectorCoeffType> &dmole_dn) const
+  {
+     const unsigned int n_species = reactions.n_species();
+
+     _h_RT_minus_s_R.resize(n_species,0.L); //everything is irreversible
+     _dh_RT_minus_s_R_dT.resize(n_species,0.L);
+     _dmole_dT.resize(n_species,0.L);
+
+     reactions.compute_mole_sources_and_derivs(T, molar_concentrations,
+                                               _h_RT_minus_s_R, _dh_RT_minus_s_R_dT,
+                                               mole_sources, _dmole_dT, dmole_dn);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::mole_sources_and_derivs(Antioch::KineticsEvaluator<CoeffType> &reactions,
+                                                                                               const CoeffType &T,
+                                                                                               const VectorStateType &molar_concentrations,
+                                                                                               VectorStateType &mole_sources,
+                                                                                               MatrixStateType &dmole_dn) const
+  {
+     const unsigned int n_species = dmole_dn.size();
+
+     _antioch_concentrations.resize(n_species);
+     _antioch_sources.resize(n_species);
+     _antioch_dmole_dn.resize(n_species);
+     for(unsigned int s = 0; s < n_species; s++)
+     {
+       _antioch_concentrations[s] = molar_concentrations[s];
+       _antioch_dmole_dn[s].resize(n_species);
+       std::fill(_antioch_dmole_dn[s].begin(),_antioch_dmole_dn[s].end(),0.L);
+     }
+     std::fill(_antioch_sources.begin(),_antioch_sources.end(),0.L);
+
+     this->mole_sources_and_derivs(reactions,T,_antioch_concentrations,_antioch_sources,_antioch_dmole_dn);
+
+     for(unsigned int s = 0; s < n_species; s++)
+     {
+       mole_sources[s] = _antioch_sources[s];
+       for(unsigned int j = 0; j < n_species; j++)dmole_dn[s][j] = _antioch_dmole_dn[s][j];
+     }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::backend_sources_and_derivs(const CoeffType &T,
+                                                                                                  const VectorCoeffType &molar_concentrations,
+                                                                                                  VectorCoeffType &mole_sources,
+                                                                                                  MatrixCoeffType &dmole_dn,
+                                                                                                  Workspace & /*workspace*/) const
+  {
+     _neutral_backend->compute_mole_sources_and_derivs(T,molar_concentrations,mole_sources,dmole_dn);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::backend_sources_and_derivs(const CoeffType &T,
+                                                                                                  const VectorStateType &molar_concentrations,
+                                                                                                  VectorStateType &mole_sources,
+                                                                                                  MatrixStateType &dmole_dn,
+                                                                                                  Workspace &workspace) const
+  {
+     workspace.concentrations.resize(molar_concentrations.size());
+     for(unsigned int s = 0; s < workspace.concentrations.size(); s++)workspace.concentrations[s] = molar_concentrations[s];
+
+     _neutral_backend->compute_mole_sources_and_derivs(T,workspace.concentrations,workspace.sources,workspace.dmole_dn);
+
+     for(unsigned int s = 0; s < workspace.sources.size(); s++)
+     {
+       mole_sources[s] = workspace.sources[s];
+       for(unsigned int j = 0; j < workspace.sources.size(); j++)dmole_dn[s][j] = workspace.dmole_dn[s][j];
+     }
+  }
+
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
   template<typename StateType, typename VectorStateType>
   inline
@@ -158,15 +683,96 @@ namespace Planet
                                                                                               VectorStateType &kin_rates) const
   {
     if(!_ionic_coupling)return;
-    
+
+    AltitudeState<CoeffType,VectorCoeffType> state;
+    _composition.altitude_state(z,state);
+    this->add_ionic_contribution(neutral_concentrations,state,kin_rates);
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::add_ionic_contribution(const VectorStateType &neutral_concentrations, 
+                                                                                              const AltitudeState<CoeffType,VectorCoeffType> &state, 
+                                                                                              VectorStateType &kin_rates) const
+  {
+    if(!_ionic_coupling)return;
+
+    VectorCoeffType molar_concentrations;
+    VectorCoeffType mole_sources;
+    MatrixCoeffType dmole_dX_s;
+    this->solve_ionic_system(neutral_concentrations,state,molar_concentrations,mole_sources,dmole_dX_s);
+
+    for(unsigned int s = 0; s < _composition.neutral_composition().n_species(); s++)
+    {
+        unsigned int i_neu = _composition.ionic_composition().species_list_map().at(_composition.neutral_composition().species_list()[s]);
+        kin_rates[s] += mole_sources[i_neu];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::add_ionic_contribution_and_derivs(const VectorStateType &neutral_concentrations, 
+                                                                                                         const AltitudeState<CoeffType,VectorCoeffType> &state, 
+                                                                                                         VectorStateType &kin_rates,
+                                                                                                         MatrixStateType &dkin_rates_dn) const
+  {
+    if(!_ionic_coupling)return;
+
+    VectorCoeffType molar_concentrations;
+    VectorCoeffType mole_sources;
+    MatrixCoeffType dmole_dX_s;
+    this->solve_ionic_system(neutral_concentrations,state,molar_concentrations,mole_sources,dmole_dX_s);
+
+    const unsigned int n_ions     = _ions_species.size();
+    const unsigned int n_neutrals = _composition.neutral_composition().n_species();
+    std::vector<unsigned int> i_ion(n_ions), i_neu(n_neutrals);
+    for(unsigned int i = 0; i < n_ions; i++)i_ion[i] = _composition.ionic_composition().species_list_map().at(_ions_species[i]);
+    for(unsigned int s = 0; s < n_neutrals; s++)
+      i_neu[s] = _composition.ionic_composition().species_list_map().at(_composition.neutral_composition().species_list()[s]);
+
+// A = dF_I/dx, B = dF_I/dn, dx/dn = - A^-1 B
+    Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> A(n_ions,n_ions);
+    Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> B(n_ions,n_neutrals);
+    for(unsigned int i = 0; i < n_ions; i++)
+    {
+      for(unsigned int j = 0; j < n_ions; j++)A(i,j) = dmole_dX_s[i_ion[i]][i_ion[j]];
+      for(unsigned int j = 0; j < n_neutrals; j++)B(i,j) = dmole_dX_s[i_ion[i]][i_neu[j]];
+    }
+    Eigen::PartialPivLU<Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> > mypartialPivLu(A);
+    Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> dx_dn = mypartialPivLu.solve(B);
+
+    for(unsigned int s = 0; s < n_neutrals; s++)
+    {
+      kin_rates[s] += mole_sources[i_neu[s]];
+      for(unsigned int j = 0; j < n_neutrals; j++)
+      {
+        CoeffType dg_dn = dmole_dX_s[i_neu[s]][i_neu[j]];
+        for(unsigned int i = 0; i < n_ions; i++)dg_dn -= dmole_dX_s[i_neu[s]][i_ion[i]] * dx_dn(i,j);
+        dkin_rates_dn[s][j] += dg_dn;
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::solve_ionic_system(const VectorStateType &neutral_concentrations, 
+                                                                                          const AltitudeState<CoeffType,VectorCoeffType> &state, 
+                                                                                          VectorCoeffType &molar_concentrations,
+                                                                                          VectorCoeffType &mole_sources,
+                                                                                          MatrixCoeffType &dmole_dX_s) const
+  {
 // Newton solver here
 // Ax + b = 0
 // A is jacobian, b is what goes to 0 (dc/dt here)
-    Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> A;
-    Eigen::Matrix<CoeffType,Eigen::Dynamic,1> b;
+    Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> A(_ions_species.size(),_ions_species.size());
+    Eigen::Matrix<CoeffType,Eigen::Dynamic,1> b(_ions_species.size());
 
 
-    VectorCoeffType molar_concentrations;
     molar_concentrations.resize(_ionic_reactions.n_species(),0.L); //full system
     for(unsigned int s = 0; s < neutral_concentrations.size(); s++)// full system
     {
@@ -175,16 +781,9 @@ namespace Planet
     }
 
 
-    VectorCoeffType h_RT_minus_s_R;
-    VectorCoeffType dh_RT_minus_s_R_dT;
-    VectorCoeffType mole_sources;
-    VectorCoeffType dmole_dT;
-    MatrixCoeffType dmole_dX_s;
-    h_RT_minus_s_R.resize(_ionic_reactions.n_species(),0.L); //irreversible
-    dh_RT_minus_s_R_dT.resize(_ionic_reactions.n_species());
     mole_sources.resize(_ionic_reactions.n_species());
-    dmole_dT.resize(_ionic_reactions.n_species());
     dmole_dX_s.resize(_ionic_reactions.n_species());
+    for(unsigned int s = 0; s < _ionic_reactions.n_species(); s++)dmole_dX_s[s].resize(_ionic_reactions.n_species(),0.L);
 
     CoeffType lim(1.L);
     CoeffType thresh = std::numeric_limits<CoeffType>::epsilon();
@@ -194,9 +793,7 @@ namespace Planet
     while(lim > thresh)
     {
 
-      _ionic_reactions.compute_mole_sources_and_derivs(_temperature.neutral_temperature(z), molar_concentrations,
-                                                       h_RT_minus_s_R, dh_RT_minus_s_R_dT,
-                                                       mole_sources, dmole_dT, dmole_dX_s );
+      this->mole_sources_and_derivs(_ionic_reactions,state.T,molar_concentrations,mole_sources,dmole_dX_s);
 
 
       for(unsigned int i = 0; i < _ions_species.size(); i++)
@@ -226,13 +823,6 @@ namespace Planet
       if(nloop > loop_max)antioch_error();
 
     }
-
-    for(unsigned int s = 0; s < _composition.neutral_composition().n_species(); s++)
-    {
-        unsigned int i_neu = _composition.ionic_composition().species_list_map().at(_composition.neutral_composition().species_list()[s]);
-        kin_rates[s] += mole_sources[i_neu];
-    }
-      
   }
 }
 
@@ -0,0 +1,291 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_CHEMISTRY_INTEGRATOR_H
+#define PLANET_CHEMISTRY_INTEGRATOR_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+#include "planet/atmospheric_kinetics.h"
+
+//eigen
+#include <Eigen/Dense>
+
+//C++
+#include <cmath>
+#include <algorithm>
+
+namespace Planet
+{
+  /*!\class ChemistryIntegrator
+   *
+   * Chemistry only time integration at one altitude, dn/dt = omega_dot(n),
+   * to relax a composition towards photochemical equilibrium.
+   *
+   * Second order Rosenbrock scheme ROS2 (Verwer et al., 1999), gamma = 1 + 1/sqrt(2):
+   *
+   *   (I - gamma h J) k1 = f(n)
+   *   (I - gamma h J) k2 = f(n + h k1) - 2 k1
+   *   n_new = n + 3/2 h k1 + 1/2 h k2
+   *
+   * ROS2 keeps its order with an approximate Jacobian, so the neutral
+   * Jacobian given by AtmosphericKinetics is enough. The error estimate
+   * is the difference with the embedded first order solution n + h k1,
+   * the step is adapted on it. Negative densities are set back to zero.
+   *
+   * The column above is fixed during the integration, the photon flux
+   * is updated at each evaluation with the current densities. With
+   * a workspace of AtmosphericKinetics, the evaluations are thread safe
+   * and several altitudes can be relaxed concurrently.
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  class ChemistryIntegrator
+  {
+      private:
+        //! no default constructor
+        ChemistryIntegrator(){antioch_error();return;}
+
+        const AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType> &_kinetics;
+
+        CoeffType    _rel_tol;
+        CoeffType    _abs_tol;
+        CoeffType    _time;
+        CoeffType    _first_step;
+        unsigned int _max_steps;
+
+        typedef typename AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::Workspace Workspace;
+
+        //! ROS2 integration, shared kinetics evaluations if workspace is NULL
+        template<typename StateType, typename VectorStateType>
+        bool integrate(VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations,
+                       const StateType &z, Workspace *workspace) const;
+
+        //! weighted RMS norm of the error
+        template<typename VectorStateType>
+        const CoeffType error_norm(const VectorStateType &error, const VectorStateType &n_old, const VectorStateType &n_new) const;
+
+      public:
+        ChemistryIntegrator(const AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType> &kinetics);
+        ~ChemistryIntegrator();
+
+        //! relative and absolute (cm-3) tolerances of the local error
+        void set_tolerances(const CoeffType &rel_tol, const CoeffType &abs_tol);
+
+        //! integration time (s) and first time step (s)
+        void set_time(const CoeffType &time, const CoeffType &first_step);
+
+        //! maximum number of steps, accepted or not
+        void set_max_steps(unsigned int max_steps);
+
+        //! integrates from molar_concentrations for the integration time
+        //!\return true if the whole integration time was covered
+        template<typename StateType, typename VectorStateType>
+        bool relax(VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations, const StateType &z) const;
+
+        //! thread safe relax, the kinetics buffers are in the workspace, one per thread
+        //!\return true if the whole integration time was covered
+        template<typename StateType, typename VectorStateType>
+        bool relax(VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations, const StateType &z,
+                   Workspace &workspace) const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::ChemistryIntegrator(const AtmosphericKinetics<CoeffType,VectorCoeffType,MatrixCoeffType> &kinetics):
+    _kinetics(kinetics),
+    _rel_tol(1e-3L),
+    _abs_tol(1e-2L),
+    _time(1e10L), // ~ 300 years, longer than the radicals lifetimes
+    _first_step(1e-6L),
+    _max_steps(5000)
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::~ChemistryIntegrator()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_tolerances(const CoeffType &rel_tol, const CoeffType &abs_tol)
+  {
+    _rel_tol = rel_tol;
+    _abs_tol = abs_tol;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_time(const CoeffType &time, const CoeffType &first_step)
+  {
+    _time = time;
+    _first_step = first_step;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_max_steps(unsigned int max_steps)
+  {
+    _max_steps = max_steps;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  const CoeffType ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::error_norm(const VectorStateType &error,
+                                                                                             const VectorStateType &n_old,
+                                                                                             const VectorStateType &n_new) const
+  {
+    CoeffType norm(0.L);
+    for(unsigned int s = 0; s < error.size(); s++)
+    {
+      const CoeffType scale = _abs_tol + _rel_tol * std::max(std::abs(n_old[s]),std::abs(n_new[s]));
+      norm += (error[s] / scale) * (error[s] / scale);
+    }
+    return std::sqrt(norm / CoeffType(error.size()));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  bool ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::relax(VectorStateType &molar_concentrations,
+                                                                             const VectorStateType &sum_concentrations,
+                                                                             const StateType &z) const
+  {
+    return this->integrate(molar_concentrations,sum_concentrations,z,NULL);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  bool ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::relax(VectorStateType &molar_concentrations,
+                                                                             const VectorStateType &sum_concentrations,
+                                                                             const StateType &z,
+                                                                             Workspace &workspace) const
+  {
+    return this->integrate(molar_concentrations,sum_concentrations,z,&workspace);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  bool ChemistryIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::integrate(VectorStateType &molar_concentrations,
+                                                                                 const VectorStateType &sum_concentrations,
+                                                                                 const StateType &z,
+                                                                                 Workspace *workspace) const
+  {
+    typedef Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> Matrix;
+    typedef Eigen::Matrix<CoeffType,Eigen::Dynamic,1>              Vector;
+
+    const unsigned int n_species = molar_concentrations.size();
+    const CoeffType gamma = CoeffType(1.L) + CoeffType(1.L) / std::sqrt(CoeffType(2.L));
+
+    VectorStateType f, f2, n_mid, n_new, error;
+    MatrixCoeffType J;
+    n_mid.resize(n_species,0.L);
+    n_new.resize(n_species,0.L);
+    error.resize(n_species,0.L);
+
+    Matrix A(n_species,n_species);
+    Vector b(n_species);
+    Vector k1(n_species);
+    Vector k2(n_species);
+
+    CoeffType t(0.L);
+    CoeffType h(_first_step);
+    bool jacobian_ok(false);
+    unsigned int nstep(0);
+    while(t < _time)
+    {
+      if(nstep++ > _max_steps)return false;
+      if(t + h > _time)h = _time - t;
+
+      if(!jacobian_ok)
+      {
+        if(workspace)
+        {
+          _kinetics.chemical_rate_and_derivs(molar_concentrations,sum_concentrations,z,f,J,*workspace);
+        }else
+        {
+          _kinetics.chemical_rate_and_derivs(molar_concentrations,sum_concentrations,z,f,J);
+        }
+        jacobian_ok = true;
+      }
+
+      for(unsigned int i = 0; i < n_species; i++)
+      {
+        for(unsigned int j = 0; j < n_species; j++)A(i,j) = - gamma * h * J[i][j];
+        A(i,i) += CoeffType(1.L);
+        b(i) = f[i];
+      }
+      Eigen::PartialPivLU<Matrix> lu(A);
+      k1 = lu.solve(b);
+
+      for(unsigned int s = 0; s < n_species; s++)n_mid[s] = molar_concentrations[s] + h * k1(s);
+      if(workspace)
+      {
+        _kinetics.chemical_rate(n_mid,sum_concentrations,z,f2,*workspace);
+      }else
+      {
+        _kinetics.chemical_rate(n_mid,sum_concentrations,z,f2);
+      }
+      for(unsigned int s = 0; s < n_species; s++)b(s) = f2[s] - CoeffType(2.L) * k1(s);
+      k2 = lu.solve(b);
+
+      for(unsigned int s = 0; s < n_species; s++)
+      {
+        n_new[s] = molar_concentrations[s] + h * (CoeffType(1.5L) * k1(s) + CoeffType(0.5L) * k2(s));
+        error[s] = CoeffType(0.5L) * h * (k1(s) + k2(s));
+      }
+
+      const CoeffType err = this->error_norm(error,molar_concentrations,n_new);
+      if(!(err == err)) // NaN, start again smaller
+      {
+        h /= CoeffType(10.L);
+        continue;
+      }
+
+      if(err <= CoeffType(1.L))
+      {
+        t += h;
+        for(unsigned int s = 0; s < n_species; s++)molar_concentrations[s] = std::max(n_new[s],CoeffType(0.L));
+        jacobian_ok = false;
+      }
+
+      // second order, error ~ h^2
+      CoeffType factor = CoeffType(0.9L) / std::sqrt(std::max(err,CoeffType(1e-10L)));
+      factor = std::min(std::max(factor,CoeffType(0.2L)),CoeffType(5.L));
+      h *= factor;
+    }
+
+    return true;
+  }
+
+}
+
+#endif
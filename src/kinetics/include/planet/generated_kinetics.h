@@ -0,0 +1,159 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_GENERATED_KINETICS_H
+#define PLANET_GENERATED_KINETICS_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+#include "antioch/reaction_set.h"
+
+//Planet
+#include "planet/neutral_kinetics_backend.h"
+
+//C++
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Planet
+{
+  /*!\class GeneratedKinetics
+   *
+   * Kinetics backend around a kernel written by KineticsCodeGenerator.
+   * The reaction set the kernel was generated from is kept for the
+   * photolysis rates only, they depend on the current photon flux.
+   *
+   * Usage:
+   * \code
+   * #include "my_mechanism.h" // generated
+   * Planet::GeneratedKinetics<Planet::Generated::MyMechanism,double,std::vector<double> > backend(neutral_reaction_set);
+   * kinetics.set_neutral_backend(&backend);
+   * \endcode
+   *
+   * The kernel header is written by planet_generate_kinetics from the
+   * mechanism files.
+   */
+  template<typename Kernel, typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType = std::vector<VectorCoeffType> >
+  class GeneratedKinetics: public NeutralKineticsBackend<CoeffType,VectorCoeffType,MatrixCoeffType>
+  {
+      private:
+        //! no default constructor
+        GeneratedKinetics(){antioch_error();return;}
+
+        const Antioch::ReactionSet<CoeffType> &_reaction_set;
+
+        //! photolysis rates, from the photon flux in the reaction set
+        template<typename StateType, typename VectorStateType>
+        void photolysis_rates(const StateType &T, const VectorStateType &molar_concentrations, VectorStateType &k_hv) const;
+
+      public:
+        GeneratedKinetics(const Antioch::ReactionSet<CoeffType> &reaction_set);
+        ~GeneratedKinetics();
+
+        //! neutral mole sources
+        void compute_mole_sources(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                  VectorCoeffType &mole_sources) const;
+
+        //! neutral mole sources and their derivatives wrt the concentrations
+        void compute_mole_sources_and_derivs(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                             VectorCoeffType &mole_sources, MatrixCoeffType &dmole_dn) const;
+  };
+
+  template<typename Kernel, typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  GeneratedKinetics<Kernel,CoeffType,VectorCoeffType,MatrixCoeffType>::GeneratedKinetics(const Antioch::ReactionSet<CoeffType> &reaction_set):
+    NeutralKineticsBackend<CoeffType,VectorCoeffType,MatrixCoeffType>(),
+    _reaction_set(reaction_set)
+  {
+    // the kernel is only valid for the mechanism it was generated from
+    if(_reaction_set.n_species()   != Kernel::n_species() ||
+       _reaction_set.n_reactions() != Kernel::n_reactions())
+    {
+      std::cerr << "Generated kinetics kernel does not match the reaction set" << std::endl;
+      antioch_error();
+    }
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      if(_reaction_set.reaction(ir).equation() != std::string(Kernel::equation(ir)))
+      {
+        std::cerr << "Generated kinetics kernel does not match the reaction set\n"
+                  << "reaction " << ir << " is " << _reaction_set.reaction(ir).equation()
+                  << " in the reaction set and " << Kernel::equation(ir) << " in the kernel" << std::endl;
+        antioch_error();
+      }
+    }
+    return;
+  }
+
+  template<typename Kernel, typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  GeneratedKinetics<Kernel,CoeffType,VectorCoeffType,MatrixCoeffType>::~GeneratedKinetics()
+  {
+    return;
+  }
+
+  template<typename Kernel, typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void GeneratedKinetics<Kernel,CoeffType,VectorCoeffType,MatrixCoeffType>::photolysis_rates(const StateType &T, const VectorStateType &molar_concentrations,
+                                                                             VectorStateType &k_hv) const
+  {
+    k_hv.resize(Kernel::n_photolysis(),0.L);
+    for(unsigned int ihv = 0; ihv < Kernel::n_photolysis(); ihv++)
+    {
+      k_hv[ihv] = _reaction_set.reaction(Kernel::photolysis_reaction(ihv)).compute_forward_rate_coefficient(molar_concentrations,T);
+    }
+  }
+
+  template<typename Kernel, typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void GeneratedKinetics<Kernel,CoeffType,VectorCoeffType,MatrixCoeffType>::compute_mole_sources(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                                                                 VectorCoeffType &mole_sources) const
+  {
+    VectorCoeffType k_hv;
+    this->photolysis_rates(T,molar_concentrations,k_hv);
+
+    mole_sources.resize(Kernel::n_species(),0.L);
+    Kernel::mole_sources(T,k_hv,molar_concentrations,mole_sources);
+  }
+
+  template<typename Kernel, typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void GeneratedKinetics<Kernel,CoeffType,VectorCoeffType,MatrixCoeffType>::compute_mole_sources_and_derivs(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                                                                                            VectorCoeffType &mole_sources, MatrixCoeffType &dmole_dn) const
+  {
+    VectorCoeffType k_hv;
+    this->photolysis_rates(T,molar_concentrations,k_hv);
+
+    mole_sources.resize(Kernel::n_species(),0.L);
+    dmole_dn.resize(Kernel::n_species());
+    for(unsigned int s = 0; s < Kernel::n_species(); s++)dmole_dn[s].resize(Kernel::n_species(),0.L);
+
+    Kernel::mole_sources(T,k_hv,molar_concentrations,mole_sources);
+    Kernel::jacobian(T,k_hv,molar_concentrations,dmole_dn);
+  }
+
+}
+
+#endif
@@ -0,0 +1,632 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_KINETICS_CODE_GENERATOR_H
+#define PLANET_KINETICS_CODE_GENERATOR_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+#include "antioch/reaction_set.h"
+#include "antioch/kooij_rate.h"
+#include "antioch/arrhenius_rate.h"
+
+//Planet
+
+//C++
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cctype>
+
+namespace Planet
+{
+  /*!\class KineticsCodeGenerator
+   *
+   * Writes a C++ header with the neutral mechanism of a reaction set
+   * fully unrolled: every rate constant, rate of progress,
+   * mole source and Jacobian entry is a straight-line expression
+   * with the kinetics parameters as literals.
+   *
+   * Supported: elementary and Lindemann falloff reactions with Kooij
+   * or Arrhenius rates, and photolysis. The third body of a falloff
+   * reaction is sum_s eff_s n_s with the efficiencies of the reaction.
+   * Photolysis rates depend on the photon flux, they are inputs of the
+   * generated kernel (see GeneratedKinetics).
+   *
+   * Everything is irreversible, as everywhere in Planet. Any other
+   * reaction (reversible, three-body, other falloff, other rate) is
+   * an error, the kernel would not be the reaction set.
+   */
+  template<typename CoeffType>
+  class KineticsCodeGenerator
+  {
+      private:
+        //! no default constructor
+        KineticsCodeGenerator(){antioch_error();return;}
+
+        const Antioch::ReactionSet<CoeffType> &_reaction_set;
+        std::string _kernel_name;
+
+        //! index of photolysis reactions in the reaction set
+        std::vector<unsigned int> _photolysis_reactions;
+        //! photolysis rank of reaction ir, if photolysis
+        std::map<unsigned int, unsigned int> _photolysis_rank;
+
+        //!\return the literal of a constant at full precision
+        const std::string literal(const CoeffType &value) const;
+
+        //!\return the expression k * prod n^nu
+        const std::string rate_of_progress(unsigned int ir, const std::string &k) const;
+
+        //!\return the expression d(k * prod n^nu)/dn_j
+        const std::string rate_of_progress_derivative(unsigned int ir, unsigned int j) const;
+
+        //!\return the expression of a thermal rate constant, flags the temperature terms used
+        const std::string thermal_rate_constant(const Antioch::KineticsType<CoeffType> &rate, bool &uses_lnT, bool &uses_invT) const;
+
+        //!\return sum_r coef * term, "StateType(0)" if no term
+        const std::string linear_combination(const std::vector<std::pair<int,std::string> > &terms) const;
+
+        //!\return net stoichiometric coefficient of species s in reaction ir
+        int net_stoichiometry(unsigned int ir, unsigned int s) const;
+
+        //!\return true if all the third-body efficiencies of reaction ir are one
+        bool unit_efficiencies(unsigned int ir) const;
+
+        //!\return the third body of falloff reaction ir, M or its own sum
+        const std::string third_body(unsigned int ir) const;
+
+        //! errors if reaction ir can not be written
+        void check_reaction(unsigned int ir) const;
+
+        //! writes all rate constants, and dk/dM for falloff if asked
+        void write_rate_constants(std::ostream &out, bool derivatives) const;
+
+        void write_mole_sources(std::ostream &out) const;
+
+        void write_jacobian(std::ostream &out) const;
+
+        //!\return species name
+        const std::string species_name(unsigned int s) const;
+
+      public:
+        KineticsCodeGenerator(const Antioch::ReactionSet<CoeffType> &reaction_set, const std::string &kernel_name);
+        ~KineticsCodeGenerator();
+
+        //! writes the specialized kernel
+        void generate(std::ostream &out) const;
+
+        //!\return number of photolysis reactions
+        unsigned int n_photolysis() const;
+  };
+
+  template<typename CoeffType>
+  inline
+  KineticsCodeGenerator<CoeffType>::KineticsCodeGenerator(const Antioch::ReactionSet<CoeffType> &reaction_set, const std::string &kernel_name):
+    _reaction_set(reaction_set),
+    _kernel_name(kernel_name)
+  {
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      this->check_reaction(ir);
+      if(_reaction_set.reaction(ir).kinetics_model() == Antioch::KineticsModel::PHOTOCHEM)
+      {
+        _photolysis_rank[ir] = _photolysis_reactions.size();
+        _photolysis_reactions.push_back(ir);
+      }
+    }
+    return;
+  }
+
+  template<typename CoeffType>
+  inline
+  KineticsCodeGenerator<CoeffType>::~KineticsCodeGenerator()
+  {
+    return;
+  }
+
+  template<typename CoeffType>
+  inline
+  unsigned int KineticsCodeGenerator<CoeffType>::n_photolysis() const
+  {
+    return _photolysis_reactions.size();
+  }
+
+  template<typename CoeffType>
+  inline
+  const std::string KineticsCodeGenerator<CoeffType>::species_name(unsigned int s) const
+  {
+    const Antioch::ChemicalMixture<CoeffType> &mixture = _reaction_set.chemical_mixture();
+    return mixture.species_inverse_name_map().at(mixture.species_list()[s]);
+  }
+
+  template<typename CoeffType>
+  inline
+  const std::string KineticsCodeGenerator<CoeffType>::literal(const CoeffType &value) const
+  {
+    std::ostringstream lit;
+    lit << "StateType(" << std::scientific << std::setprecision(std::numeric_limits<CoeffType>::digits10 + 3)
+        << value << "L)";
+    return lit.str();
+  }
+
+  template<typename CoeffType>
+  inline
+  int KineticsCodeGenerator<CoeffType>::net_stoichiometry(unsigned int ir, unsigned int s) const
+  {
+    const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+    int nu(0);
+    for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+    {
+      if(reaction.reactant_id(r) == s)nu -= reaction.reactant_stoichiometric_coefficient(r);
+    }
+    for(unsigned int p = 0; p < reaction.n_products(); p++)
+    {
+      if(reaction.product_id(p) == s)nu += reaction.product_stoichiometric_coefficient(p);
+    }
+    return nu;
+  }
+
+  template<typename CoeffType>
+  inline
+  void KineticsCodeGenerator<CoeffType>::check_reaction(unsigned int ir) const
+  {
+    const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+    if(reaction.reversible())
+    {
+      std::cerr << "Reversible reaction " << reaction.equation() << " can not be generated" << std::endl;
+      antioch_error();
+    }
+    if(reaction.kinetics_model() == Antioch::KineticsModel::PHOTOCHEM)return;
+
+    if(reaction.type() != Antioch::ReactionType::ELEMENTARY &&
+       reaction.type() != Antioch::ReactionType::LINDEMANN_FALLOFF)
+    {
+      std::cerr << "Reaction type of " << reaction.equation() << " can not be generated" << std::endl;
+      antioch_error();
+    }
+    if(reaction.type() == Antioch::ReactionType::ELEMENTARY && !this->unit_efficiencies(ir))
+    {
+      std::cerr << "Third-body efficiencies of elementary reaction " << reaction.equation() << " can not be generated" << std::endl;
+      antioch_error();
+    }
+    if(reaction.kinetics_model() != Antioch::KineticsModel::KOOIJ &&
+       reaction.kinetics_model() != Antioch::KineticsModel::ARRHENIUS)
+    {
+      std::cerr << "Only Kooij and Arrhenius rates can be generated, not the one of " << reaction.equation() << std::endl;
+      antioch_error();
+    }
+  }
+
+  template<typename CoeffType>
+  inline
+  bool KineticsCodeGenerator<CoeffType>::unit_efficiencies(unsigned int ir) const
+  {
+    const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+    for(unsigned int s = 0; s < _reaction_set.n_species(); s++)
+    {
+      if(reaction.efficiency(s) != CoeffType(1.L))return false;
+    }
+    return true;
+  }
+
+  template<typename CoeffType>
+  inline
+  const std::string KineticsCodeGenerator<CoeffType>::third_body(unsigned int ir) const
+  {
+    if(this->unit_efficiencies(ir))return "M";
+    std::ostringstream M;
+    M << "M" << ir;
+    return M.str();
+  }
+
+  template<typename CoeffType>
+  inline
+  const std::string KineticsCodeGenerator<CoeffType>::rate_of_progress(unsigned int ir, const std::string &k) const
+  {
+    const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+    std::ostringstream R;
+    R << k;
+    for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+    {
+      for(unsigned int nu = 0; nu < reaction.reactant_stoichiometric_coefficient(r); nu++)
+      {
+        R << " * n[" << reaction.reactant_id(r) << "]";
+      }
+    }
+    return R.str();
+  }
+
+  template<typename CoeffType>
+  inline
+  const std::string KineticsCodeGenerator<CoeffType>::rate_of_progress_derivative(unsigned int ir, unsigned int j) const
+  {
+    const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+    std::ostringstream dR;
+    dR << "k" << ir;
+    for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+    {
+      unsigned int nu = reaction.reactant_stoichiometric_coefficient(r);
+      if(reaction.reactant_id(r) == j)
+      {
+        if(nu > 1)dR << " * StateType(" << nu << ")";
+        nu--;
+      }
+      for(unsigned int i = 0; i < nu; i++)
+      {
+        dR << " * n[" << reaction.reactant_id(r) << "]";
+      }
+    }
+    return dR.str();
+  }
+
+  template<typename CoeffType>
+  inline
+  const std::string KineticsCodeGenerator<CoeffType>::thermal_rate_constant(const Antioch::KineticsType<CoeffType> &rate,
+                                                                           bool &uses_lnT, bool &uses_invT) const
+  {
+    CoeffType Cf, eta(0.L), EaR;
+    if(const Antioch::KooijRate<CoeffType> *kooij = dynamic_cast<const Antioch::KooijRate<CoeffType>*>(&rate))
+    {
+      eta = kooij->eta();
+      Cf  = kooij->Cf() * std::pow(kooij->Tref(),-eta); // (T/Tref)^eta -> T^eta
+      EaR = kooij->Ea() / kooij->rscale();
+    }else if(const Antioch::ArrheniusRate<CoeffType> *arrhenius = dynamic_cast<const Antioch::ArrheniusRate<CoeffType>*>(&rate))
+    {
+      Cf  = arrhenius->Cf();
+      EaR = arrhenius->Ea() / arrhenius->rscale();
+    }else
+    {
+      std::cerr << "Only Kooij and Arrhenius rates can be generated" << std::endl;
+      antioch_error();
+    }
+
+    std::string k = literal(Cf);
+    if(eta == CoeffType(0.L) && EaR == CoeffType(0.L))return k;
+
+    k += " * Antioch::ant_exp(";
+    if(eta != CoeffType(0.L))
+    {
+      k += literal(eta) + " * lnT";
+      uses_lnT = true;
+    }
+    if(EaR != CoeffType(0.L))
+    {
+      k += ((eta != CoeffType(0.L))?" - ":"- ") + literal(EaR) + " * invT";
+      uses_invT = true;
+    }
+    k += ")";
+
+    return k;
+  }
+
+  template<typename CoeffType>
+  inline
+  const std::string KineticsCodeGenerator<CoeffType>::linear_combination(const std::vector<std::pair<int,std::string> > &terms) const
+  {
+    if(terms.empty())return "StateType(0)";
+
+    std::ostringstream comb;
+    for(unsigned int t = 0; t < terms.size(); t++)
+    {
+      int coef = terms[t].first;
+      if(coef < 0)
+      {
+        comb << ((t == 0)?"- ":" - ");
+        coef = -coef;
+      }else if(t != 0)
+      {
+        comb << " + ";
+      }
+      if(coef != 1)comb << "StateType(" << coef << ") * ";
+      comb << terms[t].second;
+    }
+    return comb.str();
+  }
+
+  template<typename CoeffType>
+  inline
+  void KineticsCodeGenerator<CoeffType>::write_rate_constants(std::ostream &header, bool derivatives) const
+  {
+    // temperature and total concentration terms are written only if used
+    bool uses_lnT(false), uses_invT(false), uses_M(false);
+    std::ostringstream out;
+
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      out << "        // " << reaction.equation() << "\n";
+      if(reaction.kinetics_model() == Antioch::KineticsModel::PHOTOCHEM)
+      {
+        out << "        const StateType k" << ir << " = k_hv[" << _photolysis_rank.at(ir) << "];\n";
+        continue;
+      }
+
+      switch(reaction.type())
+      {
+        case Antioch::ReactionType::ELEMENTARY:
+        {
+          out << "        const StateType k" << ir << " = " << thermal_rate_constant(reaction.forward_rate(0),uses_lnT,uses_invT) << ";\n";
+          break;
+        }
+        case Antioch::ReactionType::LINDEMANN_FALLOFF: // k = k0 M / (1 + k0 M / kinf)
+        {
+          const std::string M = this->third_body(ir);
+          if(M == "M")
+          {
+            uses_M = true;
+          }else // M = sum_s eff_s n_s, zero efficiencies skipped
+          {
+            std::vector<std::pair<int,std::string> > terms;
+            for(unsigned int s = 0; s < _reaction_set.n_species(); s++)
+            {
+              if(reaction.efficiency(s) == CoeffType(0.L))continue;
+              std::ostringstream term;
+              term << literal(reaction.efficiency(s)) << " * n[" << s << "]";
+              terms.push_back(std::make_pair(1,term.str()));
+            }
+            out << "        const StateType " << M << " = " << linear_combination(terms) << ";\n";
+          }
+          out << "        const StateType k" << ir << "_0   = " << thermal_rate_constant(reaction.forward_rate(0),uses_lnT,uses_invT) << ";\n"
+              << "        const StateType k" << ir << "_inf = " << thermal_rate_constant(reaction.forward_rate(1),uses_lnT,uses_invT) << ";\n"
+              << "        const StateType k" << ir << "_den = StateType(1.L) / (k" << ir << "_inf + k" << ir << "_0 * " << M << ");\n"
+              << "        const StateType k" << ir << "     = k" << ir << "_0 * k" << ir << "_inf * " << M << " * k" << ir << "_den;\n";
+          if(derivatives)
+          {
+            out << "        const StateType dk" << ir << "_dM = k" << ir << "_0 * k" << ir << "_inf * k" << ir << "_inf * k"
+                                                    << ir << "_den * k" << ir << "_den;\n";
+          }
+          break;
+        }
+        default:
+        {
+          std::cerr << "Reaction type of " << reaction.equation() << " can not be generated" << std::endl;
+          antioch_error();
+        }
+      }
+    }
+
+    if(uses_invT)header << "        const StateType invT = StateType(1.L) / T;\n";
+    if(uses_lnT) header << "        const StateType lnT  = Antioch::ant_log(T);\n";
+    if(uses_M)
+    {
+      header << "        const StateType M    = n[0]";
+      for(unsigned int s = 1; s < _reaction_set.n_species(); s++)header << " + n[" << s << "]";
+      header << ";\n";
+    }
+    if(uses_invT || uses_lnT || uses_M)header << "\n";
+
+    header << out.str() << "\n";
+  }
+
+  template<typename CoeffType>
+  inline
+  void KineticsCodeGenerator<CoeffType>::write_mole_sources(std::ostream &out) const
+  {
+    out << "      //! mole sources, omega_dot must be of size n_species()\n"
+        << "      template<typename StateType, typename VectorStateType>\n"
+        << "      static void mole_sources(const StateType &T, const VectorStateType &k_hv,\n"
+        << "                               const VectorStateType &n, VectorStateType &omega_dot)\n"
+        << "      {\n"
+        << "        antioch_assert_equal_to(n.size(), n_species());\n"
+        << "        antioch_assert_equal_to(omega_dot.size(), n_species());\n"
+        << "        antioch_assert_equal_to(k_hv.size(), n_photolysis());\n\n";
+
+    this->write_rate_constants(out,false);
+
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      std::ostringstream k;
+      k << "k" << ir;
+      out << "        const StateType R" << ir << " = " << rate_of_progress(ir,k.str()) << ";\n";
+    }
+    out << "\n";
+
+    for(unsigned int s = 0; s < _reaction_set.n_species(); s++)
+    {
+      std::vector<std::pair<int,std::string> > terms;
+      for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+      {
+        int nu = this->net_stoichiometry(ir,s);
+        if(nu == 0)continue;
+        std::ostringstream R;
+        R << "R" << ir;
+        terms.push_back(std::make_pair(nu,R.str()));
+      }
+      out << "        omega_dot[" << s << "] = " << linear_combination(terms) << "; // " << species_name(s) << "\n";
+    }
+
+    out << "      }\n\n";
+  }
+
+  template<typename CoeffType>
+  inline
+  void KineticsCodeGenerator<CoeffType>::write_jacobian(std::ostream &out) const
+  {
+    const unsigned int n_species = _reaction_set.n_species();
+
+    out << "      //! mole sources derivatives, domega_dot_dn[s][j] = d omega_dot_s / d n_j, must be n_species() x n_species()\n"
+        << "      template<typename StateType, typename VectorStateType, typename MatrixStateType>\n"
+        << "      static void jacobian(const StateType &T, const VectorStateType &k_hv,\n"
+        << "                           const VectorStateType &n, MatrixStateType &domega_dot_dn)\n"
+        << "      {\n"
+        << "        antioch_assert_equal_to(n.size(), n_species());\n"
+        << "        antioch_assert_equal_to(domega_dot_dn.size(), n_species());\n"
+        << "        antioch_assert_equal_to(k_hv.size(), n_photolysis());\n\n";
+
+    this->write_rate_constants(out,true);
+
+// d R_r / d n_j, and d R_r / d M for falloff
+    std::map<std::pair<unsigned int,unsigned int>, std::vector<std::pair<int,std::string> > > entries;
+    std::vector<std::vector<std::pair<int,std::string> > > row_M(n_species);
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+      {
+        unsigned int j = reaction.reactant_id(r);
+        std::ostringstream dR;
+        dR << "dR" << ir << "_" << j;
+        out << "        const StateType " << dR.str() << " = " << rate_of_progress_derivative(ir,j) << ";\n";
+        for(unsigned int s = 0; s < n_species; s++)
+        {
+          int nu = this->net_stoichiometry(ir,s);
+          if(nu != 0)entries[std::make_pair(s,j)].push_back(std::make_pair(nu,dR.str()));
+        }
+      }
+      if(reaction.kinetics_model() != Antioch::KineticsModel::PHOTOCHEM &&
+         reaction.type() == Antioch::ReactionType::LINDEMANN_FALLOFF)
+      {
+        std::ostringstream dk, dR;
+        dk << "dk" << ir << "_dM";
+        dR << "dR" << ir << "_dM";
+        out << "        const StateType " << dR.str() << " = " << rate_of_progress(ir,dk.str()) << ";\n";
+        const bool unit = this->unit_efficiencies(ir);
+        for(unsigned int s = 0; s < n_species; s++)
+        {
+          int nu = this->net_stoichiometry(ir,s);
+          if(nu == 0)continue;
+          if(unit)
+          {
+            row_M[s].push_back(std::make_pair(nu,dR.str()));
+            continue;
+          }
+// dM/dn_j = eff_j
+          for(unsigned int j = 0; j < n_species; j++)
+          {
+            if(reaction.efficiency(j) == CoeffType(0.L))continue;
+            entries[std::make_pair(s,j)].push_back(std::make_pair(nu,literal(reaction.efficiency(j)) + " * " + dR.str()));
+          }
+        }
+      }
+    }
+    out << "\n";
+
+    out << "        for(unsigned int s = 0; s < n_species(); s++)\n"
+        << "        {\n"
+        << "          for(unsigned int j = 0; j < n_species(); j++)domega_dot_dn[s][j] = StateType(0);\n"
+        << "        }\n\n";
+
+    for(typename std::map<std::pair<unsigned int,unsigned int>, std::vector<std::pair<int,std::string> > >::const_iterator it = entries.begin();
+        it != entries.end(); it++)
+    {
+      out << "        domega_dot_dn[" << it->first.first << "][" << it->first.second << "] = " << linear_combination(it->second) << ";\n";
+    }
+    out << "\n";
+
+// M = sum_j n_j, falloff contributes to every column
+    for(unsigned int s = 0; s < n_species; s++)
+    {
+      if(row_M[s].empty())continue;
+      out << "        {\n"
+          << "          const StateType dM = " << linear_combination(row_M[s]) << ";\n"
+          << "          for(unsigned int j = 0; j < n_species(); j++)domega_dot_dn[" << s << "][j] += dM;\n"
+          << "        }\n";
+    }
+
+    out << "      }\n";
+  }
+
+  template<typename CoeffType>
+  inline
+  void KineticsCodeGenerator<CoeffType>::generate(std::ostream &out) const
+  {
+    std::string guard("PLANET_GENERATED_");
+    for(unsigned int i = 0; i < _kernel_name.size(); i++)guard += std::toupper(_kernel_name[i]);
+    guard += "_H";
+
+    out << "// Generated by Planet::KineticsCodeGenerator, do not edit.\n"
+        << "// " << _reaction_set.n_species() << " species, " << _reaction_set.n_reactions() << " reactions, "
+                 << _photolysis_reactions.size() << " photolysis\n\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n\n"
+        << "//Antioch\n"
+        << "#include \"antioch/antioch_asserts.h\"\n"
+        << "#include \"antioch/cmath_shims.h\"\n\n"
+        << "namespace Planet\n"
+        << "{\n"
+        << "  namespace Generated\n"
+        << "  {\n"
+        << "    struct " << _kernel_name << "\n"
+        << "    {\n"
+        << "      static unsigned int n_species()    {return " << _reaction_set.n_species()     << ";}\n"
+        << "      static unsigned int n_reactions()  {return " << _reaction_set.n_reactions()   << ";}\n"
+        << "      static unsigned int n_photolysis() {return " << _photolysis_reactions.size()  << ";}\n\n";
+
+    out << "      //! index in the reaction set of photolysis reaction ihv\n"
+        << "      static unsigned int photolysis_reaction(unsigned int ihv)\n"
+        << "      {\n";
+    if(_photolysis_reactions.empty())
+    {
+      out << "        antioch_error();\n"
+          << "        return ihv;\n";
+    }else
+    {
+      out << "        static const unsigned int ids[] = {";
+      for(unsigned int i = 0; i < _photolysis_reactions.size(); i++)
+      {
+        out << ((i == 0)?"":", ") << _photolysis_reactions[i];
+      }
+      out << "};\n"
+          << "        antioch_assert_less(ihv, n_photolysis());\n"
+          << "        return ids[ihv];\n";
+    }
+    out << "      }\n\n";
+
+    out << "      //! equation of reaction ir, to check the mechanism\n"
+        << "      static const char * equation(unsigned int ir)\n"
+        << "      {\n"
+        << "        static const char * equations[] = {\n";
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      std::string eq = _reaction_set.reaction(ir).equation();
+      std::string escaped;
+      for(unsigned int i = 0; i < eq.size(); i++)
+      {
+        if(eq[i] == '"' || eq[i] == '\\')escaped += '\\';
+        escaped += eq[i];
+      }
+      out << "          \"" << escaped << "\"" << ((ir + 1 < _reaction_set.n_reactions())?",":"") << "\n";
+    }
+    out << "        };\n"
+        << "        antioch_assert_less(ir, n_reactions());\n"
+        << "        return equations[ir];\n"
+        << "      }\n\n";
+
+    this->write_mole_sources(out);
+    this->write_jacobian(out);
+
+    out << "    };\n"
+        << "  } // end namespace Generated\n"
+        << "} // end namespace Planet\n\n"
+        << "#endif\n";
+  }
+
+}
+
+#endif
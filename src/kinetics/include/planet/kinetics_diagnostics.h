@@ -0,0 +1,424 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_KINETICS_DIAGNOSTICS_H
+#define PLANET_KINETICS_DIAGNOSTICS_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+#include "antioch/reaction_set.h"
+
+//Planet
+#include "planet/sparse_kinetics.h"
+#include "planet/interpolation_grid.h"
+
+//C++
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+
+namespace Planet
+{
+  /*!\class KineticsDiagnostics
+   *
+   * Rates of progress of the neutral reactions, node by node of the
+   * altitude grid.
+   *
+   * When given to AtmosphericKinetics, the neutral mole sources are computed
+   * here from the rates of progress, which are recorded on the way: one
+   * evaluation for both. A node computed again overwrites the previous
+   * record, so the table holds the last state of each node. The node of
+   * an altitude is the closest one, within a relative tolerance of the
+   * grid spacing; altitudes off the grid (quadrature points) are computed
+   * but not recorded, they are counted.
+   *
+   * Each node stores the reactions with a non zero rate of progress
+   * (reaction id, rate), above an optional cutoff relative to the fastest
+   * reaction of the node.
+   */
+  template<typename CoeffType, typename VectorCoeffType>
+  class KineticsDiagnostics
+  {
+      public:
+        //! (reaction id, rate) pairs
+        typedef std::vector<std::pair<unsigned int, CoeffType> > Contributors;
+
+      private:
+        //! no default constructor
+        KineticsDiagnostics(){antioch_error();return;}
+
+        //! non zero rates of progress of one node
+        struct RateRecord
+        {
+          bool                      recorded;
+          std::vector<unsigned int> reactions;
+          VectorCoeffType           rates;
+
+          RateRecord():recorded(false){}
+        };
+
+        const Antioch::ReactionSet<CoeffType> &_reaction_set;
+        SparseKinetics<CoeffType,VectorCoeffType> _kinetics;
+
+        //! net stoichiometric coefficients, species x reactions
+        std::vector<std::vector<int> > _nu;
+
+        CoeffType _cutoff;
+
+        //! altitude grid, one record per node
+        InterpolationGrid<CoeffType,VectorCoeffType> *_grid;
+        std::vector<RateRecord>                        _table;
+        unsigned int                                   _n_off_grid;
+
+        //! evaluation buffers, rate constants and rates of progress
+        VectorCoeffType _k;
+        VectorCoeffType _q;
+
+        //! comparison in absolute value
+        static bool larger_contribution(const std::pair<unsigned int,CoeffType> &a, const std::pair<unsigned int,CoeffType> &b)
+                {return std::abs(a.second) > std::abs(b.second);}
+
+        //! sorts and keeps the k largest in absolute value
+        void top_k(Contributors &contributors, unsigned int k) const;
+
+        //! stores the rates of progress in _q at node iz
+        void record(unsigned int iz);
+
+      public:
+        KineticsDiagnostics(const Antioch::ReactionSet<CoeffType> &reaction_set);
+        ~KineticsDiagnostics();
+
+        //! nodes of the table, monotonic, forgets the records
+        void set_altitudes(const VectorCoeffType &altitudes);
+
+        //! rates of progress lower than cutoff * max rate of the node are not stored
+        void set_relative_cutoff(const CoeffType &cutoff);
+
+        //!\return node of altitude z, n_nodes() if z is not a node
+        template<typename StateType>
+        unsigned int node_index(const StateType &z) const;
+
+        //! neutral mole sources at altitude z, rates of progress recorded if z is a node
+        template<typename StateType, typename VectorStateType>
+        void compute_mole_sources(const StateType &z, const StateType &T, const VectorStateType &molar_concentrations,
+                                  VectorStateType &mole_sources);
+
+        //! neutral mole sources at node iz, rates of progress recorded
+        template<typename StateType, typename VectorStateType>
+        void compute_mole_sources(unsigned int iz, const StateType &T, const VectorStateType &molar_concentrations,
+                                  VectorStateType &mole_sources);
+
+        //! forgets the records
+        void clear();
+
+        //!\return number of nodes of the grid
+        unsigned int n_nodes() const;
+
+        //!\return number of recorded nodes
+        unsigned int n_altitudes() const;
+
+        //!\return number of stored rates, all nodes
+        unsigned int n_entries() const;
+
+        //!\return number of evaluations off the grid, not recorded
+        unsigned int n_off_grid() const;
+
+        //!\return recorded rate of progress of reaction ir at node iz, zero if not stored
+        const CoeffType rate_of_progress(unsigned int iz, unsigned int ir) const;
+
+        //! column integrated rates of progress, trapezoidal rule over the recorded nodes, altitude unit
+        void column_rates(VectorCoeffType &columns) const;
+
+        //! k reactions contributing most to species s at node iz, signed contributions nu_sr q_r
+        void top_contributors(unsigned int s, unsigned int iz, unsigned int k, Contributors &contributors) const;
+
+        //! k reactions contributing most to species s over the column, signed column contributions
+        void top_column_contributors(unsigned int s, unsigned int k, Contributors &contributors) const;
+
+        //! prints the k main contributors of species s at node iz
+        void print_top_contributors(unsigned int s, unsigned int iz, unsigned int k, std::ostream &out = std::cout) const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  KineticsDiagnostics<CoeffType,VectorCoeffType>::KineticsDiagnostics(const Antioch::ReactionSet<CoeffType> &reaction_set):
+    _reaction_set(reaction_set),
+    _kinetics(reaction_set),
+    _cutoff(0.L),
+    _grid(NULL),
+    _n_off_grid(0)
+  {
+    _nu.resize(_reaction_set.n_species());
+    for(unsigned int s = 0; s < _reaction_set.n_species(); s++)_nu[s].resize(_reaction_set.n_reactions(),0);
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+        _nu[reaction.reactant_id(r)][ir] -= reaction.reactant_stoichiometric_coefficient(r);
+      for(unsigned int p = 0; p < reaction.n_products(); p++)
+        _nu[reaction.product_id(p)][ir] += reaction.product_stoichiometric_coefficient(p);
+    }
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  KineticsDiagnostics<CoeffType,VectorCoeffType>::~KineticsDiagnostics()
+  {
+    if(_grid)delete _grid;
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::set_altitudes(const VectorCoeffType &altitudes)
+  {
+    if(_grid)delete _grid;
+    _grid = new InterpolationGrid<CoeffType,VectorCoeffType>(altitudes);
+    _table.clear();
+    _table.resize(altitudes.size());
+    _n_off_grid = 0;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::set_relative_cutoff(const CoeffType &cutoff)
+  {
+    _cutoff = cutoff;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  unsigned int KineticsDiagnostics<CoeffType,VectorCoeffType>::node_index(const StateType &z) const
+  {
+    antioch_assert(_grid);
+
+    const VectorCoeffType &nodes = _grid->abscissa();
+    const unsigned int iz = _grid->floor_index(z);
+    const CoeffType tol = std::abs(nodes[iz + 1] - nodes[iz]) * 1e-6L;
+    if(std::abs(z - nodes[iz])     <= tol)return iz;
+    if(std::abs(z - nodes[iz + 1]) <= tol)return iz + 1;
+
+    return nodes.size();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::record(unsigned int iz)
+  {
+    CoeffType qmax(0.L);
+    for(unsigned int ir = 0; ir < _q.size(); ir++)qmax = std::max(qmax,(CoeffType)std::abs(_q[ir]));
+
+    RateRecord &record = _table[iz];
+    record.recorded = true;
+    record.reactions.clear();
+    record.rates.clear();
+    for(unsigned int ir = 0; ir < _q.size(); ir++)
+    {
+      if(_q[ir] == 0.L || std::abs(_q[ir]) < _cutoff * qmax)continue;
+      record.reactions.push_back(ir);
+      record.rates.push_back(_q[ir]);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::compute_mole_sources(const StateType &z, const StateType &T,
+                                                                            const VectorStateType &molar_concentrations,
+                                                                            VectorStateType &mole_sources)
+  {
+    const unsigned int iz = this->node_index(z);
+    if(iz < _table.size())
+    {
+      this->compute_mole_sources(iz,T,molar_concentrations,mole_sources);
+    }else
+    {
+      _kinetics.rate_constants(T,molar_concentrations,_k);
+      _kinetics.rates_of_progress(_k,molar_concentrations,_q);
+      _kinetics.species_sources(_q,mole_sources);
+      _n_off_grid++;
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::compute_mole_sources(unsigned int iz, const StateType &T,
+                                                                            const VectorStateType &molar_concentrations,
+                                                                            VectorStateType &mole_sources)
+  {
+    antioch_assert_less(iz,_table.size());
+
+    _kinetics.rate_constants(T,molar_concentrations,_k);
+    _kinetics.rates_of_progress(_k,molar_concentrations,_q);
+    _kinetics.species_sources(_q,mole_sources);
+
+    this->record(iz);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::clear()
+  {
+    for(unsigned int iz = 0; iz < _table.size(); iz++)_table[iz] = RateRecord();
+    _n_off_grid = 0;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int KineticsDiagnostics<CoeffType,VectorCoeffType>::n_nodes() const
+  {
+    return _table.size();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int KineticsDiagnostics<CoeffType,VectorCoeffType>::n_altitudes() const
+  {
+    unsigned int n(0);
+    for(unsigned int iz = 0; iz < _table.size(); iz++)if(_table[iz].recorded)n++;
+    return n;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int KineticsDiagnostics<CoeffType,VectorCoeffType>::n_entries() const
+  {
+    unsigned int n(0);
+    for(unsigned int iz = 0; iz < _table.size(); iz++)n += _table[iz].reactions.size();
+    return n;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int KineticsDiagnostics<CoeffType,VectorCoeffType>::n_off_grid() const
+  {
+    return _n_off_grid;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const CoeffType KineticsDiagnostics<CoeffType,VectorCoeffType>::rate_of_progress(unsigned int iz, unsigned int ir) const
+  {
+    antioch_assert_less(iz,_table.size());
+    antioch_assert(_table[iz].recorded);
+    const RateRecord &record = _table[iz];
+    typename std::vector<unsigned int>::const_iterator it = std::lower_bound(record.reactions.begin(),record.reactions.end(),ir);
+    if(it == record.reactions.end() || *it != ir)return 0.L;
+    return record.rates[it - record.reactions.begin()];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::column_rates(VectorCoeffType &columns) const
+  {
+    columns.resize(_reaction_set.n_reactions());
+    std::fill(columns.begin(),columns.end(),0.L);
+
+// recorded nodes, in the grid order
+    std::vector<unsigned int> nodes;
+    for(unsigned int iz = 0; iz < _table.size(); iz++)if(_table[iz].recorded)nodes.push_back(iz);
+    if(nodes.size() < 2)return;
+
+    const VectorCoeffType &altitudes = _grid->abscissa();
+    for(unsigned int i = 0; i + 1 < nodes.size(); i++)
+    {
+      const RateRecord &low  = _table[nodes[i]];
+      const RateRecord &high = _table[nodes[i + 1]];
+      const CoeffType half_dz = std::abs(altitudes[nodes[i + 1]] - altitudes[nodes[i]]) / 2.L;
+      for(unsigned int j = 0; j < low.reactions.size(); j++) columns[low.reactions[j]]  += half_dz * low.rates[j];
+      for(unsigned int j = 0; j < high.reactions.size(); j++)columns[high.reactions[j]] += half_dz * high.rates[j];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::top_k(Contributors &contributors, unsigned int k) const
+  {
+    if(k > contributors.size())k = contributors.size();
+    std::partial_sort(contributors.begin(),contributors.begin() + k, contributors.end(),
+                      &KineticsDiagnostics<CoeffType,VectorCoeffType>::larger_contribution);
+    contributors.resize(k);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::top_contributors(unsigned int s, unsigned int iz, unsigned int k,
+                                                                        Contributors &contributors) const
+  {
+    antioch_assert_less(s,_nu.size());
+    antioch_assert_less(iz,_table.size());
+    antioch_assert(_table[iz].recorded);
+
+    contributors.clear();
+    const RateRecord &record = _table[iz];
+    for(unsigned int i = 0; i < record.reactions.size(); i++)
+    {
+      const int nu = _nu[s][record.reactions[i]];
+      if(nu == 0)continue;
+      contributors.push_back(std::make_pair(record.reactions[i],(CoeffType)nu * record.rates[i]));
+    }
+    this->top_k(contributors,k);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::top_column_contributors(unsigned int s, unsigned int k, Contributors &contributors) const
+  {
+    antioch_assert_less(s,_nu.size());
+
+    VectorCoeffType columns;
+    this->column_rates(columns);
+
+    contributors.clear();
+    for(unsigned int ir = 0; ir < columns.size(); ir++)
+    {
+      if(_nu[s][ir] == 0 || columns[ir] == 0.L)continue;
+      contributors.push_back(std::make_pair(ir,(CoeffType)_nu[s][ir] * columns[ir]));
+    }
+    this->top_k(contributors,k);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void KineticsDiagnostics<CoeffType,VectorCoeffType>::print_top_contributors(unsigned int s, unsigned int iz, unsigned int k, std::ostream &out) const
+  {
+    Contributors contributors;
+    this->top_contributors(s,iz,k,contributors);
+
+    const Antioch::ChemicalMixture<CoeffType> &mixture = _reaction_set.chemical_mixture();
+    out << "Main contributors to " << mixture.species_inverse_name_map().at(mixture.species_list()[s])
+        << " at altitude " << _grid->abscissa()[iz] << std::endl;
+    for(unsigned int i = 0; i < contributors.size(); i++)
+    {
+      out << "  " << _reaction_set.reaction(contributors[i].first).equation() << "\t" << contributors[i].second << std::endl;
+    }
+  }
+
+}
+
+#endif
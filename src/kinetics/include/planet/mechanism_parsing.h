@@ -0,0 +1,300 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_MECHANISM_PARSING_H
+#define PLANET_MECHANISM_PARSING_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+#include "antioch/reaction_set.h"
+#include "antioch/kinetics_parsing.h"
+#include "antioch/reaction_parsing.h"
+
+//Planet
+
+//C++
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace Planet
+{
+  /* Readers of the Titan mechanism files (see test/input):
+   *   - species list: one name per line,
+   *   - elementary reactions: one title line, then
+   *       reactants -> products; A beta Ea_R Hr
+   *   - falloff reactions: three title lines, then
+   *       reactants -> products; A0 beta0 Ea_R0 Ainf betainf Ea_Rinf Hr
+   *   - photolysis cross-sections: header "Lambda Total branch...", a branch
+   *     is its products separated by '/', then one wavelength per line.
+   *
+   * Rates are Kooij, Arrhenius if beta = 0, activation energies in K.
+   * Reactions involving a species outside of the reaction set are skipped.
+   */
+
+  //! reads the species names
+  inline
+  void read_species_list(const std::string &file, std::vector<std::string> &species)
+  {
+    std::ifstream data(file.c_str());
+    if(!data.good())
+    {
+      std::cerr << "Could not open species file " << file << std::endl;
+      antioch_error();
+    }
+    std::string name;
+    while(data >> name)species.push_back(name);
+    data.close();
+  }
+
+  //! removes leading and trailing blanks
+  inline
+  void shave_string(std::string &str)
+  {
+    const std::string blanks(" \t\r");
+    str.erase(0,str.find_first_not_of(blanks));
+    str.erase(str.find_last_not_of(blanks) + 1);
+  }
+
+  //! splits "A + B + A" in molecules (A,B) and stoichiometric coefficients (2,1)
+  inline
+  void parse_molecules(const std::string &side, const std::string &separator,
+                       std::vector<std::string> &molecules, std::vector<unsigned int> &stoi)
+  {
+    std::string::size_type start(0);
+    while(start <= side.size())
+    {
+      std::string::size_type end = side.find(separator,start);
+      if(end == std::string::npos)end = side.size();
+      std::string molecule = side.substr(start,end - start);
+      shave_string(molecule);
+      start = end + separator.size();
+      if(molecule.empty())continue;
+
+      std::vector<std::string>::iterator it = std::find(molecules.begin(),molecules.end(),molecule);
+      if(it == molecules.end())
+      {
+        molecules.push_back(molecule);
+        stoi.push_back(1);
+      }else
+      {
+        stoi[it - molecules.begin()]++;
+      }
+    }
+  }
+
+  //!\return false if one of the molecules is not in the mixture
+  template<typename Scalar>
+  bool known_molecules(const std::vector<std::string> &molecules, const Antioch::ChemicalMixture<Scalar> &mixture)
+  {
+    for(unsigned int i = 0; i < molecules.size(); i++)
+    {
+      if(!mixture.active_species_name_map().count(molecules[i]))return false;
+    }
+    return true;
+  }
+
+  //! builds the reaction and adds it to the reaction set
+  template<typename Scalar>
+  void add_reaction(const std::string &equation, 
+                    const std::vector<std::string> &reactants, const std::vector<unsigned int> &stoi_reac,
+                    const std::vector<std::string> &products,  const std::vector<unsigned int> &stoi_prod,
+                    Antioch::ReactionType::ReactionType reaction_type, Antioch::KineticsModel::KineticsModel kinetics_model,
+                    const std::vector<std::vector<Scalar> > &rates, Antioch::ReactionSet<Scalar> &reaction_set)
+  {
+    const Antioch::ChemicalMixture<Scalar> &mixture = reaction_set.chemical_mixture();
+    Antioch::Reaction<Scalar> *reaction = Antioch::build_reaction<Scalar>(mixture.n_species(), equation, false, reaction_type, kinetics_model);
+    for(unsigned int r = 0; r < rates.size(); r++)
+    {
+      reaction->add_forward_rate(Antioch::build_rate<Scalar,std::vector<Scalar> >(rates[r],kinetics_model));
+    }
+    for(unsigned int ir = 0; ir < reactants.size(); ir++)
+    {
+      reaction->add_reactant(reactants[ir],mixture.active_species_name_map().find(reactants[ir])->second,stoi_reac[ir]);
+    }
+    for(unsigned int ip = 0; ip < products.size(); ip++)
+    {
+      reaction->add_product(products[ip],mixture.active_species_name_map().find(products[ip])->second,stoi_prod[ip]);
+    }
+    reaction_set.add_reaction(reaction);
+  }
+
+  //! reads the reactions of a rate file, n_title title lines, n_rates (A beta Ea_R) per line, Hr last
+  template<typename Scalar>
+  void read_kinetics_reactions(const std::string &file, unsigned int n_title, unsigned int n_rates,
+                               Antioch::ReactionType::ReactionType reaction_type,
+                               Antioch::ReactionSet<Scalar> &reaction_set)
+  {
+    std::ifstream data(file.c_str());
+    if(!data.good())
+    {
+      std::cerr << "Could not open reactions file " << file << std::endl;
+      antioch_error();
+    }
+    std::string line;
+    for(unsigned int i = 0; i < n_title; i++)getline(data,line);
+
+    while(getline(data,line))
+    {
+      shave_string(line);
+      if(line.empty())continue;
+
+      const std::string::size_type semicolon = line.find(';');
+      const std::string::size_type arrow     = line.find("->");
+      if(semicolon == std::string::npos || arrow == std::string::npos || arrow > semicolon)
+      {
+        std::cerr << "reaction is badly shaped, need \"reactants -> products; parameters\"\n"
+                  << line << std::endl;
+        antioch_error();
+      }
+
+      std::vector<std::string> reactants, products;
+      std::vector<unsigned int> stoi_reac, stoi_prod;
+      parse_molecules(line.substr(0,arrow),"+",reactants,stoi_reac);
+      parse_molecules(line.substr(arrow + 2,semicolon - arrow - 2),"+",products,stoi_prod);
+      if(!known_molecules(reactants,reaction_set.chemical_mixture()) ||
+         !known_molecules(products,reaction_set.chemical_mixture()))continue;
+
+      std::string equation = line.substr(0,semicolon);
+      shave_string(equation);
+
+      std::vector<Scalar> parameters;
+      std::istringstream numbers(line.substr(semicolon + 1));
+      Scalar value;
+      while(numbers >> value)parameters.push_back(value);
+      if(parameters.size() != 3 * n_rates + 1)
+      {
+        std::cerr << "data are badly shaped, need " << 3 * n_rates + 1 << " numbers in this line\n"
+                  << line << std::endl;
+        antioch_error();
+      }
+
+// Arrhenius if no temperature exponent at all
+      bool arrhenius(true);
+      for(unsigned int r = 0; r < n_rates; r++)arrhenius = arrhenius && (parameters[3 * r + 1] == Scalar(0.L));
+      const Antioch::KineticsModel::KineticsModel kinetics_model = (arrhenius)?Antioch::KineticsModel::ARRHENIUS:
+                                                                               Antioch::KineticsModel::KOOIJ;
+      std::vector<std::vector<Scalar> > rates(n_rates);
+      for(unsigned int r = 0; r < n_rates; r++)
+      {
+        rates[r].push_back(parameters[3 * r]);                      //A
+        if(!arrhenius)rates[r].push_back(parameters[3 * r + 1]);    //beta
+        rates[r].push_back(parameters[3 * r + 2]);                  //Ea_R
+        if(!arrhenius)rates[r].push_back(1.L);                      //Tref
+        rates[r].push_back(1.L);                                    //scale, Ea_R in K
+      }
+
+      add_reaction(equation,reactants,stoi_reac,products,stoi_prod,reaction_type,kinetics_model,rates,reaction_set);
+    }
+    data.close();
+  }
+
+  //! elementary reactions file
+  template<typename Scalar>
+  void read_elementary_reactions(const std::string &file, Antioch::ReactionSet<Scalar> &reaction_set)
+  {
+    read_kinetics_reactions(file,1,1,Antioch::ReactionType::ELEMENTARY,reaction_set);
+  }
+
+  //! Lindemann falloff reactions file
+  template<typename Scalar>
+  void read_falloff_reactions(const std::string &file, Antioch::ReactionSet<Scalar> &reaction_set)
+  {
+    read_kinetics_reactions(file,3,2,Antioch::ReactionType::LINDEMANN_FALLOFF,reaction_set);
+  }
+
+  //! photolysis reactions of molecule reactant, one per branch of the cross-sections file
+  template<typename Scalar>
+  void read_photolysis_reactions(const std::string &file, const std::string &reactant, Antioch::ReactionSet<Scalar> &reaction_set)
+  {
+    std::ifstream data(file.c_str());
+    if(!data.good())
+    {
+      std::cerr << "Could not open cross-sections file " << file << std::endl;
+      antioch_error();
+    }
+    std::string line;
+    getline(data,line);
+    std::vector<std::string> header;
+    {
+      std::istringstream words(line);
+      std::string word;
+      while(words >> word)header.push_back(word);
+    }
+    if(header.size() < 3)
+    {
+      std::cerr << "cross-sections header is badly shaped, need \"Lambda Total branches...\"\n"
+                << line << std::endl;
+      antioch_error();
+    }
+    const unsigned int n_branches = header.size() - 2;
+
+// wavelengths then the branches
+    std::vector<Scalar> lambda;
+    std::vector<std::vector<Scalar> > sigmas(n_branches);
+    while(getline(data,line))
+    {
+      std::istringstream numbers(line);
+      Scalar l, total;
+      if(!(numbers >> l >> total))continue;
+      lambda.push_back(l);
+      for(unsigned int ibr = 0; ibr < n_branches; ibr++)
+      {
+        Scalar sigma(0.L);
+        numbers >> sigma;
+        sigmas[ibr].push_back(sigma);
+      }
+    }
+    data.close();
+
+    const std::vector<std::string> reactants(1,reactant);
+    const std::vector<unsigned int> stoi_reac(1,1);
+    if(!known_molecules(reactants,reaction_set.chemical_mixture()))return;
+    for(unsigned int ibr = 0; ibr < n_branches; ibr++)
+    {
+      std::vector<std::string> products;
+      std::vector<unsigned int> stoi_prod;
+      parse_molecules(header[ibr + 2],"/",products,stoi_prod);
+      if(!known_molecules(products,reaction_set.chemical_mixture()))continue;
+
+      std::string equation(reactant + " -> ");
+      for(unsigned int ip = 0; ip < products.size(); ip++)
+      {
+        for(unsigned int i = 0; i < stoi_prod[ip]; i++)equation += products[ip] + " + ";
+      }
+      equation.erase(equation.size() - 3, 3);
+
+      std::vector<std::vector<Scalar> > rates(1,lambda);
+      rates[0].insert(rates[0].end(),sigmas[ibr].begin(),sigmas[ibr].end());
+
+      add_reaction(equation,reactants,stoi_reac,products,stoi_prod,
+                   Antioch::ReactionType::ELEMENTARY,Antioch::KineticsModel::PHOTOCHEM,rates,reaction_set);
+    }
+  }
+
+}
+
+#endif
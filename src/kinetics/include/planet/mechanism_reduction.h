@@ -0,0 +1,589 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_MECHANISM_REDUCTION_H
+#define PLANET_MECHANISM_REDUCTION_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+#include "antioch/reaction_set.h"
+#include "antioch/photochemical_rate.h"
+#include "antioch/particle_flux.h"
+
+//Planet
+#include "planet/atmospheric_temperature.h"
+#include "planet/photon_evaluator.h"
+
+//C++
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+namespace Planet
+{
+  /*!\class MechanismReduction
+   *
+   * Directed relation graph (DRG) reduction of the neutral mechanism.
+   *
+   * States are sampled along a converged column; at each of them the rates of
+   * progress q_r are computed with the full mechanism and the coefficients
+   *
+   *    r_AB = sum_r |nu_Ar q_r delta_Br| / sum_r |nu_Ar q_r|
+   *
+   * are stored, with delta_Br = 1 if B is involved in r, keeping the maximum
+   * over the samples. Species reached from the targets through edges r_AB above
+   * the threshold are kept, the others are removed along with all the
+   * reactions involving them. Among the remaining reactions, those whose
+   * contribution |nu_Ar q_r| / sum_r |nu_Ar q_r| stays under the threshold for
+   * every kept species are removed too.
+   *
+   * The error report compares, at the sampled states, the net rates of the kept
+   * species between the full and the reduced mechanisms, scaled by the total
+   * production-loss turnover of the species. The reduced rates are those of the
+   * reduced reaction set: kept reactions only, removed species absent, so that
+   * the pressure dependent rate constants see the reduced total concentration.
+   *
+   * The photon flux is computed in a flux of its own, the one of the
+   * photon evaluator, shared with the reaction set, is left untouched.
+   *
+   * The reduced mechanism is written in the input formats: a species
+   * list in the neutral_list.dat format and filtered reaction files.
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  class MechanismReduction
+  {
+      private:
+        //! no default constructor
+        MechanismReduction(){antioch_error();return;}
+
+        const Antioch::ReactionSet<CoeffType>                    &_reaction_set;
+        AtmosphericTemperature<CoeffType,VectorCoeffType>          &_temperature;
+        PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType> &_photon;
+
+        std::vector<unsigned int> _targets;
+
+        //! photolysis rate of each reaction, NULL if not photolysis
+        std::vector<const Antioch::PhotochemicalRate<CoeffType,VectorCoeffType>*> _photolysis;
+        bool                                                                     _has_photolysis;
+        Antioch::ParticleFlux<VectorCoeffType>                                    _photon_flux;
+
+        //! net stoichiometric coefficients, species x reactions
+        MatrixCoeffType _nu;
+        //! species involved in each reaction, once
+        std::vector<std::vector<unsigned int> > _involved;
+        //! max over samples of r_AB
+        MatrixCoeffType _drg;
+        //! max over samples of the contribution of reaction r to species A
+        MatrixCoeffType _contribution;
+
+        //! sampled states and rates of progress
+        VectorCoeffType _altitudes;
+        MatrixCoeffType _concentrations;
+        MatrixCoeffType _sum_concentrations;
+        MatrixCoeffType _rates_of_progress;
+
+        //! max over the samples of |net_full - net_reduced| / turnover, computed by reduce()
+        VectorCoeffType _errors;
+
+        std::vector<bool> _species_kept;
+        std::vector<bool> _reactions_kept;
+        CoeffType         _threshold;
+
+        //! equation with the blank characters removed
+        const std::string normalized_equation(const std::string &equation) const;
+
+        //! errors of the reduced reaction set on the sampled states
+        void compute_errors();
+
+      public:
+        MechanismReduction(const Antioch::ReactionSet<CoeffType>                    &reaction_set,
+                           AtmosphericTemperature<CoeffType,VectorCoeffType>          &temperature,
+                           PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType> &photon);
+        ~MechanismReduction();
+
+        //! adds a species to keep whatever happens
+        void add_target(const std::string &species);
+
+        //! rates of progress of the full mechanism at altitude z
+        template<typename StateType, typename VectorStateType>
+        void rates_of_progress(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations,
+                               const StateType &z, VectorStateType &rates);
+
+        //! adds a state to the samples
+        template<typename StateType, typename VectorStateType>
+        void sample(const VectorStateType &molar_concentrations, const VectorStateType &sum_concentrations, const StateType &z);
+
+        //! removes every sample
+        void clear_samples();
+
+        //! graph search from the targets
+        void reduce(const CoeffType &threshold);
+
+        //!\return true if species s is in the reduced mechanism
+        bool species_kept(unsigned int s) const;
+
+        //!\return true if reaction ir is in the reduced mechanism
+        bool reaction_kept(unsigned int ir) const;
+
+        //!\return number of species in the reduced mechanism
+        unsigned int n_species_kept() const;
+
+        //!\return number of reactions in the reduced mechanism
+        unsigned int n_reactions_kept() const;
+
+        //!\return r_AB, maximum over the samples
+        const CoeffType drg_coefficient(unsigned int A, unsigned int B) const;
+
+        //! max over the samples of |net_full - net_reduced| / turnover for species s, reduced reaction set
+        const CoeffType max_relative_error(unsigned int s) const;
+
+        //! writes the kept species, neutral_list.dat format
+        void write_species_list(std::ostream &out) const;
+
+        //! copies input_file into output_file without the removed reactions, header lines are kept
+        void write_reduced_reactions(const std::string &input_file, const std::string &output_file, unsigned int n_header_lines) const;
+
+        //! summary and errors of the reduced mechanism
+        void print_report(std::ostream &out = std::cout) const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::MechanismReduction(const Antioch::ReactionSet<CoeffType>                    &reaction_set,
+                                                                                    AtmosphericTemperature<CoeffType,VectorCoeffType>          &temperature,
+                                                                                    PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType> &photon):
+    _reaction_set(reaction_set),
+    _temperature(temperature),
+    _photon(photon),
+    _threshold(-1.L)
+  {
+    const unsigned int n_species   = _reaction_set.n_species();
+    const unsigned int n_reactions = _reaction_set.n_reactions();
+
+    _nu.resize(n_species);
+    _drg.resize(n_species);
+    _contribution.resize(n_species);
+    for(unsigned int s = 0; s < n_species; s++)
+    {
+      _nu[s].resize(n_reactions,0.L);
+      _drg[s].resize(n_species,0.L);
+      _contribution[s].resize(n_reactions,0.L);
+    }
+
+    for(unsigned int ir = 0; ir < n_reactions; ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+        _nu[reaction.reactant_id(r)][ir] -= (CoeffType)reaction.reactant_stoichiometric_coefficient(r);
+      for(unsigned int p = 0; p < reaction.n_products(); p++)
+        _nu[reaction.product_id(p)][ir] += (CoeffType)reaction.product_stoichiometric_coefficient(p);
+    }
+
+    _involved.resize(n_reactions);
+    for(unsigned int ir = 0; ir < n_reactions; ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      for(unsigned int r = 0; r < reaction.n_reactants(); r++)_involved[ir].push_back(reaction.reactant_id(r));
+      for(unsigned int p = 0; p < reaction.n_products(); p++) _involved[ir].push_back(reaction.product_id(p));
+      std::sort(_involved[ir].begin(),_involved[ir].end());
+      _involved[ir].erase(std::unique(_involved[ir].begin(),_involved[ir].end()),_involved[ir].end());
+    }
+
+    _has_photolysis = false;
+    _photolysis.resize(n_reactions,NULL);
+    for(unsigned int ir = 0; ir < n_reactions; ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      if(reaction.kinetics_model() != Antioch::KineticsModel::PHOTOCHEM)continue;
+      _photolysis[ir] = dynamic_cast<const Antioch::PhotochemicalRate<CoeffType,VectorCoeffType>*>(&reaction.forward_rate(0));
+      if(!_photolysis[ir])
+      {
+        std::cerr << "Photolysis reaction " << reaction.equation() << " has no photochemical rate" << std::endl;
+        antioch_error();
+      }
+      _has_photolysis = true;
+    }
+
+    _species_kept.resize(n_species,true);
+    _reactions_kept.resize(n_reactions,true);
+    _errors.resize(n_species,0.L);
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::~MechanismReduction()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::add_target(const std::string &species)
+  {
+    const std::map<std::string,unsigned int> &names = _reaction_set.chemical_mixture().active_species_name_map();
+    if(!names.count(species))
+    {
+      std::cerr << "Target species " << species << " is not in the mechanism" << std::endl;
+      antioch_error();
+    }
+    _targets.push_back(names.at(species));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::rates_of_progress(const VectorStateType &molar_concentrations,
+                                                                                        const VectorStateType &sum_concentrations,
+                                                                                        const StateType &z, VectorStateType &rates)
+  {
+    antioch_assert_equal_to(molar_concentrations.size(),_reaction_set.n_species());
+
+    // photolysis rates are read in our photon flux
+    if(_has_photolysis)_photon.update_photon_flux(molar_concentrations,sum_concentrations,z,_photon_flux);
+    const StateType T = _temperature.neutral_temperature(z);
+
+    rates.resize(_reaction_set.n_reactions(),0.L);
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      rates[ir] = (_photolysis[ir])?_photolysis[ir]->rate(_photon_flux):
+                                    reaction.compute_forward_rate_coefficient(molar_concentrations,T);
+      for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+      {
+        for(unsigned int nu = 0; nu < reaction.reactant_stoichiometric_coefficient(r); nu++)
+                rates[ir] *= molar_concentrations[reaction.reactant_id(r)];
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::sample(const VectorStateType &molar_concentrations,
+                                                                             const VectorStateType &sum_concentrations, const StateType &z)
+  {
+    VectorStateType q;
+    this->rates_of_progress(molar_concentrations,sum_concentrations,z,q);
+
+    const unsigned int n_species   = _reaction_set.n_species();
+    const unsigned int n_reactions = _reaction_set.n_reactions();
+
+    for(unsigned int A = 0; A < n_species; A++)
+    {
+      // turnover of A
+      CoeffType den(0.L);
+      for(unsigned int ir = 0; ir < n_reactions; ir++)den += std::abs(_nu[A][ir] * q[ir]);
+      if(den <= 0.L)continue;
+
+      VectorCoeffType num;
+      num.resize(n_species,0.L);
+      for(unsigned int ir = 0; ir < n_reactions; ir++)
+      {
+        if(_nu[A][ir] == 0.L)continue;
+        const CoeffType w = std::abs(_nu[A][ir] * q[ir]);
+
+        const CoeffType c = w / den;
+        if(c > _contribution[A][ir])_contribution[A][ir] = c;
+
+        for(unsigned int b = 0; b < _involved[ir].size(); b++)num[_involved[ir][b]] += w;
+      }
+
+      for(unsigned int B = 0; B < n_species; B++)
+      {
+         if(B == A)continue;
+         if(num[B] / den > _drg[A][B])_drg[A][B] = num[B] / den;
+      }
+    }
+
+    _altitudes.push_back(z);
+    _concentrations.push_back(molar_concentrations);
+    _sum_concentrations.push_back(sum_concentrations);
+    _rates_of_progress.push_back(q);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::clear_samples()
+  {
+    _altitudes.clear();
+    _concentrations.clear();
+    _sum_concentrations.clear();
+    _rates_of_progress.clear();
+    for(unsigned int s = 0; s < _reaction_set.n_species(); s++)
+    {
+      std::fill(_drg[s].begin(),_drg[s].end(),0.L);
+      std::fill(_contribution[s].begin(),_contribution[s].end(),0.L);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::reduce(const CoeffType &threshold)
+  {
+    if(_targets.empty())
+    {
+      std::cerr << "No target species, nothing to reduce the mechanism on" << std::endl;
+      antioch_error();
+    }
+    if(_altitudes.empty())
+    {
+      std::cerr << "No sample, nothing to reduce the mechanism on" << std::endl;
+      antioch_error();
+    }
+
+    _threshold = threshold;
+    const unsigned int n_species   = _reaction_set.n_species();
+    const unsigned int n_reactions = _reaction_set.n_reactions();
+
+    // species: graph search from the targets
+    std::fill(_species_kept.begin(),_species_kept.end(),false);
+    std::queue<unsigned int> to_visit;
+    for(unsigned int t = 0; t < _targets.size(); t++)
+    {
+      if(_species_kept[_targets[t]])continue;
+      _species_kept[_targets[t]] = true;
+      to_visit.push(_targets[t]);
+    }
+    while(!to_visit.empty())
+    {
+      unsigned int A = to_visit.front();
+      to_visit.pop();
+      for(unsigned int B = 0; B < n_species; B++)
+      {
+        if(_species_kept[B] || _drg[A][B] < threshold)continue;
+        _species_kept[B] = true;
+        to_visit.push(B);
+      }
+    }
+
+    // reactions: all species kept, and contributing to at least one of them
+    for(unsigned int ir = 0; ir < n_reactions; ir++)
+    {
+      bool keep(true);
+      for(unsigned int b = 0; b < _involved[ir].size(); b++)keep = keep && _species_kept[_involved[ir][b]];
+      if(keep)
+      {
+        keep = false;
+        for(unsigned int s = 0; s < n_species; s++)
+        {
+          if(_species_kept[s] && _contribution[s][ir] >= threshold)
+          {
+             keep = true;
+             break;
+          }
+        }
+      }
+      _reactions_kept[ir] = keep;
+    }
+
+    this->compute_errors();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_errors()
+  {
+    const unsigned int n_species   = _reaction_set.n_species();
+    const unsigned int n_reactions = _reaction_set.n_reactions();
+
+    std::fill(_errors.begin(),_errors.end(),0.L);
+    VectorCoeffType reduced_concentrations;
+    VectorCoeffType reduced_rates;
+    for(unsigned int i = 0; i < _altitudes.size(); i++)
+    {
+      // the reduced set knows nothing of the removed species
+      reduced_concentrations = _concentrations[i];
+      for(unsigned int s = 0; s < n_species; s++)
+      {
+        if(!_species_kept[s])reduced_concentrations[s] = 0.L;
+      }
+      this->rates_of_progress(reduced_concentrations,_sum_concentrations[i],_altitudes[i],reduced_rates);
+
+      for(unsigned int s = 0; s < n_species; s++)
+      {
+        if(!_species_kept[s])continue;
+        CoeffType full(0.L), reduced(0.L), turnover(0.L);
+        for(unsigned int ir = 0; ir < n_reactions; ir++)
+        {
+          const CoeffType w = _nu[s][ir] * _rates_of_progress[i][ir];
+          full     += w;
+          turnover += std::abs(w);
+          if(_reactions_kept[ir])reduced += _nu[s][ir] * reduced_rates[ir];
+        }
+        if(turnover <= 0.L)continue;
+        const CoeffType e = std::abs(full - reduced) / turnover;
+        if(e > _errors[s])_errors[s] = e;
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  bool MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::species_kept(unsigned int s) const
+  {
+    antioch_assert_less(s,_species_kept.size());
+    return _species_kept[s];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  bool MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::reaction_kept(unsigned int ir) const
+  {
+    antioch_assert_less(ir,_reactions_kept.size());
+    return _reactions_kept[ir];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  unsigned int MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::n_species_kept() const
+  {
+    unsigned int n(0);
+    for(unsigned int s = 0; s < _species_kept.size(); s++)if(_species_kept[s])n++;
+    return n;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  unsigned int MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::n_reactions_kept() const
+  {
+    unsigned int n(0);
+    for(unsigned int ir = 0; ir < _reactions_kept.size(); ir++)if(_reactions_kept[ir])n++;
+    return n;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const CoeffType MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::drg_coefficient(unsigned int A, unsigned int B) const
+  {
+    antioch_assert_less(A,_drg.size());
+    antioch_assert_less(B,_drg.size());
+    return _drg[A][B];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const CoeffType MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::max_relative_error(unsigned int s) const
+  {
+    antioch_assert_less(s,_errors.size());
+    antioch_assert_greater_equal(_threshold,0.L); // reduce() not called
+
+    return _errors[s];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const std::string MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::normalized_equation(const std::string &equation) const
+  {
+    std::string out;
+    for(unsigned int c = 0; c < equation.size(); c++)
+    {
+      if(!std::isspace(equation[c]))out += equation[c];
+    }
+    return out;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::write_species_list(std::ostream &out) const
+  {
+    const Antioch::ChemicalMixture<CoeffType> &mixture = _reaction_set.chemical_mixture();
+    for(unsigned int s = 0; s < mixture.n_species(); s++)
+    {
+      if(_species_kept[s])out << mixture.species_inverse_name_map().at(mixture.species_list()[s]) << std::endl;
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::write_reduced_reactions(const std::string &input_file, const std::string &output_file,
+                                                                                              unsigned int n_header_lines) const
+  {
+    std::set<std::string> kept;
+    for(unsigned int ir = 0; ir < _reaction_set.n_reactions(); ir++)
+    {
+      if(_reactions_kept[ir])kept.insert(this->normalized_equation(_reaction_set.reaction(ir).equation()));
+    }
+
+    std::ifstream in(input_file.c_str());
+    if(!in.good())
+    {
+      std::cerr << "Can't open reaction file " << input_file << std::endl;
+      antioch_error();
+    }
+    std::ofstream out(output_file.c_str());
+
+    std::string line;
+    for(unsigned int l = 0; l < n_header_lines; l++)
+    {
+      getline(in,line);
+      out << line << std::endl;
+    }
+    while(getline(in,line))
+    {
+      // reactions not in the full mechanism are removed as well
+      if(kept.count(this->normalized_equation(line.substr(0,line.find(';')))))out << line << std::endl;
+    }
+
+    in.close();
+    out.close();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void MechanismReduction<CoeffType,VectorCoeffType,MatrixCoeffType>::print_report(std::ostream &out) const
+  {
+    const Antioch::ChemicalMixture<CoeffType> &mixture = _reaction_set.chemical_mixture();
+
+    out << "Mechanism reduction, threshold " << _threshold << ", " << _altitudes.size() << " samples" << std::endl;
+    out << "  species:   " << this->n_species_kept()   << " / " << _reaction_set.n_species()   << std::endl;
+    out << "  reactions: " << this->n_reactions_kept() << " / " << _reaction_set.n_reactions() << std::endl;
+
+    out << "Removed species:" << std::endl;
+    for(unsigned int s = 0; s < mixture.n_species(); s++)
+    {
+      if(!_species_kept[s])out << "  " << mixture.species_inverse_name_map().at(mixture.species_list()[s]) << std::endl;
+    }
+
+    out << "Max relative error on the net rates (full - reduced) / turnover:" << std::endl;
+    for(unsigned int s = 0; s < mixture.n_species(); s++)
+    {
+      if(!_species_kept[s])continue;
+      bool target(false);
+      for(unsigned int t = 0; t < _targets.size(); t++)target = target || (_targets[t] == s);
+      out << "  " << mixture.species_inverse_name_map().at(mixture.species_list()[s])
+          << ((target)?" (target)":"") << "\t" << this->max_relative_error(s) << std::endl;
+    }
+  }
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_NEUTRAL_KINETICS_BACKEND_H
+#define PLANET_NEUTRAL_KINETICS_BACKEND_H
+
+//Antioch
+
+//Planet
+
+//C++
+#include <vector>
+
+namespace Planet
+{
+  /*!\class NeutralKineticsBackend
+   *
+   * Alternative evaluation of the neutral mole sources.
+   * When AtmosphericKinetics is given a backend, the
+   * neutral chemistry is delegated to it instead of the
+   * Antioch KineticsEvaluator. The photon flux is updated
+   * beforehand, so photolysis rates are up to date.
+   *
+   * One virtual call per altitude, nothing per reaction.
+   * The derivatives are written in MatrixCoeffType, the
+   * matrix type of AtmosphericKinetics.
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType = std::vector<VectorCoeffType> >
+  class NeutralKineticsBackend
+  {
+      public:
+        NeutralKineticsBackend(){return;}
+        virtual ~NeutralKineticsBackend(){return;}
+
+        //! neutral mole sources at temperature T
+        virtual void compute_mole_sources(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                          VectorCoeffType &mole_sources) const = 0;
+
+        //! neutral mole sources and their derivatives wrt the concentrations,
+        //! dmole_dn[s][j] = d mole_sources_s / d n_j, sized here
+        virtual void compute_mole_sources_and_derivs(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                                     VectorCoeffType &mole_sources, MatrixCoeffType &dmole_dn) const = 0;
+  };
+
+}
+
+#endif
@@ -0,0 +1,442 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_SPARSE_KINETICS_H
+#define PLANET_SPARSE_KINETICS_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+#include "antioch/reaction_set.h"
+
+//Planet
+#include "planet/neutral_kinetics_backend.h"
+
+//C++
+#include <vector>
+#include <algorithm>
+
+namespace Planet
+{
+  /*!\class SparseKinetics
+   *
+   * Kinetics backend on compressed sparse row (CSR) matrices.
+   * The reaction set is compiled once into
+   *   - the reactant stoichiometry, rows are reactions,
+   *   - the product stoichiometry, rows are reactions,
+   *   - the net stoichiometry, rows are species,
+   * and a vector of rate constants. Then
+   *
+   *    q_r     = k_r prod_j n_j^{nu'_rj}    (reactant matrix)
+   *    omega_s = sum_r nu_sr q_r            (net matrix)
+   *
+   * are loops over contiguous arrays. The reaction set is used
+   * for the rate constants only, photolysis ones included.
+   *
+   * The batched versions work on several points at once, arrays
+   * are flattened by row with the points contiguous:
+   * n[s * n_points + p], k[r * n_points + p], so that the innermost
+   * loop is over the points.
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType = std::vector<VectorCoeffType> >
+  class SparseKinetics: public NeutralKineticsBackend<CoeffType,VectorCoeffType,MatrixCoeffType>
+  {
+      private:
+        //! no default constructor
+        SparseKinetics(){antioch_error();return;}
+
+        const Antioch::ReactionSet<CoeffType> &_reaction_set;
+
+        unsigned int _n_species;
+        unsigned int _n_reactions;
+
+        //! reactant matrix, CSR, n_reactions rows
+        std::vector<unsigned int> _reactant_row;
+        std::vector<unsigned int> _reactant_col;
+        std::vector<unsigned int> _reactant_stoi;
+
+        //! product matrix, CSR, n_reactions rows
+        std::vector<unsigned int> _product_row;
+        std::vector<unsigned int> _product_col;
+        std::vector<unsigned int> _product_stoi;
+
+        //! net matrix, CSR, n_species rows
+        std::vector<unsigned int> _net_row;
+        std::vector<unsigned int> _net_col;
+        VectorCoeffType           _net_val;
+
+        //! builds the matrices
+        void build_matrices();
+
+      public:
+        SparseKinetics(const Antioch::ReactionSet<CoeffType> &reaction_set);
+        ~SparseKinetics();
+
+        //!\return number of species
+        unsigned int n_species() const;
+
+        //!\return number of reactions
+        unsigned int n_reactions() const;
+
+        //! rate constants at temperature T, photon flux as set in the reaction set
+        template<typename StateType, typename VectorStateType>
+        void rate_constants(const StateType &T, const VectorStateType &molar_concentrations, VectorStateType &k) const;
+
+        //! rates of progress from the rate constants
+        template<typename VectorStateType>
+        void rates_of_progress(const VectorStateType &k, const VectorStateType &molar_concentrations, VectorStateType &q) const;
+
+        //! production and loss from the rates of progress
+        template<typename VectorStateType>
+        void production_loss(const VectorStateType &q, VectorStateType &production, VectorStateType &loss) const;
+
+        //! net species sources from the rates of progress
+        template<typename VectorStateType>
+        void species_sources(const VectorStateType &q, VectorStateType &mole_sources) const;
+
+        //! neutral mole sources
+        void compute_mole_sources(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                  VectorCoeffType &mole_sources) const;
+
+        //! neutral mole sources and their derivatives wrt the concentrations,
+        //! pressure dependent rate constants included
+        void compute_mole_sources_and_derivs(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                             VectorCoeffType &mole_sources, MatrixCoeffType &dmole_dn) const;
+
+        //! adds the sources of reaction ir and their derivatives, from its rate constant
+        //! and the derivatives of the rate constant wrt the concentrations (falloff),
+        //! dq_dn is a scratch of n_species
+        template<typename VectorStateType, typename MatrixStateType>
+        void add_reaction_sources_and_derivs(unsigned int ir, const CoeffType &kfwd, const VectorCoeffType &dkfwd_dn,
+                                             const VectorStateType &molar_concentrations,
+                                             VectorStateType &mole_sources, MatrixStateType &dmole_dn,
+                                             VectorCoeffType &dq_dn) const;
+
+        //! rates of progress of n_points points, flattened arrays
+        template<typename VectorStateType>
+        void rates_of_progress(unsigned int n_points, const VectorStateType &k,
+                               const VectorStateType &molar_concentrations, VectorStateType &q) const;
+
+        //! net species sources of n_points points, flattened arrays
+        template<typename VectorStateType>
+        void species_sources(unsigned int n_points, const VectorStateType &q, VectorStateType &mole_sources) const;
+
+        //! neutral mole sources of n_points points, rate constants given, flattened arrays
+        template<typename VectorStateType>
+        void compute_mole_sources(unsigned int n_points, const VectorStateType &k,
+                                  const VectorStateType &molar_concentrations, VectorStateType &mole_sources) const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::SparseKinetics(const Antioch::ReactionSet<CoeffType> &reaction_set):
+    NeutralKineticsBackend<CoeffType,VectorCoeffType,MatrixCoeffType>(),
+    _reaction_set(reaction_set),
+    _n_species(reaction_set.n_species()),
+    _n_reactions(reaction_set.n_reactions())
+  {
+    this->build_matrices();
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::~SparseKinetics()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::build_matrices()
+  {
+    _reactant_row.resize(_n_reactions + 1,0);
+    _product_row.resize(_n_reactions + 1,0);
+    for(unsigned int ir = 0; ir < _n_reactions; ir++)
+    {
+      const Antioch::Reaction<CoeffType> &reaction = _reaction_set.reaction(ir);
+      for(unsigned int r = 0; r < reaction.n_reactants(); r++)
+      {
+        _reactant_col.push_back(reaction.reactant_id(r));
+        _reactant_stoi.push_back(reaction.reactant_stoichiometric_coefficient(r));
+      }
+      for(unsigned int p = 0; p < reaction.n_products(); p++)
+      {
+        _product_col.push_back(reaction.product_id(p));
+        _product_stoi.push_back(reaction.product_stoichiometric_coefficient(p));
+      }
+      _reactant_row[ir + 1] = _reactant_col.size();
+      _product_row[ir + 1]  = _product_col.size();
+    }
+
+// net matrix, species rows: dense per species, zeros removed
+    _net_row.resize(_n_species + 1,0);
+    std::vector<int> nu(_n_reactions);
+    for(unsigned int s = 0; s < _n_species; s++)
+    {
+      std::fill(nu.begin(),nu.end(),0);
+      for(unsigned int ir = 0; ir < _n_reactions; ir++)
+      {
+        for(unsigned int i = _reactant_row[ir]; i < _reactant_row[ir + 1]; i++)
+        {
+          if(_reactant_col[i] == s)nu[ir] -= _reactant_stoi[i];
+        }
+        for(unsigned int i = _product_row[ir]; i < _product_row[ir + 1]; i++)
+        {
+          if(_product_col[i] == s)nu[ir] += _product_stoi[i];
+        }
+      }
+      for(unsigned int ir = 0; ir < _n_reactions; ir++)
+      {
+        if(nu[ir] == 0)continue;
+        _net_col.push_back(ir);
+        _net_val.push_back(nu[ir]);
+      }
+      _net_row[s + 1] = _net_col.size();
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  unsigned int SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::n_species() const
+  {
+    return _n_species;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  unsigned int SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::n_reactions() const
+  {
+    return _n_reactions;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::rate_constants(const StateType &T, const VectorStateType &molar_concentrations,
+                                                                 VectorStateType &k) const
+  {
+    k.resize(_n_reactions,0.L);
+    for(unsigned int ir = 0; ir < _n_reactions; ir++)
+    {
+      k[ir] = _reaction_set.reaction(ir).compute_forward_rate_coefficient(molar_concentrations,T);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::rates_of_progress(const VectorStateType &k, const VectorStateType &molar_concentrations,
+                                                                    VectorStateType &q) const
+  {
+    antioch_assert_equal_to(k.size(),_n_reactions);
+    antioch_assert_equal_to(molar_concentrations.size(),_n_species);
+
+    q.resize(_n_reactions,0.L);
+    for(unsigned int ir = 0; ir < _n_reactions; ir++)
+    {
+      q[ir] = k[ir];
+      for(unsigned int i = _reactant_row[ir]; i < _reactant_row[ir + 1]; i++)
+      {
+        for(unsigned int nu = 0; nu < _reactant_stoi[i]; nu++)q[ir] *= molar_concentrations[_reactant_col[i]];
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::production_loss(const VectorStateType &q, VectorStateType &production, VectorStateType &loss) const
+  {
+    antioch_assert_equal_to(q.size(),_n_reactions);
+
+    production.resize(_n_species);
+    loss.resize(_n_species);
+    std::fill(production.begin(),production.end(),0.L);
+    std::fill(loss.begin(),loss.end(),0.L);
+    for(unsigned int ir = 0; ir < _n_reactions; ir++)
+    {
+      for(unsigned int i = _reactant_row[ir]; i < _reactant_row[ir + 1]; i++)loss[_reactant_col[i]]       += _reactant_stoi[i] * q[ir];
+      for(unsigned int i = _product_row[ir];  i < _product_row[ir + 1];  i++)production[_product_col[i]] += _product_stoi[i]  * q[ir];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::species_sources(const VectorStateType &q, VectorStateType &mole_sources) const
+  {
+    antioch_assert_equal_to(q.size(),_n_reactions);
+
+    mole_sources.resize(_n_species,0.L);
+    for(unsigned int s = 0; s < _n_species; s++)
+    {
+      mole_sources[s] = 0.L;
+      for(unsigned int i = _net_row[s]; i < _net_row[s + 1]; i++)mole_sources[s] += _net_val[i] * q[_net_col[i]];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_mole_sources(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                                                       VectorCoeffType &mole_sources) const
+  {
+    VectorCoeffType k;
+    VectorCoeffType q;
+    this->rate_constants(T,molar_concentrations,k);
+    this->rates_of_progress(k,molar_concentrations,q);
+    this->species_sources(q,mole_sources);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_mole_sources_and_derivs(const CoeffType &T, const VectorCoeffType &molar_concentrations,
+                                                                                                  VectorCoeffType &mole_sources, MatrixCoeffType &dmole_dn) const
+  {
+    antioch_assert_equal_to(molar_concentrations.size(),_n_species);
+
+    mole_sources.resize(_n_species,0.L);
+    dmole_dn.resize(_n_species);
+    for(unsigned int s = 0; s < _n_species; s++)
+    {
+      mole_sources[s] = 0.L;
+      dmole_dn[s].resize(_n_species,0.L);
+      for(unsigned int j = 0; j < _n_species; j++)dmole_dn[s][j] = 0.L;
+    }
+
+    CoeffType kfwd, dkfwd_dT;
+    VectorCoeffType dkfwd_dn(_n_species,0.L);
+    VectorCoeffType dq_dn(_n_species,0.L);
+    for(unsigned int ir = 0; ir < _n_reactions; ir++)
+    {
+      std::fill(dkfwd_dn.begin(),dkfwd_dn.end(),0.L);
+      _reaction_set.reaction(ir).compute_forward_rate_coefficient_and_derivatives(molar_concentrations,T,kfwd,dkfwd_dT,dkfwd_dn);
+
+      this->add_reaction_sources_and_derivs(ir,kfwd,dkfwd_dn,molar_concentrations,mole_sources,dmole_dn,dq_dn);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType, typename MatrixStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::add_reaction_sources_and_derivs(unsigned int ir, const CoeffType &kfwd,
+                                                                                                  const VectorCoeffType &dkfwd_dn,
+                                                                                                  const VectorStateType &molar_concentrations,
+                                                                                                  VectorStateType &mole_sources,
+                                                                                                  MatrixStateType &dmole_dn,
+                                                                                                  VectorCoeffType &dq_dn) const
+  {
+// q = k prod_j n_j^nu_j, the rate constant depends on the concentrations through the falloff
+    CoeffType concentrations(1.L);
+    for(unsigned int i = _reactant_row[ir]; i < _reactant_row[ir + 1]; i++)
+    {
+      for(unsigned int nu = 0; nu < _reactant_stoi[i]; nu++)concentrations *= molar_concentrations[_reactant_col[i]];
+    }
+    const CoeffType q = kfwd * concentrations;
+    for(unsigned int j = 0; j < _n_species; j++)dq_dn[j] = dkfwd_dn[j] * concentrations;
+    for(unsigned int i = _reactant_row[ir]; i < _reactant_row[ir + 1]; i++)
+    {
+      CoeffType dq = kfwd * CoeffType(_reactant_stoi[i]);
+      for(unsigned int l = _reactant_row[ir]; l < _reactant_row[ir + 1]; l++)
+      {
+        const unsigned int power = (l == i)?_reactant_stoi[l] - 1:_reactant_stoi[l];
+        for(unsigned int nu = 0; nu < power; nu++)dq *= molar_concentrations[_reactant_col[l]];
+      }
+      dq_dn[_reactant_col[i]] += dq;
+    }
+
+    for(unsigned int i = _reactant_row[ir]; i < _reactant_row[ir + 1]; i++)
+    {
+      const unsigned int s = _reactant_col[i];
+      const CoeffType nu = _reactant_stoi[i];
+      mole_sources[s] -= nu * q;
+      for(unsigned int j = 0; j < _n_species; j++)dmole_dn[s][j] -= nu * dq_dn[j];
+    }
+    for(unsigned int i = _product_row[ir]; i < _product_row[ir + 1]; i++)
+    {
+      const unsigned int s = _product_col[i];
+      const CoeffType nu = _product_stoi[i];
+      mole_sources[s] += nu * q;
+      for(unsigned int j = 0; j < _n_species; j++)dmole_dn[s][j] += nu * dq_dn[j];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::rates_of_progress(unsigned int n_points, const VectorStateType &k,
+                                                                    const VectorStateType &molar_concentrations, VectorStateType &q) const
+  {
+    antioch_assert_equal_to(k.size(),_n_reactions * n_points);
+    antioch_assert_equal_to(molar_concentrations.size(),_n_species * n_points);
+
+    q.resize(_n_reactions * n_points,0.L);
+    for(unsigned int ir = 0; ir < _n_reactions; ir++)
+    {
+      const unsigned int iq = ir * n_points;
+      for(unsigned int p = 0; p < n_points; p++)q[iq + p] = k[iq + p];
+      for(unsigned int i = _reactant_row[ir]; i < _reactant_row[ir + 1]; i++)
+      {
+        const unsigned int in = _reactant_col[i] * n_points;
+        for(unsigned int nu = 0; nu < _reactant_stoi[i]; nu++)
+        {
+          for(unsigned int p = 0; p < n_points; p++)q[iq + p] *= molar_concentrations[in + p];
+        }
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::species_sources(unsigned int n_points, const VectorStateType &q, VectorStateType &mole_sources) const
+  {
+    antioch_assert_equal_to(q.size(),_n_reactions * n_points);
+
+    mole_sources.resize(_n_species * n_points,0.L);
+    for(unsigned int s = 0; s < _n_species; s++)
+    {
+      const unsigned int is = s * n_points;
+      for(unsigned int p = 0; p < n_points; p++)mole_sources[is + p] = 0.L;
+      for(unsigned int i = _net_row[s]; i < _net_row[s + 1]; i++)
+      {
+        const CoeffType nu     = _net_val[i];
+        const unsigned int iq  = _net_col[i] * n_points;
+        for(unsigned int p = 0; p < n_points; p++)mole_sources[is + p] += nu * q[iq + p];
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void SparseKinetics<CoeffType,VectorCoeffType,MatrixCoeffType>::compute_mole_sources(unsigned int n_points, const VectorStateType &k,
+                                                                       const VectorStateType &molar_concentrations, VectorStateType &mole_sources) const
+  {
+    VectorStateType q;
+    this->rates_of_progress(n_points,k,molar_concentrations,q);
+    this->species_sources(n_points,q,mole_sources);
+  }
+
+}
+
+#endif
@@ -0,0 +1,331 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_COLUMN_DENSITY_INTEGRATOR_H
+#define PLANET_COLUMN_DENSITY_INTEGRATOR_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+
+//C++
+#include <vector>
+#include <algorithm>
+
+namespace Planet
+{
+  /*!\class ColumnDensityIntegrator
+   *
+   * Column densities above the nodes of an altitude grid, per species,
+   * cumulated from the top in one sweep over the nodal densities:
+   *
+   *   N_s(z_i) = N_s(z_{i+1}) + int_{z_i}^{z_{i+1}} n_s(z) dz
+   *
+   * The column above the highest node is given (barometric guess, zero
+   * at the top of the atmosphere). Each interval is integrated either by
+   * the trapezoidal rule or by the quadratic through the interval and its
+   * neighbour (the upper one, the lower one for the last interval): on two
+   * intervals, the non uniform Simpson rule, the column is known at every
+   * node. An interval where the quadratic of a steep profile would give a
+   * negative contribution falls back to the trapezoidal rule.
+   *
+   * The table is read only out of the integration, the photon flux is
+   * computed from it (see PhotonEvaluator).
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  class ColumnDensityIntegrator
+  {
+      private:
+        //! no default constructor
+        ColumnDensityIntegrator(){antioch_error();return;}
+
+        unsigned int    _n_species;
+        bool            _simpson;
+
+        //! increasing altitudes, one column vector per altitude, handed
+        //! to the photon flux as is
+        VectorCoeffType _altitudes;
+        std::vector<VectorCoeffType> _columns;
+
+        //! quadrature weights of the interval [z_iz, z_{iz+1}] on nodes
+        //! i0, i0 + 1, i0 + 2, trapezoid if i0 is iz and w2 is zero
+        void weights(unsigned int iz, unsigned int &i0, CoeffType &w0, CoeffType &w1, CoeffType &w2) const;
+
+        //! one sweep, density of species s at node iz is densities(iz,s)
+        template<typename Accessor>
+        void sweep(const Accessor &densities);
+
+        //! row access, densities[iz][s]
+        template<typename MatrixStateType>
+        struct RowAccessor
+        {
+          const MatrixStateType &densities;
+          RowAccessor(const MatrixStateType &d):densities(d){}
+          const CoeffType operator()(unsigned int iz, unsigned int s) const {return densities[iz][s];}
+        };
+
+        //! flattened access, densities[iz * n_species + s]
+        template<typename VectorStateType>
+        struct FlattenedAccessor
+        {
+          const VectorStateType &densities;
+          unsigned int n_species;
+          FlattenedAccessor(const VectorStateType &d, unsigned int n):densities(d),n_species(n){}
+          const CoeffType operator()(unsigned int iz, unsigned int s) const {return densities[iz * n_species + s];}
+        };
+
+      public:
+        ColumnDensityIntegrator(unsigned int n_species);
+        ~ColumnDensityIntegrator();
+
+        //! Simpson (default) or trapezoidal rule
+        void set_simpson(bool simpson);
+
+        //!\return true if the Simpson rule is used
+        bool simpson() const;
+
+        //! nodes of the column, sorted, columns set to zero
+        template<typename VectorStateType>
+        void set_altitudes(const VectorStateType &altitudes);
+
+        //! new node z with its column
+        //!\return index of the node, the ones above are shifted
+        template<typename StateType, typename VectorStateType>
+        unsigned int insert_altitude(const StateType &z, const VectorStateType &column);
+
+        //! column above node iz, the one of the highest node is the top column
+        template<typename VectorStateType>
+        void set_column(unsigned int iz, const VectorStateType &column);
+
+        //! columns from densities[iz][s] at the nodes, the top column is kept
+        template<typename MatrixStateType>
+        void integrate(const MatrixStateType &densities);
+
+        //! columns from densities[iz * n_species + s] at the nodes, the top column is kept
+        template<typename VectorStateType>
+        void integrate_flattened(const VectorStateType &densities);
+
+        //!\return number of species
+        unsigned int n_species() const;
+
+        //!\return number of nodes
+        unsigned int n_altitudes() const;
+
+        //!\return altitudes of the nodes, increasing
+        const VectorCoeffType &altitudes() const;
+
+        //!\return column above node iz
+        const VectorCoeffType &column(unsigned int iz) const;
+
+        //!\return columns, one vector per node
+        const std::vector<VectorCoeffType> &columns() const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::ColumnDensityIntegrator(unsigned int n_species):
+    _n_species(n_species),
+    _simpson(true)
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::~ColumnDensityIntegrator()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_simpson(bool simpson)
+  {
+    _simpson = simpson;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  bool ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::simpson() const
+  {
+    return _simpson;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_altitudes(const VectorStateType &altitudes)
+  {
+    _altitudes.resize(altitudes.size());
+    for(unsigned int iz = 0; iz < altitudes.size(); iz++)_altitudes[iz] = altitudes[iz];
+    std::sort(_altitudes.begin(),_altitudes.end());
+
+    _columns.resize(_altitudes.size());
+    for(unsigned int iz = 0; iz < _altitudes.size(); iz++)_columns[iz].assign(_n_species,0.L);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  unsigned int ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::insert_altitude(const StateType &z, const VectorStateType &column)
+  {
+    antioch_assert_equal_to(column.size(),_n_species);
+
+    typename VectorCoeffType::iterator it = std::lower_bound(_altitudes.begin(),_altitudes.end(),z);
+    const unsigned int iz = it - _altitudes.begin();
+    _altitudes.insert(it,z);
+    _columns.insert(_columns.begin() + iz,VectorCoeffType(_n_species));
+    this->set_column(iz,column);
+
+    return iz;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::set_column(unsigned int iz, const VectorStateType &column)
+  {
+    antioch_assert_less(iz,_columns.size());
+    antioch_assert_equal_to(column.size(),_n_species);
+
+    for(unsigned int s = 0; s < _n_species; s++)_columns[iz][s] = column[s];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::weights(unsigned int iz, unsigned int &i0,
+                                                                                    CoeffType &w0, CoeffType &w1, CoeffType &w2) const
+  {
+    const CoeffType h = _altitudes[iz + 1] - _altitudes[iz];
+    i0 = iz;
+    w2 = 0.L;
+    if(!_simpson || _altitudes.size() < 3)
+    {
+      w0 = h / CoeffType(2.L);
+      w1 = w0;
+      return;
+    }
+
+// quadratic on z_iz, z_{iz+1}, z_{iz+2}, integrated on the first interval,
+// on z_{iz-1}, z_iz, z_{iz+1}, integrated on the second one, for the last interval
+    if(iz + 2 < _altitudes.size())
+    {
+      const CoeffType h1 = _altitudes[iz + 2] - _altitudes[iz + 1];
+      const CoeffType H  = h + h1;
+      w0 =   h * (CoeffType(3.L) * H - h) / (CoeffType(6.L) * H);
+      w1 =   h * (CoeffType(3.L) * H - CoeffType(2.L) * h) / (CoeffType(6.L) * h1);
+      w2 = - h * h * h / (CoeffType(6.L) * H * h1);
+    }else
+    {
+      i0 = iz - 1;
+      const CoeffType h0 = _altitudes[iz] - _altitudes[iz - 1];
+      const CoeffType H  = h0 + h;
+      w0 = - h * h * h / (CoeffType(6.L) * H * h0);
+      w1 =   h * (CoeffType(3.L) * H - CoeffType(2.L) * h) / (CoeffType(6.L) * h0);
+      w2 =   h * (CoeffType(3.L) * H - h) / (CoeffType(6.L) * H);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename Accessor>
+  inline
+  void ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::sweep(const Accessor &densities)
+  {
+    if(_altitudes.size() < 2)return;
+
+    for(unsigned int iz = _altitudes.size() - 1; iz > 0; iz--)
+    {
+      unsigned int i0;
+      CoeffType w0,w1,w2;
+      this->weights(iz - 1,i0,w0,w1,w2);
+      const CoeffType h = _altitudes[iz] - _altitudes[iz - 1];
+      for(unsigned int s = 0; s < _n_species; s++)
+      {
+        CoeffType segment = w0 * densities(i0,s) + w1 * densities(i0 + 1,s);
+        if(w2 != CoeffType(0.L))segment += w2 * densities(i0 + 2,s);
+        if(segment < CoeffType(0.L))segment = (densities(iz - 1,s) + densities(iz,s)) * h / CoeffType(2.L);
+        _columns[iz - 1][s] = _columns[iz][s] + segment;
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename MatrixStateType>
+  inline
+  void ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::integrate(const MatrixStateType &densities)
+  {
+    antioch_assert_equal_to(densities.size(),_altitudes.size());
+
+    this->sweep(RowAccessor<MatrixStateType>(densities));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::integrate_flattened(const VectorStateType &densities)
+  {
+    antioch_assert_equal_to(densities.size(),_altitudes.size() * _n_species);
+
+    this->sweep(FlattenedAccessor<VectorStateType>(densities,_n_species));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  unsigned int ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::n_species() const
+  {
+    return _n_species;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  unsigned int ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::n_altitudes() const
+  {
+    return _altitudes.size();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const VectorCoeffType &ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::altitudes() const
+  {
+    return _altitudes;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const VectorCoeffType &ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::column(unsigned int iz) const
+  {
+    antioch_assert_less(iz,_columns.size());
+    return _columns[iz];
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  const std::vector<VectorCoeffType> &ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType>::columns() const
+  {
+    return _columns;
+  }
+
+}
+
+#endif
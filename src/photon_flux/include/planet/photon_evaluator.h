@@ -31,6 +31,7 @@
 //Planet
 #include "planet/photon_opacity.h"
 #include "planet/atmospheric_mixture.h"
+#include "planet/column_density_integrator.h"
 
 //C++
 #include <vector>
@@ -75,6 +76,24 @@ namespace Planet
         template<typename StateType, typename VectorStateType>
         void update_photon_flux(const VectorStateType &molar_densities, const VectorStateType &sum_dens, const StateType &z);
 
+        //!calculate photon flux in a given flux, nothing written here, thread safe
+        template<typename StateType, typename VectorStateType>
+        void update_photon_flux(const VectorStateType &molar_densities, const VectorStateType &sum_dens, const StateType &z,
+                                Antioch::ParticleFlux<VectorCoeffType> &phy) const;
+
+        //!calculate photon flux at a state computed from the densities
+        template<typename VectorStateType>
+        void update_photon_flux(const VectorStateType &sum_dens, const AltitudeState<CoeffType,VectorCoeffType> &state);
+
+        //!calculate photon flux at a state computed from the densities in a given flux, thread safe
+        template<typename VectorStateType>
+        void update_photon_flux(const VectorStateType &sum_dens, const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                Antioch::ParticleFlux<VectorCoeffType> &phy) const;
+
+        //!calculate photon flux at node iz of a column table
+        void update_photon_flux(const ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &column, unsigned int iz,
+                                const AltitudeState<CoeffType,VectorCoeffType> &state);
+
   };
 
   template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
@@ -145,20 +164,58 @@ namespace Planet
   inline
   void PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType>::update_photon_flux(const VectorStateType &molar_densities, 
                                                                       const VectorStateType &sum_dens, const StateType &z)
+  {
+     if(!_phy)_phy = new Antioch::ParticleFlux<VectorCoeffType>;
+
+     this->update_photon_flux(molar_densities,sum_dens,z,*_phy);
+
+     return; 
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  void PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType>::update_photon_flux(const VectorStateType &molar_densities, 
+                                                                      const VectorStateType &sum_dens, const StateType &z,
+                                                                      Antioch::ParticleFlux<VectorCoeffType> &phy) const
   {
      antioch_assert_equal_to(molar_densities.size(), _mixture.neutral_composition().n_species());
+
+     AltitudeState<CoeffType,VectorCoeffType> state;
+     _mixture.altitude_state(molar_densities,z,state);
+     this->update_photon_flux(sum_dens,state,phy);
+
+     return; 
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType>::update_photon_flux(const VectorStateType &sum_dens,
+                                                                      const AltitudeState<CoeffType,VectorCoeffType> &state)
+  {
+     if(!_phy)_phy = new Antioch::ParticleFlux<VectorCoeffType>;
+
+     this->update_photon_flux(sum_dens,state,*_phy);
+
+     return; 
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  template<typename VectorStateType>
+  inline
+  void PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType>::update_photon_flux(const VectorStateType &sum_dens,
+                                                                      const AltitudeState<CoeffType,VectorCoeffType> &state,
+                                                                      Antioch::ParticleFlux<VectorCoeffType> &phy) const
+  {
      antioch_assert_equal_to(sum_dens.size(), _mixture.neutral_composition().n_species());
      antioch_assert(!_phy_at_top.abscissa().empty());
      antioch_assert(!_phy_at_top.flux().empty());
 
-     if(!_phy)
-     {
-       _phy = new Antioch::ParticleFlux<VectorCoeffType>;
-       _phy->set_abscissa(_phy_at_top.abscissa());
-     }
+     if(phy.abscissa().empty())phy.set_abscissa(_phy_at_top.abscissa());
 
      VectorCoeffType tau;
-     _hv_tau.compute_tau(_mixture.a(molar_densities,z),sum_dens,tau);
+     _hv_tau.compute_tau(_mixture.a(state),sum_dens,tau);
 
      antioch_assert_equal_to(tau.size(), _phy_at_top.abscissa().size());
 
@@ -169,7 +226,18 @@ namespace Planet
        flux[ilambda] = _phy_at_top.flux()[ilambda] * Antioch::ant_exp(- tau[ilambda]);
      }
 
-     _phy->set_flux(flux);
+     phy.set_flux(flux);
+
+     return; 
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType>
+  inline
+  void PhotonEvaluator<CoeffType,VectorCoeffType,MatrixCoeffType>::update_photon_flux(const ColumnDensityIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType> &column,
+                                                                      unsigned int iz,
+                                                                      const AltitudeState<CoeffType,VectorCoeffType> &state)
+  {
+     this->update_photon_flux(column.column(iz),state);
 
      return; 
   }
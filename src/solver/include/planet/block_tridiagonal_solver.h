@@ -0,0 +1,247 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_BLOCK_TRIDIAGONAL_SOLVER_H
+#define PLANET_BLOCK_TRIDIAGONAL_SOLVER_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//eigen
+#include <Eigen/Dense>
+
+//C++
+#include <vector>
+
+namespace Planet
+{
+  /*!\class BlockTridiagonalSolver
+   *
+   * Block Thomas algorithm for
+   *
+   *   L_i x_{i-1} + D_i x_i + U_i x_{i+1} = b_i,  i = 0 .. n_blocks - 1
+   *
+   * The forward elimination factorizes D_i - L_i C_{i-1} (partial pivoting LU)
+   * with C_i = (D_i - L_i C_{i-1})^{-1} U_i, the back substitution gives x.
+   * Cost is linear in the number of blocks, cubic in the block size.
+   * The factors are kept: back_solve solves another right hand side
+   * with the same matrix at the cost of the substitutions only.
+   * No pivoting between blocks: the system is expected to be block
+   * diagonally dominant, as implicit reaction-diffusion systems are.
+   *
+   * L_0 and U_{n_blocks - 1} are not used.
+   */
+  template<typename CoeffType>
+  class BlockTridiagonalSolver
+  {
+      public:
+        typedef Eigen::Matrix<CoeffType,Eigen::Dynamic,Eigen::Dynamic> Block;
+        typedef Eigen::Matrix<CoeffType,Eigen::Dynamic,1>              BlockVector;
+
+      private:
+        //! no default constructor
+        BlockTridiagonalSolver(){antioch_error();return;}
+
+        unsigned int _n_blocks;
+        unsigned int _block_size;
+
+        std::vector<Block>       _lower;
+        std::vector<Block>       _diagonal;
+        std::vector<Block>       _upper;
+        std::vector<BlockVector> _rhs;
+
+        //! elimination factors and buffer
+        std::vector<Eigen::PartialPivLU<Block> > _lu;
+        std::vector<Block>       _C;
+        std::vector<BlockVector> _d;
+
+      public:
+        BlockTridiagonalSolver(unsigned int n_blocks, unsigned int block_size);
+        ~BlockTridiagonalSolver();
+
+        //!\return number of blocks
+        unsigned int n_blocks() const;
+
+        //!\return size of the blocks
+        unsigned int block_size() const;
+
+        //! all blocks and right hand side to zero
+        void zero();
+
+        //!\return block coupling i to i-1
+        Block &lower(unsigned int i);
+
+        //!\return diagonal block i
+        Block &diagonal(unsigned int i);
+
+        //!\return block coupling i to i+1
+        Block &upper(unsigned int i);
+
+        //!\return right hand side of block i
+        BlockVector &rhs(unsigned int i);
+
+        //! forward elimination of the blocks, factors kept
+        void factorize();
+
+        //! solution for the current right hand side with the last factors,
+        //! flattened solution: x[i * block_size + k]
+        template<typename VectorStateType>
+        void back_solve(VectorStateType &x);
+
+        //! factorize then back_solve
+        template<typename VectorStateType>
+        void solve(VectorStateType &x);
+  };
+
+  template<typename CoeffType>
+  inline
+  BlockTridiagonalSolver<CoeffType>::BlockTridiagonalSolver(unsigned int n_blocks, unsigned int block_size):
+    _n_blocks(n_blocks),
+    _block_size(block_size),
+    _lower(n_blocks,Block::Zero(block_size,block_size)),
+    _diagonal(n_blocks,Block::Zero(block_size,block_size)),
+    _upper(n_blocks,Block::Zero(block_size,block_size)),
+    _rhs(n_blocks,BlockVector::Zero(block_size)),
+    _lu(n_blocks),
+    _C(n_blocks,Block::Zero(block_size,block_size)),
+    _d(n_blocks,BlockVector::Zero(block_size))
+  {
+    antioch_assert_greater(n_blocks,0);
+    return;
+  }
+
+  template<typename CoeffType>
+  inline
+  BlockTridiagonalSolver<CoeffType>::~BlockTridiagonalSolver()
+  {
+    return;
+  }
+
+  template<typename CoeffType>
+  inline
+  unsigned int BlockTridiagonalSolver<CoeffType>::n_blocks() const
+  {
+    return _n_blocks;
+  }
+
+  template<typename CoeffType>
+  inline
+  unsigned int BlockTridiagonalSolver<CoeffType>::block_size() const
+  {
+    return _block_size;
+  }
+
+  template<typename CoeffType>
+  inline
+  void BlockTridiagonalSolver<CoeffType>::zero()
+  {
+    for(unsigned int i = 0; i < _n_blocks; i++)
+    {
+      _lower[i].setZero();
+      _diagonal[i].setZero();
+      _upper[i].setZero();
+      _rhs[i].setZero();
+    }
+  }
+
+  template<typename CoeffType>
+  inline
+  typename BlockTridiagonalSolver<CoeffType>::Block &BlockTridiagonalSolver<CoeffType>::lower(unsigned int i)
+  {
+    antioch_assert_less(i,_n_blocks);
+    return _lower[i];
+  }
+
+  template<typename CoeffType>
+  inline
+  typename BlockTridiagonalSolver<CoeffType>::Block &BlockTridiagonalSolver<CoeffType>::diagonal(unsigned int i)
+  {
+    antioch_assert_less(i,_n_blocks);
+    return _diagonal[i];
+  }
+
+  template<typename CoeffType>
+  inline
+  typename BlockTridiagonalSolver<CoeffType>::Block &BlockTridiagonalSolver<CoeffType>::upper(unsigned int i)
+  {
+    antioch_assert_less(i,_n_blocks);
+    return _upper[i];
+  }
+
+  template<typename CoeffType>
+  inline
+  typename BlockTridiagonalSolver<CoeffType>::BlockVector &BlockTridiagonalSolver<CoeffType>::rhs(unsigned int i)
+  {
+    antioch_assert_less(i,_n_blocks);
+    return _rhs[i];
+  }
+
+  template<typename CoeffType>
+  inline
+  void BlockTridiagonalSolver<CoeffType>::factorize()
+  {
+    for(unsigned int i = 0; i < _n_blocks; i++)
+    {
+      Block pivot = _diagonal[i];
+      if(i > 0)pivot.noalias() -= _lower[i] * _C[i - 1];
+      _lu[i].compute(pivot);
+      if(i + 1 < _n_blocks)_C[i] = _lu[i].solve(_upper[i]);
+    }
+  }
+
+  template<typename CoeffType>
+  template<typename VectorStateType>
+  inline
+  void BlockTridiagonalSolver<CoeffType>::back_solve(VectorStateType &x)
+  {
+// forward elimination of the right hand side
+    for(unsigned int i = 0; i < _n_blocks; i++)
+    {
+      BlockVector d = _rhs[i];
+      if(i > 0)d.noalias() -= _lower[i] * _d[i - 1];
+      _d[i] = _lu[i].solve(d);
+    }
+
+// back substitution
+    x.resize(_n_blocks * _block_size);
+    BlockVector xi = _d[_n_blocks - 1];
+    for(unsigned int k = 0; k < _block_size; k++)x[(_n_blocks - 1) * _block_size + k] = xi(k);
+    for(int i = (int)_n_blocks - 2; i >= 0; i--)
+    {
+      xi = _d[i] - _C[i] * xi;
+      for(unsigned int k = 0; k < _block_size; k++)x[i * _block_size + k] = xi(k);
+    }
+  }
+
+  template<typename CoeffType>
+  template<typename VectorStateType>
+  inline
+  void BlockTridiagonalSolver<CoeffType>::solve(VectorStateType &x)
+  {
+    this->factorize();
+    this->back_solve(x);
+  }
+
+}
+
+#endif
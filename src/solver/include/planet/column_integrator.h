@@ -0,0 +1,592 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_COLUMN_INTEGRATOR_H
+#define PLANET_COLUMN_INTEGRATOR_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+#include "planet/column_solver.h"
+#include "planet/block_tridiagonal_solver.h"
+
+//C++
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace Planet
+{
+  /*!\class ColumnIntegrator
+   *
+   * Transient of the column of a ColumnSolver,
+   *
+   *   V_i dn_i/dt = - R_i(n),  i > 0,   R_0(n) = 0 (lower boundary)
+   *
+   * by variable step BDF2 (implicit Euler for the first two steps).
+   * With omega = h_n / h_{n-1}:
+   *
+   *   (1 + 2 omega)/(1 + omega) y_{n+1} - (1 + omega) y_n + omega^2/(1 + omega) y_{n-1} = h_n f(y_{n+1})
+   *
+   * The local error is estimated from the distance between the solution and
+   * the extrapolation of the previous steps (Milne's device), the step
+   * follows err^{-1/(q+1)}, its growth is kept below 1 + sqrt(2)
+   * (zero-stability of variable step BDF2).
+   *
+   * Each step is solved by simplified Newton on gamma V + J, gamma the
+   * leading coefficient over the step. The Jacobian J is kept across
+   * steps, and evaluated again only when the Newton iterations do not
+   * converge or after max_jacobian_age steps. The iteration matrix is
+   * factorized again only when gamma changed by more than the refactor
+   * ratio.
+   *
+   * The history is kept between two calls to advance, unless the densities
+   * given are not the last ones (or reset is called).
+   *
+   * Physics is the physics of the ColumnSolver, PlanetPhysicsHelper by default.
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType,
+           typename Physics = PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType> >
+  class ColumnIntegrator
+  {
+      private:
+        //! no default constructor
+        ColumnIntegrator(){antioch_error();return;}
+
+        //! owns _jacobian and _iteration, no copy (not implemented)
+        ColumnIntegrator(const ColumnIntegrator &);
+        ColumnIntegrator &operator=(const ColumnIntegrator &);
+
+        ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics> &_column;
+
+        CoeffType    _rel_tol;
+        CoeffType    _abs_tol;
+        CoeffType    _initial_step;
+        CoeffType    _min_step;
+        CoeffType    _max_step;
+        CoeffType    _max_step_growth;
+        unsigned int _max_newton_iterations;
+        unsigned int _max_jacobian_age;
+        CoeffType    _refactor_ratio;
+
+        CoeffType    _time;
+        CoeffType    _step;
+
+        //! last solutions, oldest first, and the steps between them
+        std::vector<VectorCoeffType> _history;
+        VectorCoeffType              _steps;
+
+        //! Jacobian of the residual, and factorized iteration matrix gamma V + J
+        BlockTridiagonalSolver<CoeffType> * _jacobian;
+        BlockTridiagonalSolver<CoeffType> * _iteration;
+        bool         _fresh_jacobian;
+        unsigned int _jacobian_age;
+        CoeffType    _factorized_gamma;
+
+        unsigned int _n_steps;
+        unsigned int _n_rejected;
+        unsigned int _n_residuals;
+        unsigned int _n_jacobians;
+        unsigned int _n_factorizations;
+
+        //! Jacobian at the last solution, residual there
+        void evaluate_jacobian(VectorCoeffType &residual);
+
+        //! gamma V + J factorized, if needed
+        void factorize(const CoeffType &gamma);
+
+        //! RMS of x relative to the tolerances on the last solution
+        const CoeffType weighted_norm(const VectorCoeffType &x) const;
+
+        //! one step of h from the last solution, at order 1 or 2
+        //!\return 0 accepted, 1 error too large, 2 Newton failure
+        unsigned int try_step(const CoeffType &h, const VectorCoeffType &first_residual,
+                              VectorCoeffType &solution, CoeffType &error);
+
+        //! simplified Newton on V (gamma y - history) + R(y) = 0 from solution
+        bool newton(const CoeffType &gamma, const VectorCoeffType &history, VectorCoeffType &solution);
+
+      public:
+        ColumnIntegrator(ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics> &column);
+        ~ColumnIntegrator();
+
+        //! local error per step below rel_tol * n + abs_tol (cm-3), RMS over the column
+        void set_tolerances(const CoeffType &rel_tol, const CoeffType &abs_tol);
+
+        //! first, smallest and largest steps (s)
+        void set_step_limits(const CoeffType &initial_step, const CoeffType &min_step, const CoeffType &max_step);
+
+        //! Jacobian evaluated again after max_age steps at most, iteration
+        //! matrix factorized again when gamma changes by more than refactor_ratio
+        void set_jacobian_reuse(unsigned int max_age, const CoeffType &refactor_ratio);
+
+        //! Newton iterations per step before the Jacobian is evaluated again or the step cut
+        void set_max_newton_iterations(unsigned int max_newton_iterations);
+
+        //! forgets the history, time back to zero
+        void reset();
+
+        //! integrates densities over duration (s)
+        //!\return false if the step fell below the smallest step
+        template<typename VectorStateType>
+        bool advance(VectorStateType &densities, const CoeffType &duration);
+
+        //!\return time integrated since the last reset (s)
+        const CoeffType time() const;
+
+        //!\return next step (s)
+        const CoeffType step() const;
+
+        //!\return accepted steps
+        unsigned int n_steps() const;
+
+        //!\return steps rejected, by error or Newton failure
+        unsigned int n_rejected() const;
+
+        //!\return residual evaluations
+        unsigned int n_residuals() const;
+
+        //!\return Jacobian evaluations
+        unsigned int n_jacobians() const;
+
+        //!\return factorizations of the iteration matrix
+        unsigned int n_factorizations() const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::ColumnIntegrator(ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics> &column):
+    _column(column),
+    _rel_tol(1e-4L),
+    _abs_tol(1e-10L),
+    _initial_step(1e-2L),
+    _min_step(1e-12L),
+    _max_step(1e15L),
+    _max_step_growth(2.L),
+    _max_newton_iterations(4),
+    _max_jacobian_age(20),
+    _refactor_ratio(0.3L),
+    _time(0.L),
+    _step(0.L),
+    _jacobian(NULL),
+    _iteration(NULL),
+    _fresh_jacobian(false),
+    _jacobian_age(0),
+    _factorized_gamma(0.L),
+    _n_steps(0),
+    _n_rejected(0),
+    _n_residuals(0),
+    _n_jacobians(0),
+    _n_factorizations(0)
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::~ColumnIntegrator()
+  {
+    if(_jacobian)delete _jacobian;
+    if(_iteration)delete _iteration;
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_tolerances(const CoeffType &rel_tol, const CoeffType &abs_tol)
+  {
+    _rel_tol = rel_tol;
+    _abs_tol = abs_tol;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_step_limits(const CoeffType &initial_step, const CoeffType &min_step,
+                                                                                    const CoeffType &max_step)
+  {
+    antioch_assert_greater(initial_step,0.L);
+    antioch_assert_less_equal(min_step,initial_step);
+    antioch_assert_less_equal(initial_step,max_step);
+    _initial_step = initial_step;
+    _min_step     = min_step;
+    _max_step     = max_step;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_jacobian_reuse(unsigned int max_age, const CoeffType &refactor_ratio)
+  {
+    _max_jacobian_age = max_age;
+    _refactor_ratio   = refactor_ratio;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_max_newton_iterations(unsigned int max_newton_iterations)
+  {
+    antioch_assert_greater(max_newton_iterations,0);
+    _max_newton_iterations = max_newton_iterations;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::reset()
+  {
+    _history.clear();
+    _steps.clear();
+    _time             = 0.L;
+    _step             = 0.L;
+    _fresh_jacobian   = false;
+    _factorized_gamma = 0.L;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  const CoeffType ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::time() const
+  {
+    return _time;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  const CoeffType ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::step() const
+  {
+    return _step;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_steps() const
+  {
+    return _n_steps;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_rejected() const
+  {
+    return _n_rejected;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_residuals() const
+  {
+    return _n_residuals;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_jacobians() const
+  {
+    return _n_jacobians;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_factorizations() const
+  {
+    return _n_factorizations;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::evaluate_jacobian(VectorCoeffType &residual)
+  {
+    _column.residual_and_jacobian(_history.back(),residual,*_jacobian);
+    _n_jacobians++;
+    _n_residuals++;
+    _fresh_jacobian   = true;
+    _jacobian_age     = 0;
+    _factorized_gamma = 0.L;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::factorize(const CoeffType &gamma)
+  {
+    if(_factorized_gamma > 0.L && std::abs(gamma / _factorized_gamma - CoeffType(1.L)) <= _refactor_ratio)return;
+
+    const unsigned int n_species = _column.n_species();
+    const VectorCoeffType &volumes = _column.volumes();
+    for(unsigned int i = 0; i < _jacobian->n_blocks(); i++)
+    {
+      _iteration->lower(i)    = _jacobian->lower(i);
+      _iteration->diagonal(i) = _jacobian->diagonal(i);
+      _iteration->upper(i)    = _jacobian->upper(i);
+      if(i == 0)continue; // Dirichlet
+      for(unsigned int s = 0; s < n_species; s++)_iteration->diagonal(i)(s,s) += gamma * volumes[i];
+    }
+    _iteration->factorize();
+    _n_factorizations++;
+    _factorized_gamma = gamma;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  const CoeffType ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::weighted_norm(const VectorCoeffType &x) const
+  {
+    const VectorCoeffType &last = _history.back();
+    CoeffType norm(0.L);
+    for(unsigned int k = 0; k < x.size(); k++)
+    {
+      const CoeffType r = x[k] / (_rel_tol * std::abs(last[k]) + _abs_tol);
+      norm += r * r;
+    }
+    return std::sqrt(norm / CoeffType(x.size()));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  bool ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::newton(const CoeffType &gamma, const VectorCoeffType &history,
+                                                                           VectorCoeffType &solution)
+  {
+    const unsigned int n_species = _column.n_species();
+    const VectorCoeffType &volumes = _column.volumes();
+
+    VectorCoeffType residual, correction;
+    CoeffType previous_norm(0.L);
+    for(unsigned int k = 0; k < _max_newton_iterations; k++)
+    {
+      _column.residual(solution,residual);
+      _n_residuals++;
+      for(unsigned int i = 0; i < _iteration->n_blocks(); i++)
+      {
+        for(unsigned int s = 0; s < n_species; s++)
+        {
+          const unsigned int is = i * n_species + s;
+          CoeffType g = residual[is];
+          if(i > 0)g += volumes[i] * (gamma * solution[is] - history[is]);
+          _iteration->rhs(i)(s) = - g;
+        }
+      }
+      _iteration->back_solve(correction);
+
+      for(unsigned int is = 0; is < solution.size(); is++)solution[is] = std::max(solution[is] + correction[is],CoeffType(0.L));
+
+      const CoeffType norm = this->weighted_norm(correction);
+      if(!(norm == norm))return false; // NaN
+
+// converged well below the local error: 1/10 of the tolerance, with the
+// contraction rate estimate after the first iteration
+      if(k == 0)
+      {
+        if(norm <= CoeffType(1e-2L))return true;
+      }else
+      {
+        const CoeffType rate = norm / previous_norm;
+        if(rate >= CoeffType(0.9L))return false;
+        if(norm * rate / (CoeffType(1.L) - rate) <= CoeffType(1e-1L))return true;
+      }
+      previous_norm = norm;
+    }
+
+    return false;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::try_step(const CoeffType &h, const VectorCoeffType &first_residual,
+                                                                                    VectorCoeffType &solution, CoeffType &error)
+  {
+    const unsigned int n_species = _column.n_species();
+    const VectorCoeffType &volumes = _column.volumes();
+    const VectorCoeffType &last = _history.back();
+    const unsigned int n_unknowns = last.size();
+
+    VectorCoeffType predictor(n_unknowns,0.L);
+    VectorCoeffType history(n_unknowns,0.L);
+    CoeffType gamma(0.L);
+    CoeffType error_constant(0.L);
+    CoeffType predictor_constant(0.L);
+
+    if(_history.size() < 3)
+    {
+// implicit Euler, predictor explicit Euler or linear extrapolation
+      gamma = CoeffType(1.L) / h;
+      error_constant = h * h;
+      if(_history.size() == 1)
+      {
+        predictor_constant = h * h;
+        for(unsigned int i = 0; i < n_unknowns / n_species; i++)
+        {
+          for(unsigned int s = 0; s < n_species; s++)
+          {
+            const unsigned int is = i * n_species + s;
+            predictor[is] = (i == 0)?last[is]:last[is] - h * first_residual[is] / volumes[i];
+          }
+        }
+      }else
+      {
+        const CoeffType h1 = _steps.back();
+        const VectorCoeffType &previous = _history[_history.size() - 2];
+        predictor_constant = h * (h + h1);
+        for(unsigned int is = 0; is < n_unknowns; is++)predictor[is] = last[is] + h / h1 * (last[is] - previous[is]);
+      }
+      for(unsigned int is = 0; is < n_unknowns; is++)history[is] = last[is] / h;
+    }else
+    {
+// BDF2, predictor quadratic extrapolation
+      const CoeffType h1 = _steps[_steps.size() - 1];
+      const CoeffType h2 = _steps[_steps.size() - 2];
+      const VectorCoeffType &previous = _history[_history.size() - 2];
+      const VectorCoeffType &oldest   = _history[_history.size() - 3];
+      const CoeffType omega = h / h1;
+
+      gamma = (CoeffType(1.L) + CoeffType(2.L) * omega) / ((CoeffType(1.L) + omega) * h);
+      error_constant     = h * h * (h + h1) * (h + h1) / (CoeffType(2.L) * h + h1);
+      predictor_constant = h * (h + h1) * (h + h1 + h2);
+
+      const CoeffType l0 = (h + h1) * (h + h1 + h2) / (h1 * (h1 + h2));
+      const CoeffType l1 = - h * (h + h1 + h2) / (h1 * h2);
+      const CoeffType l2 = h * (h + h1) / ((h1 + h2) * h2);
+      for(unsigned int is = 0; is < n_unknowns; is++)
+      {
+        predictor[is] = std::max(l0 * last[is] + l1 * previous[is] + l2 * oldest[is],CoeffType(0.L));
+        history[is] = ((CoeffType(1.L) + omega) * last[is] - omega * omega / (CoeffType(1.L) + omega) * previous[is]) / h;
+      }
+    }
+
+    this->factorize(gamma);
+    solution = predictor;
+    if(!this->newton(gamma,history,solution))return 2;
+
+// Milne's device
+    VectorCoeffType estimate(n_unknowns,0.L);
+    const CoeffType milne = error_constant / (error_constant + predictor_constant);
+    for(unsigned int is = 0; is < n_unknowns; is++)estimate[is] = milne * (solution[is] - predictor[is]);
+    error = this->weighted_norm(estimate);
+    if(!(error == error))return 2; // NaN
+
+    return (error <= CoeffType(1.L))?0:1;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  bool ColumnIntegrator<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::advance(VectorStateType &densities, const CoeffType &duration)
+  {
+    antioch_assert_equal_to(densities.size() % _column.n_species(),0);
+    antioch_assert_greater_equal(duration,0.L);
+
+    const unsigned int n_unknowns = densities.size();
+    const unsigned int n_nodes    = n_unknowns / _column.n_species();
+
+    if(!_jacobian || _jacobian->n_blocks() != n_nodes)
+    {
+      if(_jacobian)delete _jacobian;
+      if(_iteration)delete _iteration;
+      _jacobian  = new BlockTridiagonalSolver<CoeffType>(n_nodes,_column.n_species());
+      _iteration = new BlockTridiagonalSolver<CoeffType>(n_nodes,_column.n_species());
+      _history.clear();
+    }
+
+// restart if the densities are not the last solution
+    bool restart = _history.empty();
+    for(unsigned int k = 0; !restart && k < n_unknowns; k++)restart = (densities[k] != _history.back()[k]);
+    if(restart)
+    {
+      const CoeffType time = _time;
+      this->reset();
+      _time = time;
+      _history.push_back(VectorCoeffType(n_unknowns,0.L));
+      for(unsigned int k = 0; k < n_unknowns; k++)_history.back()[k] = densities[k];
+      _step = _initial_step;
+    }
+
+    VectorCoeffType first_residual, solution;
+    if(restart)
+    {
+// consistent initial state: the lower boundary rows are algebraic
+      _column.residual(_history.back(),first_residual);
+      _n_residuals++;
+      for(unsigned int s = 0; s < _column.n_species(); s++)_history.back()[s] -= first_residual[s];
+      this->evaluate_jacobian(first_residual);
+    }
+
+    const CoeffType end = _time + duration;
+    while(_time < end)
+    {
+// last step on the end, no sliver left
+      CoeffType h = std::min(_step,_max_step);
+      bool last_step(false);
+      if(_time + h * CoeffType(1.05L) >= end)
+      {
+        h = end - _time;
+        last_step = true;
+      }
+
+      CoeffType error(0.L);
+      const unsigned int status = this->try_step(h,first_residual,solution,error);
+      if(status == 2)
+      {
+        _n_rejected++;
+        if(!_fresh_jacobian)
+        {
+          this->evaluate_jacobian(first_residual);
+          continue;
+        }
+        _step = h / CoeffType(4.L);
+        _factorized_gamma = 0.L;
+        if(_step < _min_step)return false;
+        continue;
+      }
+
+      const CoeffType order = (_history.size() < 3)?CoeffType(1.L):CoeffType(2.L);
+      CoeffType factor = CoeffType(0.9L) * std::pow(std::max(error,CoeffType(1e-10L)),- CoeffType(1.L) / (order + CoeffType(1.L)));
+      if(status == 1)
+      {
+        _n_rejected++;
+        _step = h * std::max(std::min(factor,CoeffType(0.9L)),CoeffType(0.2L));
+        if(_step < _min_step)return false;
+        continue;
+      }
+
+// accepted
+      _n_steps++;
+      _time = (last_step)?end:_time + h;
+      _history.push_back(solution);
+      _steps.push_back(h);
+      if(_history.size() > 3)
+      {
+        _history.erase(_history.begin());
+        _steps.erase(_steps.begin());
+      }
+
+// the clipped last step does not decide of the next one
+      if(!last_step)_step = h * std::max(std::min(factor,_max_step_growth),CoeffType(0.2L));
+
+      _fresh_jacobian = false;
+      _jacobian_age++;
+      if(_jacobian_age >= _max_jacobian_age)this->evaluate_jacobian(first_residual);
+    }
+
+    for(unsigned int k = 0; k < n_unknowns; k++)densities[k] = _history.back()[k];
+
+    return true;
+  }
+
+}
+
+#endif
@@ -0,0 +1,1071 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_COLUMN_SOLVER_H
+#define PLANET_COLUMN_SOLVER_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+#include "planet/planet_physics_helper.h"
+#include "planet/block_tridiagonal_solver.h"
+#include "planet/planet_constants.h"
+
+//C++
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace Planet
+{
+  /*!\class ColumnSolver
+   *
+   * Steady state of the 1D spherical column, finite volumes on the altitude
+   * nodes, no FEM framework:
+   *
+   *   1/r^2 d(r^2 Phi_s)/dr = omega_dot_s,  Phi_s = n_s omega_s
+   *
+   * Node i holds the volume between the mid-points [z_{i-1/2},z_{i+1/2}],
+   * the flux at z_{i+1/2} uses the mean concentrations and the centered
+   * gradient of the two nodes. The lowest node is Dirichlet (lower boundary
+   * concentrations), the highest node volume ends at the top, where the
+   * flux is the Jeans escape flux.
+   *
+   * Damped Newton: the Jacobian is block tridiagonal (one block per node,
+   * species x species) and solved by block Thomas, linear in the number
+   * of nodes. The photon flux is lagged: the column above a node is the one
+   * of the helper cache, updated after each assembly. The step is limited to
+   * keep the concentrations positive, then halved while the scaled residual
+   * does not decrease.
+   *
+   * Optionally the unknowns are ln(n_s) (set_log_formulation): the Jacobian
+   * columns are scaled by the concentrations, the Dirichlet rows are written
+   * on ln(n), each update of ln(n) is clipped to max_log_step and the line
+   * search checks the decrease of the Newton correction (natural
+   * monotonicity) instead of the residual, which trace species dominate.
+   * Trace species spanning tens of orders of magnitude stay positive
+   * whatever the step.
+   *
+   * The Newton iterations may keep a Jacobian and its factors over several
+   * iterations (set_jacobian_reuse), and freeze the photolysis column
+   * between two Jacobians (set_freeze_photolysis), counters tell the
+   * factorizations saved.
+   *
+   * Far from the solution, solve_pseudo_transient marches V dn/dtau = - R
+   * with implicit Euler steps, (V/dtau + J) dn = - R, the pseudo time step
+   * following the residual (switched evolution relaxation,
+   * dtau_{k+1} = dtau_k |R_{k-1}| / |R_k|). Once dtau reaches the Newton
+   * time step, the mass term is negligible and plain Newton takes over.
+   *
+   * Concentrations are flattened node by node: [i * n_species + s].
+   *
+   * The physics are those of a PlanetPhysicsHelper, any class with the same
+   * node interface (first guess, boundaries, chemical and diffusion terms with
+   * or without derivatives, column updates) can replace it, e.g. an analytic
+   * model.
+   */
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType,
+           typename Physics = PlanetPhysicsHelper<CoeffType,VectorCoeffType,MatrixCoeffType> >
+  class ColumnSolver
+  {
+      private:
+        //! no default constructor
+        ColumnSolver(){antioch_error();return;}
+
+        //! owns _linear, no copy (not implemented)
+        ColumnSolver(const ColumnSolver &);
+        ColumnSolver &operator=(const ColumnSolver &);
+
+        Physics &_helper;
+
+        unsigned int _n_species;
+
+        //! nodes, volumes (r^2 dr) and face areas (r^2), face i between nodes i and i+1
+        VectorCoeffType _altitudes;
+        VectorCoeffType _volumes;
+        VectorCoeffType _areas;
+        CoeffType       _top_area;
+
+        //! Jeans flux per unit concentration
+        VectorCoeffType _escape_velocities;
+
+        CoeffType    _rel_tol;
+        CoeffType    _abs_tol;
+        unsigned int _max_iterations;
+        CoeffType    _min_damping;
+
+        bool         _log_formulation;
+        CoeffType    _log_floor;
+        CoeffType    _max_log_step;
+
+        //! pseudo-transient continuation
+        CoeffType    _initial_time_step;
+        CoeffType    _newton_time_step;
+        CoeffType    _max_time_step_growth;
+        CoeffType    _max_residual_growth;
+        unsigned int _max_pseudo_steps;
+
+        //! Jacobian reuse
+        unsigned int _max_reuse;
+        CoeffType    _max_rate;
+        bool         _freeze_photolysis;
+
+        unsigned int _n_iterations;
+        unsigned int _n_pseudo_steps;
+        unsigned int _n_jacobians;
+        unsigned int _n_factorizations;
+        unsigned int _n_factorizations_saved;
+        unsigned int _n_column_updates;
+        CoeffType    _residual_norm;
+        VectorCoeffType _residual_history;
+        VectorCoeffType _time_step_history;
+
+        BlockTridiagonalSolver<CoeffType> * _linear;
+
+        //! residual, and Jacobian in _linear if jacobian is true
+        template<typename VectorStateType>
+        void assemble(const VectorStateType &densities, VectorStateType &residual, bool jacobian);
+
+        //! Jacobian wrt ln(n) and log Dirichlet rows, from an assembly in n
+        template<typename VectorStateType>
+        void to_log_variables(const VectorStateType &densities, VectorStateType &residual);
+
+        //! Dirichlet rows on ln(n)
+        template<typename VectorStateType>
+        void log_dirichlet(const VectorStateType &densities, VectorStateType &residual) const;
+
+        //! copies the Jacobian of _linear
+        void copy_jacobian(BlockTridiagonalSolver<CoeffType> &jacobian) const;
+
+        //! RMS of a vector
+        template<typename VectorStateType>
+        const CoeffType rms(const VectorStateType &x) const;
+
+        //! RMS of the residual, relative to the concentrations (times the volume)
+        template<typename VectorStateType>
+        const CoeffType scaled_norm(const VectorStateType &densities, const VectorStateType &residual) const;
+
+        //! clips the update (ln(n)) or returns the damping keeping n positive
+        template<typename VectorStateType>
+        const CoeffType limit_step(const VectorStateType &densities, VectorStateType &update) const;
+
+        //! trial = densities + damping * update, in n or ln(n)
+        template<typename VectorStateType>
+        void take_step(const VectorStateType &densities, const VectorStateType &update,
+                       const CoeffType &damping, VectorStateType &trial) const;
+
+        //! largest update relative to the tolerances
+        template<typename VectorStateType>
+        const CoeffType update_norm(const VectorStateType &densities, const VectorStateType &trial) const;
+
+        //! adds V / dtau to the diagonal of the Jacobian in _linear
+        template<typename VectorStateType>
+        void add_pseudo_time(const VectorStateType &densities, const CoeffType &inverse_time_step);
+
+        //! rhs of _linear = - residual
+        template<typename VectorStateType>
+        void set_rhs(const VectorStateType &residual);
+
+        //! floors, resets counters and histories
+        template<typename VectorStateType>
+        void start(VectorStateType &densities);
+
+        //! Newton iterations, counters and histories continued, fails if the
+        //! line search fails on a fresh Jacobian
+        template<typename VectorStateType>
+        bool newton(VectorStateType &densities);
+
+      public:
+        ColumnSolver(Physics &helper);
+        ~ColumnSolver();
+
+        //! altitude nodes (km), fixes the altitude grid of the helper
+        template<typename VectorStateType>
+        void set_altitudes(const VectorStateType &altitudes);
+
+        //! convergence when every Newton update is below rel_tol * n + abs_tol (cm-3)
+        void set_tolerances(const CoeffType &rel_tol, const CoeffType &abs_tol);
+
+        //! maximum number of Newton iterations
+        void set_max_iterations(unsigned int max_iterations);
+
+        //! smallest damping factor of the line search
+        void set_min_damping(const CoeffType &min_damping);
+
+        //! unknowns ln(n): positive densities by construction, the Newton update
+        //! of ln(n) is limited to max_log_step, densities floored to floor (cm-3)
+        void set_log_formulation(bool log_formulation, const CoeffType &floor = 1e-60L, const CoeffType &max_log_step = 4.6L);
+
+        //! pseudo-transient continuation: first pseudo time step (s), pure Newton
+        //! once the pseudo time step reaches newton_time_step, at most
+        //! max_pseudo_steps linear solves before it
+        void set_pseudo_transient(const CoeffType &initial_time_step, const CoeffType &newton_time_step,
+                                  unsigned int max_pseudo_steps = 500);
+
+        //! growth of the pseudo time step per step (at most), growth of the
+        //! residual above which a step is taken again with dtau / 4
+        void set_pseudo_transient_limits(const CoeffType &max_time_step_growth, const CoeffType &max_residual_growth);
+
+        //! modified Newton: a Jacobian and its factors are kept over max_reuse
+        //! iterations at most, and evaluated again as soon as the contraction
+        //! (residual in n, Newton correction in ln(n)) is above max_rate or
+        //! the line search fails. max_reuse = 1 is plain Newton.
+        void set_jacobian_reuse(unsigned int max_reuse, const CoeffType &max_rate = 0.5L);
+
+        //! photolysis (column above) frozen in the Newton iterations, updated
+        //! with the Jacobian only
+        void set_freeze_photolysis(bool freeze);
+
+        //! first guess of the helper at each node
+        template<typename VectorStateType>
+        void first_guess(VectorStateType &densities) const;
+
+        //! steady state residual
+        template<typename VectorStateType>
+        void residual(const VectorStateType &densities, VectorStateType &residual);
+
+        //! steady state residual and its Jacobian, copied in jacobian
+        template<typename VectorStateType>
+        void residual_and_jacobian(const VectorStateType &densities, VectorStateType &residual,
+                                   BlockTridiagonalSolver<CoeffType> &jacobian);
+
+        //! residual of the log formulation, Dirichlet rows on ln(n)
+        template<typename VectorStateType>
+        void log_residual(const VectorStateType &densities, VectorStateType &residual);
+
+        //! residual of the log formulation and its Jacobian wrt ln(n), copied in jacobian
+        template<typename VectorStateType>
+        void log_residual_and_jacobian(const VectorStateType &densities, VectorStateType &residual,
+                                       BlockTridiagonalSolver<CoeffType> &jacobian);
+
+        //! number of species per node
+        unsigned int n_species() const;
+
+        //! node volumes, the residual is V dn/dt = - R away from the lower boundary
+        const VectorCoeffType &volumes() const;
+
+        //! Newton iterations from densities
+        //!\return true if converged
+        template<typename VectorStateType>
+        bool solve(VectorStateType &densities);
+
+        //! pseudo-transient continuation from densities then Newton iterations,
+        //! for first guesses too far for Newton alone
+        //!\return true if converged
+        template<typename VectorStateType>
+        bool solve_pseudo_transient(VectorStateType &densities);
+
+        //!\return number of Newton iterations of the last solve
+        unsigned int n_iterations() const;
+
+        //!\return number of pseudo time steps (linear solves) of the last solve
+        unsigned int n_pseudo_steps() const;
+
+        //!\return number of Jacobians assembled in the Newton iterations of the last solve
+        unsigned int n_jacobians() const;
+
+        //!\return number of factorizations in the Newton iterations of the last solve
+        unsigned int n_factorizations() const;
+
+        //!\return number of Newton iterations of the last solve on older factors
+        unsigned int n_factorizations_saved() const;
+
+        //!\return number of photolysis column updates of the last solve, photolysis frozen
+        unsigned int n_column_updates() const;
+
+        //!\return scaled residual norm at the end of the last solve
+        const CoeffType residual_norm() const;
+
+        //!\return scaled residual norm after each accepted step of the last solve, first guess included
+        const VectorCoeffType &residual_history() const;
+
+        //!\return pseudo time step of each accepted pseudo time step of the last solve
+        const VectorCoeffType &time_step_history() const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::ColumnSolver(Physics &helper):
+    _helper(helper),
+    _n_species(helper.diffusion_terms().size()),
+    _top_area(0.L),
+    _rel_tol(1e-6L),
+    _abs_tol(1e-10L),
+    _max_iterations(100),
+    _min_damping(1e-4L),
+    _log_formulation(false),
+    _log_floor(1e-60L),
+    _max_log_step(4.6L), // two decades
+    _initial_time_step(1e-2L),
+    _newton_time_step(1e12L),
+    _max_time_step_growth(10.L),
+    _max_residual_growth(10.L),
+    _max_pseudo_steps(500),
+    _max_reuse(1),
+    _max_rate(0.5L),
+    _freeze_photolysis(false),
+    _n_iterations(0),
+    _n_pseudo_steps(0),
+    _n_jacobians(0),
+    _n_factorizations(0),
+    _n_factorizations_saved(0),
+    _n_column_updates(0),
+    _residual_norm(0.L),
+    _linear(NULL)
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::~ColumnSolver()
+  {
+    if(_linear)delete _linear;
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_altitudes(const VectorStateType &altitudes)
+  {
+    antioch_assert_greater(altitudes.size(),1);
+
+    const unsigned int n_nodes = altitudes.size();
+    _altitudes.resize(n_nodes);
+    for(unsigned int i = 0; i < n_nodes; i++)_altitudes[i] = altitudes[i];
+    std::sort(_altitudes.begin(),_altitudes.end());
+
+    _helper.set_altitude_grid(_altitudes);
+
+    const CoeffType radius = Constants::Titan::radius<CoeffType>();
+    _areas.resize(n_nodes - 1);
+    _volumes.resize(n_nodes,0.L);
+    CoeffType r_low = radius + _altitudes[0];
+    for(unsigned int i = 0; i < n_nodes; i++)
+    {
+      const CoeffType r_high = (i + 1 < n_nodes)?radius + (_altitudes[i] + _altitudes[i + 1]) / CoeffType(2.L):
+                                                 radius + _altitudes[i];
+      _volumes[i] = (r_high * r_high * r_high - r_low * r_low * r_low) / CoeffType(3.L);
+      if(i + 1 < n_nodes)_areas[i] = r_high * r_high;
+      r_low = r_high;
+    }
+    _top_area = (radius + _altitudes.back()) * (radius + _altitudes.back());
+
+// Jeans flux is linear in the concentration
+    VectorCoeffType ones(_n_species,1.L);
+    _escape_velocities.resize(_n_species,0.L);
+    _helper.upper_boundary_neumann(_escape_velocities,ones);
+
+    if(_linear)delete _linear;
+    _linear = new BlockTridiagonalSolver<CoeffType>(n_nodes,_n_species);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_tolerances(const CoeffType &rel_tol, const CoeffType &abs_tol)
+  {
+    _rel_tol = rel_tol;
+    _abs_tol = abs_tol;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_max_iterations(unsigned int max_iterations)
+  {
+    _max_iterations = max_iterations;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_min_damping(const CoeffType &min_damping)
+  {
+    _min_damping = min_damping;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_log_formulation(bool log_formulation, const CoeffType &floor,
+                                                                                    const CoeffType &max_log_step)
+  {
+    _log_formulation = log_formulation;
+    _log_floor       = floor;
+    _max_log_step    = max_log_step;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_pseudo_transient(const CoeffType &initial_time_step, const CoeffType &newton_time_step,
+                                                                                     unsigned int max_pseudo_steps)
+  {
+    antioch_assert_greater(initial_time_step,0.L);
+    _initial_time_step = initial_time_step;
+    _newton_time_step  = newton_time_step;
+    _max_pseudo_steps  = max_pseudo_steps;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_pseudo_transient_limits(const CoeffType &max_time_step_growth, const CoeffType &max_residual_growth)
+  {
+    antioch_assert_greater(max_time_step_growth,1.L);
+    antioch_assert_greater(max_residual_growth,1.L);
+    _max_time_step_growth = max_time_step_growth;
+    _max_residual_growth  = max_residual_growth;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_iterations() const
+  {
+    return _n_iterations;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_jacobian_reuse(unsigned int max_reuse, const CoeffType &max_rate)
+  {
+    antioch_assert_greater(max_reuse,0);
+    _max_reuse = max_reuse;
+    _max_rate  = max_rate;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_freeze_photolysis(bool freeze)
+  {
+    _freeze_photolysis = freeze;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_pseudo_steps() const
+  {
+    return _n_pseudo_steps;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_jacobians() const
+  {
+    return _n_jacobians;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_factorizations() const
+  {
+    return _n_factorizations;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_factorizations_saved() const
+  {
+    return _n_factorizations_saved;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_column_updates() const
+  {
+    return _n_column_updates;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  const VectorCoeffType &ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::residual_history() const
+  {
+    return _residual_history;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  const VectorCoeffType &ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::time_step_history() const
+  {
+    return _time_step_history;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  const CoeffType ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::residual_norm() const
+  {
+    return _residual_norm;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::first_guess(VectorStateType &densities) const
+  {
+    densities.resize(_altitudes.size() * _n_species);
+    VectorCoeffType node(_n_species,0.L);
+    for(unsigned int i = 0; i < _altitudes.size(); i++)
+    {
+      _helper.first_guess(node,_altitudes[i],i);
+      for(unsigned int s = 0; s < _n_species; s++)densities[i * _n_species + s] = node[s];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::residual(const VectorStateType &densities, VectorStateType &residual)
+  {
+    this->assemble(densities,residual,false);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::residual_and_jacobian(const VectorStateType &densities, VectorStateType &residual,
+                                                                                      BlockTridiagonalSolver<CoeffType> &jacobian)
+  {
+    this->assemble(densities,residual,true);
+    this->copy_jacobian(jacobian);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::log_residual(const VectorStateType &densities, VectorStateType &residual)
+  {
+    this->assemble(densities,residual,false);
+    this->log_dirichlet(densities,residual);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::log_residual_and_jacobian(const VectorStateType &densities, VectorStateType &residual,
+                                                                                                  BlockTridiagonalSolver<CoeffType> &jacobian)
+  {
+    this->assemble(densities,residual,true);
+    this->to_log_variables(densities,residual);
+    this->copy_jacobian(jacobian);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::copy_jacobian(BlockTridiagonalSolver<CoeffType> &jacobian) const
+  {
+    antioch_assert_equal_to(jacobian.n_blocks(),_altitudes.size());
+    antioch_assert_equal_to(jacobian.block_size(),_n_species);
+
+    for(unsigned int i = 0; i < _altitudes.size(); i++)
+    {
+      jacobian.lower(i)    = _linear->lower(i);
+      jacobian.diagonal(i) = _linear->diagonal(i);
+      jacobian.upper(i)    = _linear->upper(i);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  unsigned int ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::n_species() const
+  {
+    return _n_species;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  inline
+  const VectorCoeffType &ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::volumes() const
+  {
+    return _volumes;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::assemble(const VectorStateType &densities, VectorStateType &residual, bool jacobian)
+  {
+    antioch_assert(_linear);
+    const unsigned int n_nodes = _altitudes.size();
+    antioch_assert_equal_to(densities.size(),n_nodes * _n_species);
+
+    residual.resize(n_nodes * _n_species);
+    std::fill(residual.begin(),residual.end(),0.L);
+    if(jacobian)_linear->zero();
+
+    VectorCoeffType n_node(_n_species,0.L);
+    VectorCoeffType n_face(_n_species,0.L);
+    VectorCoeffType dn_face(_n_species,0.L);
+    VectorCoeffType omegas, domegas_ddn, omegas_dots;
+    MatrixCoeffType domegas_dn, domegas_dots_dn;
+
+// chemistry, every node to keep the column cache complete, derivatives
+// only for a Jacobian
+    for(unsigned int i = 0; i < n_nodes; i++)
+    {
+      for(unsigned int s = 0; s < _n_species; s++)n_node[s] = densities[i * _n_species + s];
+      if(jacobian)
+      {
+        _helper.chemical_and_derivs(n_node,_altitudes[i],i,omegas_dots,domegas_dots_dn);
+      }else
+      {
+        _helper.chemical(n_node,_altitudes[i],i,omegas_dots);
+      }
+      if(i == 0)continue;
+      for(unsigned int s = 0; s < _n_species; s++)
+      {
+        residual[i * _n_species + s] -= _volumes[i] * omegas_dots[s];
+        if(!jacobian)continue;
+        for(unsigned int j = 0; j < _n_species; j++)_linear->diagonal(i)(s,j) -= _volumes[i] * domegas_dots_dn[s][j];
+      }
+    }
+
+// fluxes through the inner faces, Phi = n omega
+    for(unsigned int i = 0; i + 1 < n_nodes; i++)
+    {
+      const CoeffType dz = _altitudes[i + 1] - _altitudes[i];
+      const CoeffType z  = (_altitudes[i + 1] + _altitudes[i]) / CoeffType(2.L);
+      for(unsigned int s = 0; s < _n_species; s++)
+      {
+        n_face[s]  = (densities[(i + 1) * _n_species + s] + densities[i * _n_species + s]) / CoeffType(2.L);
+        dn_face[s] = (densities[(i + 1) * _n_species + s] - densities[i * _n_species + s]) / dz;
+      }
+      if(jacobian)
+      {
+        _helper.diffusion_and_derivs(n_face,dn_face,z,omegas,domegas_dn,domegas_ddn);
+      }else
+      {
+        _helper.diffusion(n_face,dn_face,z,omegas);
+      }
+
+      for(unsigned int s = 0; s < _n_species; s++)
+      {
+        const CoeffType flux = _areas[i] * n_face[s] * omegas[s];
+        if(i > 0)residual[i * _n_species + s] += flux;
+        residual[(i + 1) * _n_species + s]    -= flux;
+        if(!jacobian)continue;
+
+        for(unsigned int j = 0; j < _n_species; j++)
+        {
+          // dPhi_s/dn_{i,j} and dPhi_s/dn_{i+1,j}
+          CoeffType dflux_low  = n_face[s] * domegas_dn[s][j] / CoeffType(2.L);
+          CoeffType dflux_high = dflux_low;
+          if(j == s)
+          {
+            dflux_low  += omegas[s] / CoeffType(2.L) - n_face[s] * domegas_ddn[s] / dz;
+            dflux_high += omegas[s] / CoeffType(2.L) + n_face[s] * domegas_ddn[s] / dz;
+          }
+          dflux_low  *= _areas[i];
+          dflux_high *= _areas[i];
+
+          if(i > 0)
+          {
+            _linear->diagonal(i)(s,j) += dflux_low;
+            _linear->upper(i)(s,j)    += dflux_high;
+          }
+          _linear->lower(i + 1)(s,j)    -= dflux_low;
+          _linear->diagonal(i + 1)(s,j) -= dflux_high;
+        }
+      }
+    }
+
+// top, Jeans escape
+    const unsigned int top = n_nodes - 1;
+    for(unsigned int s = 0; s < _n_species; s++)
+    {
+      residual[top * _n_species + s] += _top_area * _escape_velocities[s] * densities[top * _n_species + s];
+      if(jacobian)_linear->diagonal(top)(s,s) += _top_area * _escape_velocities[s];
+    }
+
+// bottom, Dirichlet
+    VectorCoeffType lower_boundary(_n_species,0.L);
+    _helper.lower_boundary_dirichlet(lower_boundary);
+    for(unsigned int s = 0; s < _n_species; s++)
+    {
+      residual[s] = densities[s] - lower_boundary[s];
+      if(jacobian)_linear->diagonal(0)(s,s) = CoeffType(1.L);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  const CoeffType ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::scaled_norm(const VectorStateType &densities, const VectorStateType &residual) const
+  {
+    CoeffType norm(0.L);
+    for(unsigned int i = 0; i < _altitudes.size(); i++)
+    {
+      const CoeffType volume = (i == 0)?CoeffType(1.L):_volumes[i];
+      for(unsigned int s = 0; s < _n_species; s++)
+      {
+        const CoeffType r = residual[i * _n_species + s] / (volume * (std::abs(densities[i * _n_species + s]) + _abs_tol));
+        norm += r * r;
+      }
+    }
+    return std::sqrt(norm / CoeffType(residual.size()));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::to_log_variables(const VectorStateType &densities, VectorStateType &residual)
+  {
+    const unsigned int n_nodes = _altitudes.size();
+
+// dR/dln(n_j) = dR/dn_j n_j, column scaling of the blocks
+    for(unsigned int i = 0; i < n_nodes; i++)
+    {
+      for(unsigned int j = 0; j < _n_species; j++)
+      {
+        _linear->diagonal(i).col(j) *= densities[i * _n_species + j];
+        if(i > 0)          _linear->lower(i).col(j) *= densities[(i - 1) * _n_species + j];
+        if(i + 1 < n_nodes)_linear->upper(i).col(j) *= densities[(i + 1) * _n_species + j];
+      }
+    }
+
+    _linear->diagonal(0).setIdentity();
+    _linear->upper(0).setZero();
+    this->log_dirichlet(densities,residual);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::log_dirichlet(const VectorStateType &densities, VectorStateType &residual) const
+  {
+    VectorCoeffType lower_boundary(_n_species,0.L);
+    _helper.lower_boundary_dirichlet(lower_boundary);
+    for(unsigned int s = 0; s < _n_species; s++)
+    {
+      residual[s] = std::log(std::max(densities[s],_log_floor)) - std::log(std::max(lower_boundary[s],_log_floor));
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  const CoeffType ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::rms(const VectorStateType &x) const
+  {
+    CoeffType norm(0.L);
+    for(unsigned int k = 0; k < x.size(); k++)norm += x[k] * x[k];
+    return std::sqrt(norm / CoeffType(x.size()));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  const CoeffType ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::limit_step(const VectorStateType &densities, VectorStateType &update) const
+  {
+    CoeffType damping(1.L);
+    if(_log_formulation)
+    {
+// no more than _max_log_step in ln(n) (decades ln(10)), unknown by unknown:
+// a trace species far from its solution does not hold back the others
+      for(unsigned int k = 0; k < densities.size(); k++)
+      {
+        update[k] = std::max(std::min(update[k],_max_log_step),- _max_log_step);
+      }
+    }else
+    {
+// positivity
+      for(unsigned int k = 0; k < densities.size(); k++)
+      {
+        if(densities[k] + update[k] < 0.L && update[k] < 0.L)
+                damping = std::min(damping,CoeffType(0.9L) * densities[k] / (- update[k]));
+      }
+    }
+    return std::max(damping,_min_damping);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::take_step(const VectorStateType &densities, const VectorStateType &update,
+                                                                          const CoeffType &damping, VectorStateType &trial) const
+  {
+    trial.resize(densities.size());
+    for(unsigned int k = 0; k < densities.size(); k++)
+    {
+      trial[k] = (_log_formulation)?densities[k] * std::exp(damping * update[k]):
+                                    std::max(densities[k] + damping * update[k],CoeffType(0.L));
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  const CoeffType ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::update_norm(const VectorStateType &densities, const VectorStateType &trial) const
+  {
+    CoeffType norm(0.L);
+    for(unsigned int k = 0; k < densities.size(); k++)
+    {
+      norm = std::max(norm,std::abs(trial[k] - densities[k]) / (_rel_tol * std::abs(densities[k]) + _abs_tol));
+    }
+    return norm;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::add_pseudo_time(const VectorStateType &densities, const CoeffType &inverse_time_step)
+  {
+// V_i dn/dtau, V_i n dln(n)/dtau in ln(n), none on the Dirichlet rows
+    for(unsigned int i = 1; i < _altitudes.size(); i++)
+    {
+      for(unsigned int s = 0; s < _n_species; s++)
+      {
+        CoeffType mass = _volumes[i] * inverse_time_step;
+        if(_log_formulation)mass *= densities[i * _n_species + s];
+        _linear->diagonal(i)(s,s) += mass;
+      }
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::set_rhs(const VectorStateType &residual)
+  {
+    for(unsigned int i = 0; i < _altitudes.size(); i++)
+    {
+      for(unsigned int s = 0; s < _n_species; s++)_linear->rhs(i)(s) = - residual[i * _n_species + s];
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  void ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::start(VectorStateType &densities)
+  {
+    antioch_assert(_linear);
+    antioch_assert_equal_to(densities.size(),_altitudes.size() * _n_species);
+
+// log unknowns need positive densities
+    if(_log_formulation)
+    {
+      for(unsigned int k = 0; k < densities.size(); k++)densities[k] = std::max(densities[k],_log_floor);
+    }
+
+    _n_iterations = 0;
+    _n_pseudo_steps = 0;
+    _n_jacobians = 0;
+    _n_factorizations = 0;
+    _n_factorizations_saved = 0;
+    _n_column_updates = 0;
+    _residual_history.clear();
+    _time_step_history.clear();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  bool ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::solve(VectorStateType &densities)
+  {
+    this->start(densities);
+    return this->newton(densities);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  bool ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::newton(VectorStateType &densities)
+  {
+    VectorStateType residual, trial_residual, trial, update, simplified_update;
+
+    const bool frozen = _helper.column_frozen();
+    if(_freeze_photolysis)
+    {
+      _helper.freeze_column(true);
+      _helper.update_column(densities);
+      _n_column_updates++;
+    }
+
+    this->assemble(densities,residual,true);
+    _n_jacobians++;
+    _residual_norm = this->scaled_norm(densities,residual);
+    _residual_history.push_back(_residual_norm);
+
+    bool converged(false);
+    bool fresh(true);
+    unsigned int age(0);
+    CoeffType previous_newton_norm(0.L);
+    unsigned int n_newton(0);
+    while(n_newton < _max_iterations)
+    {
+      n_newton++;
+      _n_iterations++;
+
+// modified Newton: the factors of an older Jacobian
+      if(fresh)
+      {
+        if(_log_formulation)this->to_log_variables(densities,residual);
+        this->set_rhs(residual);
+        _linear->solve(update);
+        _n_factorizations++;
+        age = 0;
+      }else
+      {
+        if(_log_formulation)this->log_dirichlet(densities,residual);
+        this->set_rhs(residual);
+        _linear->back_solve(update);
+        _n_factorizations_saved++;
+      }
+      age++;
+
+      const CoeffType newton_norm = this->rms(update);
+      CoeffType damping = this->limit_step(densities,update);
+      const CoeffType step_norm = this->rms(update);
+
+// line search, on the scaled residual in n, on the Newton correction in ln(n):
+// the simplified correction -J^{-1} R(trial), with the same factors, must
+// decrease by a quarter of the step taken (natural monotonicity test)
+      bool accepted(false);
+      CoeffType trial_norm(0.L);
+      while(true)
+      {
+        this->take_step(densities,update,damping,trial);
+        this->assemble(trial,trial_residual,false);
+        trial_norm = this->scaled_norm(trial,trial_residual);
+        if(this->update_norm(densities,trial) <= CoeffType(1.L))
+        {
+          accepted = true; // within the tolerances, below what the tests can tell
+        }else if(_log_formulation)
+        {
+          this->log_dirichlet(trial,trial_residual);
+          this->set_rhs(trial_residual);
+          _linear->back_solve(simplified_update);
+          const CoeffType simplified_norm = this->rms(simplified_update);
+          accepted = (simplified_norm == simplified_norm && // NaN
+                      simplified_norm <= newton_norm - damping * step_norm / CoeffType(4.L));
+        }else
+        {
+          accepted = (trial_norm == trial_norm && // NaN
+                      trial_norm <= (CoeffType(1.L) - CoeffType(1e-4L) * damping) * _residual_norm);
+        }
+        if(accepted)break;
+        if(damping / CoeffType(2.L) < _min_damping)break;
+        damping /= CoeffType(2.L);
+      }
+
+// line search failure: older factors are replaced by a Jacobian at the
+// same densities, on a fresh Jacobian Newton has failed
+      if(!accepted)
+      {
+        if(fresh)break;
+        if(_freeze_photolysis)
+        {
+          _helper.update_column(densities);
+          _n_column_updates++;
+        }
+        this->assemble(densities,residual,true);
+        _n_jacobians++;
+        fresh = true;
+        continue;
+      }
+
+      const CoeffType correction = this->update_norm(densities,trial);
+      if(!(correction == correction))break; // NaN
+
+// contraction of the Newton correction in ln(n), of the residual in n
+      const CoeffType rate = (_log_formulation)?newton_norm / previous_newton_norm:trial_norm / _residual_norm;
+      previous_newton_norm = newton_norm;
+      const bool refresh = (age >= _max_reuse || (!fresh && !(rate <= _max_rate)));
+
+      densities = trial;
+      if(refresh && _freeze_photolysis)
+      {
+        _helper.update_column(densities);
+        _n_column_updates++;
+      }
+      this->assemble(densities,residual,refresh);
+      if(refresh)_n_jacobians++;
+      _residual_norm = this->scaled_norm(densities,residual);
+      _residual_history.push_back(_residual_norm);
+      fresh = refresh;
+
+      if(correction <= CoeffType(1.L))
+      {
+        converged = true;
+        break;
+      }
+    }
+
+    _helper.freeze_column(frozen);
+
+    return converged;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType, typename MatrixCoeffType, typename Physics>
+  template<typename VectorStateType>
+  inline
+  bool ColumnSolver<CoeffType,VectorCoeffType,MatrixCoeffType,Physics>::solve_pseudo_transient(VectorStateType &densities)
+  {
+    this->start(densities);
+
+    VectorStateType residual, trial_residual, trial, update;
+
+    this->assemble(densities,residual,true);
+    _residual_norm = this->scaled_norm(densities,residual);
+    _residual_history.push_back(_residual_norm);
+
+    CoeffType time_step = _initial_time_step;
+    while(time_step < _newton_time_step)
+    {
+      if(_n_pseudo_steps >= _max_pseudo_steps)return false;
+
+      if(_log_formulation)this->to_log_variables(densities,residual);
+      this->add_pseudo_time(densities,CoeffType(1.L) / time_step);
+      this->set_rhs(residual);
+
+// no line search: the pseudo time step is the globalization, a step
+// blowing up the residual is taken again with a smaller time step
+      CoeffType trial_norm(0.L);
+      while(true)
+      {
+        _n_pseudo_steps++;
+        _linear->solve(update);
+        const CoeffType damping = this->limit_step(densities,update);
+        this->take_step(densities,update,damping,trial);
+        this->assemble(trial,trial_residual,false);
+        trial_norm = this->scaled_norm(trial,trial_residual);
+
+        if(trial_norm == trial_norm && // NaN
+           trial_norm <= _max_residual_growth * _residual_norm)break;
+
+        if(_n_pseudo_steps >= _max_pseudo_steps)return false;
+        this->add_pseudo_time(densities,CoeffType(3.L) / time_step); // 1/dtau -> 4/dtau
+        time_step /= CoeffType(4.L);
+      }
+      _time_step_history.push_back(time_step);
+
+// switched evolution relaxation: dtau grows as the residual falls
+      const CoeffType ratio = (trial_norm > 0.L)?_residual_norm / trial_norm:_max_time_step_growth;
+      time_step *= std::min(ratio,_max_time_step_growth);
+
+      densities = trial;
+      this->assemble(densities,residual,true);
+      _residual_norm = this->scaled_norm(densities,residual);
+      _residual_history.push_back(_residual_norm);
+    }
+
+    return this->newton(densities);
+  }
+
+}
+
+#endif
@@ -29,6 +29,8 @@
 
 //Planet
 #include "planet/math_functions.h"
+#include "planet/interpolation_grid.h"
+#include "planet/monotone_cubic_interpolation.h"
 
 //C++
 
@@ -48,6 +50,34 @@ namespace Planet
         VectorCoeffType _electronic_altitude;
         VectorCoeffType _electronic_temperature;
 
+        //! interval lookups
+        InterpolationGrid<CoeffType,VectorCoeffType> _neutral_grid;
+        InterpolationGrid<CoeffType,VectorCoeffType> _ionic_grid;
+
+        //! monotone cubic tables, NULL when linear
+        MonotoneCubicInterpolation<CoeffType,VectorCoeffType> *_neutral_cubic;
+        MonotoneCubicInterpolation<CoeffType,VectorCoeffType> *_ionic_cubic;
+        MonotoneCubicInterpolation<CoeffType,VectorCoeffType> *_electronic_cubic;
+
+        //! incremented at every change of the profiles
+        unsigned int _version;
+
+        //! (re)computes the cubic tables from the profiles
+        void build_cubic();
+        void clear_cubic();
+
+        //! linear value and slope of the interval, one lookup from hint
+        template<typename StateType>
+        void linear_and_dz(const InterpolationGrid<CoeffType,VectorCoeffType> &grid, const VectorCoeffType &data,
+                           const StateType &z, CoeffType &T, CoeffType &dT_dz, unsigned int &hint) const;
+
+        //! profile and derivative at all the altitudes, the lookup
+        //! of each altitude starts from the interval of the previous one
+        template<typename VectorStateType>
+        void profile_and_dz(const MonotoneCubicInterpolation<CoeffType,VectorCoeffType> *cubic,
+                            const InterpolationGrid<CoeffType,VectorCoeffType> &grid, const VectorCoeffType &data,
+                            const VectorStateType &z, VectorCoeffType &T, VectorCoeffType &dT_dz) const;
+
       public:
         AtmosphericTemperature(const VectorCoeffType &neu, const VectorCoeffType &ion, const VectorCoeffType &alt_neu, const VectorCoeffType &alt_ion);
         ~AtmosphericTemperature();
@@ -108,12 +138,54 @@ namespace Planet
         template<typename StateType>
         const CoeffType delectronic_temperature_dz(const StateType &z) const;
 
+        //! temperature and derivative at an altitude, one lookup
+        template<typename StateType>
+        void neutral_temperature_and_dz(const StateType &z, CoeffType &T, CoeffType &dT_dz) const;
+
+        //! temperature and derivative at an altitude, one lookup
+        template<typename StateType>
+        void ionic_temperature_and_dz(const StateType &z, CoeffType &T, CoeffType &dT_dz) const;
+
+        //! temperature and derivative at an altitude, one lookup
+        template<typename StateType>
+        void electronic_temperature_and_dz(const StateType &z, CoeffType &T, CoeffType &dT_dz) const;
+
+        //! temperatures and derivatives at sorted altitudes (increasing or decreasing),
+        //! e.g. the quadrature points of an element or a column: one pass over
+        //! the profile, T and dT_dz resized to z.size()
+        template<typename VectorStateType>
+        void neutral_temperature_and_dz(const VectorStateType &z, VectorCoeffType &T, VectorCoeffType &dT_dz) const;
+
+        //! temperatures and derivatives at sorted altitudes, one pass over the profile
+        template<typename VectorStateType>
+        void ionic_temperature_and_dz(const VectorStateType &z, VectorCoeffType &T, VectorCoeffType &dT_dz) const;
+
+        //! temperatures and derivatives at sorted altitudes, one pass over the profile
+        template<typename VectorStateType>
+        void electronic_temperature_and_dz(const VectorStateType &z, VectorCoeffType &T, VectorCoeffType &dT_dz) const;
+
+        //! monotone cubic (PCHIP) interpolation of the profiles instead of
+        //! the linear one: continuous derivatives, no overshoot
+        void set_monotone_cubic(bool cubic);
+
+        //!\return true if the profiles are monotone cubic
+        bool monotone_cubic() const;
+
+        //!\return number of changes of the profiles, tables built on them compare it
+        unsigned int version() const;
+
+        //! profiles resampled on altitudes, typically the solver grid,
+        //! with the current interpolation (values and slopes if cubic)
+        template<typename VectorStateType>
+        void resample(const VectorStateType &altitudes);
+
   };
 
   template<typename CoeffType, typename VectorCoeffType>
   inline
   AtmosphericTemperature<CoeffType,VectorCoeffType>::~AtmosphericTemperature()
   {
+    this->clear_cubic();
     return;
   }
 
@@ -126,7 +198,13 @@ namespace Planet
       _neutral_altitude(alt_neu),
       _neutral_temperature(neu),
       _ionic_altitude(alt_ion),
-      _ionic_temperature(ion)
+      _ionic_temperature(ion),
+      _neutral_grid(alt_neu),
+      _ionic_grid(alt_ion),
+      _neutral_cubic(NULL),
+      _ionic_cubic(NULL),
+      _electronic_cubic(NULL),
+      _version(0)
   {
     _electronic_altitude = _neutral_altitude;
     _electronic_temperature.resize(_electronic_altitude.size());
@@ -200,7 +278,8 @@ namespace Planet
   inline
   const CoeffType AtmosphericTemperature<CoeffType,VectorCoeffType>::ionic_temperature(const StateType &z) const
   {
-    return Functions::linear_evaluation(_ionic_altitude,_ionic_temperature,z);
+    if(_ionic_cubic)return _ionic_cubic->evaluation(z);
+    return _ionic_grid.linear_evaluation(_ionic_temperature,z);
   }
 
   template<typename CoeffType, typename VectorCoeffType>
@@ -208,7 +287,8 @@ namespace Planet
   inline
   const CoeffType AtmosphericTemperature<CoeffType,VectorCoeffType>::neutral_temperature(const StateType &z) const
   {
-    return Functions::linear_evaluation(_neutral_altitude,_neutral_temperature,z);
+    if(_neutral_cubic)return _neutral_cubic->evaluation(z);
+    return _neutral_grid.linear_evaluation(_neutral_temperature,z);
   }
 
   template<typename CoeffType, typename VectorCoeffType>
@@ -216,7 +296,8 @@ namespace Planet
   inline
   const CoeffType AtmosphericTemperature<CoeffType,VectorCoeffType>::electronic_temperature(const StateType &z) const
   {
-    return Functions::linear_evaluation(_electronic_altitude,_electronic_temperature,z);
+    if(_electronic_cubic)return _electronic_cubic->evaluation(z);
+    return _neutral_grid.linear_evaluation(_electronic_temperature,z); // electronic on the neutral altitudes
   }
 
 
@@ -226,6 +307,8 @@ namespace Planet
   void AtmosphericTemperature<CoeffType,VectorCoeffType>::set_neutral_temperature(const VectorStateType &neu)
   {
      _neutral_temperature = neu;
+     if(this->monotone_cubic())this->build_cubic();
+     _version++;
   }
 
   template<typename CoeffType, typename VectorCoeffType>
@@ -234,6 +317,8 @@ namespace Planet
   void AtmosphericTemperature<CoeffType,VectorCoeffType>::set_ionic_temperature(const VectorStateType &ion)
   {
      _ionic_temperature = ion;
+     if(this->monotone_cubic())this->build_cubic();
+     _version++;
   }
 
   template<typename CoeffType, typename VectorCoeffType>
@@ -242,6 +327,8 @@ namespace Planet
   void AtmosphericTemperature<CoeffType,VectorCoeffType>::set_electronic_temperature(const VectorStateType &electron)
   {
      _electronic_temperature = electron;
+     if(this->monotone_cubic())this->build_cubic();
+     _version++;
   }
 
   template<typename CoeffType, typename VectorCoeffType>
@@ -249,6 +336,7 @@ namespace Planet
   inline
   const CoeffType AtmosphericTemperature<CoeffType,VectorCoeffType>::dneutral_temperature_dz(const StateType &z) const
   {
+     if(_neutral_cubic)return _neutral_cubic->evaluation_dz(z);
      return Functions::linear_evaluation_dz(_neutral_altitude,_neutral_temperature,z);
   }
 
@@ -257,6 +345,7 @@ namespace Planet
   inline
   const CoeffType AtmosphericTemperature<CoeffType,VectorCoeffType>::dionic_temperature_dz(const StateType &z) const
   {
+     if(_ionic_cubic)return _ionic_cubic->evaluation_dz(z);
      return Functions::linear_evaluation_dz(_ionic_altitude,_ionic_temperature,z);
   }
 
@@ -265,9 +354,210 @@ namespace Planet
   inline
   const CoeffType AtmosphericTemperature<CoeffType,VectorCoeffType>::delectronic_temperature_dz(const StateType &z) const
   {
+     if(_electronic_cubic)return _electronic_cubic->evaluation_dz(z);
      return Functions::linear_evaluation_dz(_electronic_altitude,_electronic_temperature,z);
   }
 
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::linear_and_dz(const InterpolationGrid<CoeffType,VectorCoeffType> &grid,
+                                                                        const VectorCoeffType &data, const StateType &z,
+                                                                        CoeffType &T, CoeffType &dT_dz, unsigned int &hint) const
+  {
+     const unsigned int iz = grid.floor_index(z,hint);
+     T = grid.linear_evaluation(data,z,hint);
+     dT_dz = (data[iz + 1] - data[iz]) / (grid.abscissa()[iz + 1] - grid.abscissa()[iz]);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::profile_and_dz(const MonotoneCubicInterpolation<CoeffType,VectorCoeffType> *cubic,
+                                                                         const InterpolationGrid<CoeffType,VectorCoeffType> &grid,
+                                                                         const VectorCoeffType &data, const VectorStateType &z,
+                                                                         VectorCoeffType &T, VectorCoeffType &dT_dz) const
+  {
+     T.resize(z.size());
+     dT_dz.resize(z.size());
+
+     unsigned int hint = grid.size();
+     CoeffType Tz, dTz;
+     for(unsigned int i = 0; i < z.size(); i++)
+     {
+       if(cubic)
+       {
+         cubic->evaluation_and_dz(z[i],Tz,dTz,hint);
+       }else
+       {
+         this->linear_and_dz(grid,data,z[i],Tz,dTz,hint);
+       }
+       T[i]     = Tz;
+       dT_dz[i] = dTz;
+     }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::neutral_temperature_and_dz(const StateType &z, CoeffType &T, CoeffType &dT_dz) const
+  {
+     if(_neutral_cubic)
+     {
+       _neutral_cubic->evaluation_and_dz(z,T,dT_dz);
+     }else
+     {
+       unsigned int hint = _neutral_grid.size();
+       this->linear_and_dz(_neutral_grid,_neutral_temperature,z,T,dT_dz,hint);
+     }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::ionic_temperature_and_dz(const StateType &z, CoeffType &T, CoeffType &dT_dz) const
+  {
+     if(_ionic_cubic)
+     {
+       _ionic_cubic->evaluation_and_dz(z,T,dT_dz);
+     }else
+     {
+       unsigned int hint = _ionic_grid.size();
+       this->linear_and_dz(_ionic_grid,_ionic_temperature,z,T,dT_dz,hint);
+     }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::electronic_temperature_and_dz(const StateType &z, CoeffType &T, CoeffType &dT_dz) const
+  {
+     if(_electronic_cubic)
+     {
+       _electronic_cubic->evaluation_and_dz(z,T,dT_dz);
+     }else
+     {
+       unsigned int hint = _neutral_grid.size();
+       this->linear_and_dz(_neutral_grid,_electronic_temperature,z,T,dT_dz,hint); // electronic on the neutral altitudes
+     }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::neutral_temperature_and_dz(const VectorStateType &z, VectorCoeffType &T,
+                                                                                     VectorCoeffType &dT_dz) const
+  {
+     this->profile_and_dz(_neutral_cubic,_neutral_grid,_neutral_temperature,z,T,dT_dz);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::ionic_temperature_and_dz(const VectorStateType &z, VectorCoeffType &T,
+                                                                                   VectorCoeffType &dT_dz) const
+  {
+     this->profile_and_dz(_ionic_cubic,_ionic_grid,_ionic_temperature,z,T,dT_dz);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::electronic_temperature_and_dz(const VectorStateType &z, VectorCoeffType &T,
+                                                                                        VectorCoeffType &dT_dz) const
+  {
+     this->profile_and_dz(_electronic_cubic,_neutral_grid,_electronic_temperature,z,T,dT_dz); // electronic on the neutral altitudes
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::clear_cubic()
+  {
+     delete _neutral_cubic;
+     delete _ionic_cubic;
+     delete _electronic_cubic;
+     _neutral_cubic    = NULL;
+     _ionic_cubic      = NULL;
+     _electronic_cubic = NULL;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::build_cubic()
+  {
+     this->clear_cubic();
+     _neutral_cubic    = new MonotoneCubicInterpolation<CoeffType,VectorCoeffType>(_neutral_altitude,_neutral_temperature);
+     _ionic_cubic      = new MonotoneCubicInterpolation<CoeffType,VectorCoeffType>(_ionic_altitude,_ionic_temperature);
+     _electronic_cubic = new MonotoneCubicInterpolation<CoeffType,VectorCoeffType>(_electronic_altitude,_electronic_temperature);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::set_monotone_cubic(bool cubic)
+  {
+     if(cubic)
+     {
+       this->build_cubic();
+     }else
+     {
+       this->clear_cubic();
+     }
+     _version++;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  bool AtmosphericTemperature<CoeffType,VectorCoeffType>::monotone_cubic() const
+  {
+     return (_neutral_cubic != NULL);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int AtmosphericTemperature<CoeffType,VectorCoeffType>::version() const
+  {
+     return _version;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename VectorStateType>
+  inline
+  void AtmosphericTemperature<CoeffType,VectorCoeffType>::resample(const VectorStateType &altitudes)
+  {
+     antioch_assert_greater(altitudes.size(),1);
+
+     VectorCoeffType alt(altitudes.size());
+     VectorCoeffType neu(altitudes.size()), dneu(altitudes.size());
+     VectorCoeffType ion(altitudes.size()), dion(altitudes.size());
+     VectorCoeffType ele(altitudes.size()), dele(altitudes.size());
+     for(unsigned int iz = 0; iz < altitudes.size(); iz++)
+     {
+        alt[iz] = altitudes[iz];
+        this->neutral_temperature_and_dz(alt[iz],neu[iz],dneu[iz]);
+        this->ionic_temperature_and_dz(alt[iz],ion[iz],dion[iz]);
+        this->electronic_temperature_and_dz(alt[iz],ele[iz],dele[iz]);
+     }
+
+     _neutral_altitude       = alt;
+     _neutral_temperature    = neu;
+     _ionic_altitude         = alt;
+     _ionic_temperature      = ion;
+     _electronic_altitude    = alt;
+     _electronic_temperature = ele;
+     _neutral_grid = InterpolationGrid<CoeffType,VectorCoeffType>(alt);
+     _ionic_grid   = InterpolationGrid<CoeffType,VectorCoeffType>(alt);
+
+// the cubic is kept on the new nodes with the slopes of the old one
+     if(this->monotone_cubic())
+     {
+       this->clear_cubic();
+       _neutral_cubic    = new MonotoneCubicInterpolation<CoeffType,VectorCoeffType>(alt,neu,dneu);
+       _ionic_cubic      = new MonotoneCubicInterpolation<CoeffType,VectorCoeffType>(alt,ion,dion);
+       _electronic_cubic = new MonotoneCubicInterpolation<CoeffType,VectorCoeffType>(alt,ele,dele);
+     }
+     _version++;
+  }
+
 }
 
 #endif
@@ -0,0 +1,343 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_CONTIGUOUS_MATRIX_H
+#define PLANET_CONTIGUOUS_MATRIX_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+
+//C++
+#include <vector>
+#include <algorithm>
+
+namespace Planet
+{
+  /*!\class ContiguousMatrix
+   *
+   * Row-major matrix in one allocation, to be used as MatrixCoeffType in
+   * place of std::vector<std::vector<CoeffType> >: the rows are views with
+   * the interface the evaluators use on a row (operator[], size, begin/end,
+   * resize, assign), m[i][j] is data()[i * n_cols() + j].
+   *
+   * All the rows have the same size: a row is resized only while the matrix
+   * has no columns or to the current size, resize_columns() changes them
+   * all and keeps the values of the common columns. Sizing a matrix row by row,
+   *
+   *   m.resize(n);
+   *   for(i < n) m[i].resize(p, 0);
+   *
+   * allocates once. data() maps directly on a row-major Eigen matrix.
+   */
+  template<typename CoeffType>
+  class ContiguousMatrix
+  {
+      private:
+        std::vector<CoeffType> _data;
+        unsigned int           _n_rows;
+        unsigned int           _n_cols;
+
+      public:
+
+        //! mutable row view, assigning to a row copies the values
+        class Row
+        {
+            private:
+              ContiguousMatrix<CoeffType> &_matrix;
+              unsigned int                 _row;
+
+            public:
+              Row(ContiguousMatrix<CoeffType> &matrix, unsigned int row):_matrix(matrix),_row(row){}
+
+              unsigned int size() const {return _matrix.n_cols();}
+              bool empty() const {return _matrix.n_cols() == 0;}
+
+              CoeffType       &operator[](unsigned int j)       {return _matrix.data()[_row * _matrix.n_cols() + j];}
+              const CoeffType &operator[](unsigned int j) const {return _matrix.data()[_row * _matrix.n_cols() + j];}
+
+              CoeffType       *begin()       {return _matrix.data() + _row * _matrix.n_cols();}
+              CoeffType       *end()         {return this->begin() + _matrix.n_cols();}
+              const CoeffType *begin() const {return _matrix.data() + _row * _matrix.n_cols();}
+              const CoeffType *end()   const {return this->begin() + _matrix.n_cols();}
+
+              //! sizes all the rows the first time, no change after
+              void resize(unsigned int n_cols, const CoeffType &value = CoeffType(0.L))
+              {
+                antioch_assert(_matrix.n_cols() == 0 || n_cols == _matrix.n_cols());
+                _matrix.resize_columns(n_cols,value);
+              }
+
+              //! sizes all the rows the first time, fills this one
+              void assign(unsigned int n_cols, const CoeffType &value)
+              {
+                antioch_assert(_matrix.n_cols() == 0 || n_cols == _matrix.n_cols());
+                _matrix.resize_columns(n_cols,value);
+                std::fill(this->begin(),this->end(),value);
+              }
+
+              Row &operator=(const Row &row)
+              {
+                antioch_assert_equal_to(row.size(),this->size());
+                std::copy(row.begin(),row.end(),this->begin());
+                return *this;
+              }
+
+              template<typename VectorStateType>
+              Row &operator=(const VectorStateType &row)
+              {
+                antioch_assert_equal_to(row.size(),this->size());
+                for(unsigned int j = 0; j < row.size(); j++)(*this)[j] = row[j];
+                return *this;
+              }
+        };
+
+        //! read only row view
+        class ConstRow
+        {
+            private:
+              const CoeffType *_begin;
+              unsigned int     _size;
+
+            public:
+              ConstRow(const CoeffType *begin, unsigned int size):_begin(begin),_size(size){}
+
+              unsigned int size() const {return _size;}
+              bool empty() const {return _size == 0;}
+
+              const CoeffType &operator[](unsigned int j) const {return _begin[j];}
+
+              const CoeffType *begin() const {return _begin;}
+              const CoeffType *end()   const {return _begin + _size;}
+        };
+
+        ContiguousMatrix();
+        ContiguousMatrix(unsigned int n_rows, unsigned int n_cols, const CoeffType &value = CoeffType(0.L));
+        ~ContiguousMatrix();
+
+        //!\return number of rows
+        unsigned int size() const;
+
+        //!\return true if no rows
+        bool empty() const;
+
+        //!\return number of rows
+        unsigned int n_rows() const;
+
+        //!\return number of columns
+        unsigned int n_cols() const;
+
+        //! number of rows, the new ones are zero
+        void resize(unsigned int n_rows);
+
+        //! number of rows, the new ones are copies of row
+        template<typename VectorStateType>
+        void resize(unsigned int n_rows, const VectorStateType &row);
+
+        //! number of columns, the values of the common columns are kept
+        void resize_columns(unsigned int n_cols, const CoeffType &value = CoeffType(0.L));
+
+        //! n_rows copies of row
+        template<typename VectorStateType>
+        void assign(unsigned int n_rows, const VectorStateType &row);
+
+        //! new last row, the number of columns is set by the first one
+        template<typename VectorStateType>
+        void push_back(const VectorStateType &row);
+
+        //! every coefficient set to value
+        void fill(const CoeffType &value);
+
+        //! no rows
+        void clear();
+
+        Row      operator[](unsigned int i);
+        ConstRow operator[](unsigned int i) const;
+
+        //! row-major storage
+        CoeffType       *data();
+        const CoeffType *data() const;
+  };
+
+  template<typename CoeffType>
+  inline
+  ContiguousMatrix<CoeffType>::ContiguousMatrix():
+    _n_rows(0),
+    _n_cols(0)
+  {
+    return;
+  }
+
+  template<typename CoeffType>
+  inline
+  ContiguousMatrix<CoeffType>::ContiguousMatrix(unsigned int n_rows, unsigned int n_cols, const CoeffType &value):
+    _data(n_rows * n_cols,value),
+    _n_rows(n_rows),
+    _n_cols(n_cols)
+  {
+    return;
+  }
+
+  template<typename CoeffType>
+  inline
+  ContiguousMatrix<CoeffType>::~ContiguousMatrix()
+  {
+    return;
+  }
+
+  template<typename CoeffType>
+  inline
+  unsigned int ContiguousMatrix<CoeffType>::size() const
+  {
+    return _n_rows;
+  }
+
+  template<typename CoeffType>
+  inline
+  bool ContiguousMatrix<CoeffType>::empty() const
+  {
+    return (_n_rows == 0);
+  }
+
+  template<typename CoeffType>
+  inline
+  unsigned int ContiguousMatrix<CoeffType>::n_rows() const
+  {
+    return _n_rows;
+  }
+
+  template<typename CoeffType>
+  inline
+  unsigned int ContiguousMatrix<CoeffType>::n_cols() const
+  {
+    return _n_cols;
+  }
+
+  template<typename CoeffType>
+  inline
+  void ContiguousMatrix<CoeffType>::resize(unsigned int n_rows)
+  {
+    _data.resize(n_rows * _n_cols,CoeffType(0.L));
+    _n_rows = n_rows;
+  }
+
+  template<typename CoeffType>
+  template<typename VectorStateType>
+  inline
+  void ContiguousMatrix<CoeffType>::resize(unsigned int n_rows, const VectorStateType &row)
+  {
+    const unsigned int first = _n_rows;
+    this->resize_columns(row.size());
+    this->resize(n_rows);
+    for(unsigned int i = first; i < n_rows; i++)(*this)[i] = row;
+  }
+
+  template<typename CoeffType>
+  inline
+  void ContiguousMatrix<CoeffType>::resize_columns(unsigned int n_cols, const CoeffType &value)
+  {
+    if(n_cols == _n_cols)return;
+
+    std::vector<CoeffType> data(_n_rows * n_cols,value);
+    const unsigned int common = std::min(n_cols,_n_cols);
+    for(unsigned int i = 0; i < _n_rows; i++)
+    {
+      std::copy(_data.begin() + i * _n_cols,_data.begin() + i * _n_cols + common,data.begin() + i * n_cols);
+    }
+    _data.swap(data);
+    _n_cols = n_cols;
+  }
+
+  template<typename CoeffType>
+  template<typename VectorStateType>
+  inline
+  void ContiguousMatrix<CoeffType>::assign(unsigned int n_rows, const VectorStateType &row)
+  {
+    _n_cols = row.size();
+    _n_rows = n_rows;
+    _data.resize(_n_rows * _n_cols);
+    for(unsigned int i = 0; i < _n_rows; i++)(*this)[i] = row;
+  }
+
+  template<typename CoeffType>
+  template<typename VectorStateType>
+  inline
+  void ContiguousMatrix<CoeffType>::push_back(const VectorStateType &row)
+  {
+    if(_n_rows == 0)_n_cols = row.size();
+    antioch_assert_equal_to(row.size(),_n_cols);
+
+    for(unsigned int j = 0; j < _n_cols; j++)_data.push_back(row[j]);
+    _n_rows++;
+  }
+
+  template<typename CoeffType>
+  inline
+  void ContiguousMatrix<CoeffType>::fill(const CoeffType &value)
+  {
+    std::fill(_data.begin(),_data.end(),value);
+  }
+
+  template<typename CoeffType>
+  inline
+  void ContiguousMatrix<CoeffType>::clear()
+  {
+    _data.clear();
+    _n_rows = 0;
+    _n_cols = 0;
+  }
+
+  template<typename CoeffType>
+  inline
+  typename ContiguousMatrix<CoeffType>::Row ContiguousMatrix<CoeffType>::operator[](unsigned int i)
+  {
+    antioch_assert_less(i,_n_rows);
+    return Row(*this,i);
+  }
+
+  template<typename CoeffType>
+  inline
+  typename ContiguousMatrix<CoeffType>::ConstRow ContiguousMatrix<CoeffType>::operator[](unsigned int i) const
+  {
+    antioch_assert_less(i,_n_rows);
+    return ConstRow(this->data() + i * _n_cols,_n_cols);
+  }
+
+  template<typename CoeffType>
+  inline
+  CoeffType *ContiguousMatrix<CoeffType>::data()
+  {
+    return (_data.empty())?NULL:&_data[0];
+  }
+
+  template<typename CoeffType>
+  inline
+  const CoeffType *ContiguousMatrix<CoeffType>::data() const
+  {
+    return (_data.empty())?NULL:&_data[0];
+  }
+
+}
+
+#endif
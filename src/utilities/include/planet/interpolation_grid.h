@@ -0,0 +1,276 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_INTERPOLATION_GRID_H
+#define PLANET_INTERPOLATION_GRID_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//C++
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+namespace Planet
+{
+  /*!\class InterpolationGrid
+   *
+   * Monotonic abscissa (increasing or decreasing) of a tabulated profile,
+   * interval lookup:
+   *   - uniform spacing is detected at construction, index in O(1),
+   *   - binary search otherwise, O(log n),
+   *   - from a hint, the index of the previous query, for monotone sweeps
+   *     along a column: O(1) per query when the queries are close.
+   *
+   * The interval index is always in [0, size() - 2], values out of the grid
+   * are in the first or last interval (linear extrapolation if asked, the
+   * linear evaluation is constant out of the grid, as Functions::linear_evaluation).
+   */
+  template<typename CoeffType, typename VectorCoeffType>
+  class InterpolationGrid
+  {
+      private:
+        //! no default constructor
+        InterpolationGrid(){antioch_error();return;}
+
+        VectorCoeffType _abscissa;
+        bool            _ascending;
+        bool            _uniform;
+        CoeffType       _step;
+
+        //! O(1) index of the uniform grid
+        template<typename StateType>
+        unsigned int uniform_index(const StateType &value) const;
+
+        //! binary search
+        template<typename StateType>
+        unsigned int search_index(const StateType &value) const;
+
+        //! true if value is before abscissa x in the grid order
+        template<typename StateType>
+        bool before(const StateType &value, const CoeffType &x) const;
+
+      public:
+        InterpolationGrid(const VectorCoeffType &abscissa);
+        ~InterpolationGrid();
+
+        //!\return number of points
+        unsigned int size() const;
+
+        //!\return abscissa
+        const VectorCoeffType &abscissa() const;
+
+        //!\return true if the spacing is uniform (O(1) lookup)
+        bool uniform() const;
+
+        //!\return true if the abscissa is increasing
+        bool ascending() const;
+
+        //!\return iz, value between abscissa[iz] and abscissa[iz + 1]
+        template<typename StateType>
+        unsigned int floor_index(const StateType &value) const;
+
+        //!\return iz, value between abscissa[iz] and abscissa[iz + 1],
+        //! search starting from hint, updated to iz
+        template<typename StateType>
+        unsigned int floor_index(const StateType &value, unsigned int &hint) const;
+
+        //!\return linear interpolation of data, constant out of the grid
+        template<typename StateType, typename VectorStateType>
+        const CoeffType linear_evaluation(const VectorStateType &data, const StateType &value) const;
+
+        //!\return linear interpolation of data, constant out of the grid, search from hint
+        template<typename StateType, typename VectorStateType>
+        const CoeffType linear_evaluation(const VectorStateType &data, const StateType &value, unsigned int &hint) const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  InterpolationGrid<CoeffType,VectorCoeffType>::InterpolationGrid(const VectorCoeffType &abscissa):
+    _abscissa(abscissa),
+    _ascending(true),
+    _uniform(false),
+    _step(0.L)
+  {
+    antioch_assert_greater(_abscissa.size(),1);
+    _ascending = (_abscissa.back() >= _abscissa.front());
+
+    const unsigned int n = _abscissa.size();
+    _step = (_abscissa.back() - _abscissa.front()) / CoeffType(n - 1);
+    const CoeffType tol = std::abs(_abscissa.back() - _abscissa.front()) * std::numeric_limits<CoeffType>::epsilon() * CoeffType(100.L);
+    _uniform = (_step != CoeffType(0.L));
+    for(unsigned int i = 1; _uniform && i < n - 1; i++)
+    {
+      _uniform = (std::abs(_abscissa[i] - (_abscissa.front() + CoeffType(i) * _step)) <= tol);
+    }
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  InterpolationGrid<CoeffType,VectorCoeffType>::~InterpolationGrid()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  unsigned int InterpolationGrid<CoeffType,VectorCoeffType>::size() const
+  {
+    return _abscissa.size();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &InterpolationGrid<CoeffType,VectorCoeffType>::abscissa() const
+  {
+    return _abscissa;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  bool InterpolationGrid<CoeffType,VectorCoeffType>::uniform() const
+  {
+    return _uniform;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  bool InterpolationGrid<CoeffType,VectorCoeffType>::ascending() const
+  {
+    return _ascending;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  bool InterpolationGrid<CoeffType,VectorCoeffType>::before(const StateType &value, const CoeffType &x) const
+  {
+    return (_ascending)?(value < x):(value > x);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  unsigned int InterpolationGrid<CoeffType,VectorCoeffType>::uniform_index(const StateType &value) const
+  {
+    const CoeffType position = (value - _abscissa.front()) / _step;
+    const unsigned int last = _abscissa.size() - 2;
+    if(!(position > CoeffType(0.L)))return 0;
+    if(position >= CoeffType(last))return last;
+
+    unsigned int iz = static_cast<unsigned int>(position);
+// rounding of the division
+    if(iz > 0 && this->before(value,_abscissa[iz]))iz--;
+    if(iz < last && !this->before(value,_abscissa[iz + 1]))iz++;
+    return iz;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  unsigned int InterpolationGrid<CoeffType,VectorCoeffType>::search_index(const StateType &value) const
+  {
+    typename VectorCoeffType::const_iterator it = (_ascending)?
+                        std::upper_bound(_abscissa.begin(),_abscissa.end(),value):
+                        std::upper_bound(_abscissa.begin(),_abscissa.end(),value,std::greater<CoeffType>());
+    // first abscissa after value
+    const unsigned int after = it - _abscissa.begin();
+    if(after == 0)return 0;
+    return std::min(after - 1,static_cast<unsigned int>(_abscissa.size() - 2));
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  unsigned int InterpolationGrid<CoeffType,VectorCoeffType>::floor_index(const StateType &value) const
+  {
+    return (_uniform)?this->uniform_index(value):this->search_index(value);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  unsigned int InterpolationGrid<CoeffType,VectorCoeffType>::floor_index(const StateType &value, unsigned int &hint) const
+  {
+    const unsigned int last = _abscissa.size() - 2;
+    if(_uniform || hint > last)
+    {
+      hint = this->floor_index(value);
+      return hint;
+    }
+
+// walk from the hint, a few intervals at most before the binary search
+    const unsigned int max_walk(4);
+    unsigned int iz = hint;
+    for(unsigned int walk = 0; walk < max_walk; walk++)
+    {
+      if(iz > 0 && this->before(value,_abscissa[iz]))
+      {
+        iz--;
+      }else if(iz < last && !this->before(value,_abscissa[iz + 1]))
+      {
+        iz++;
+      }else
+      {
+        hint = iz;
+        return iz;
+      }
+    }
+
+    hint = this->search_index(value);
+    return hint;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  const CoeffType InterpolationGrid<CoeffType,VectorCoeffType>::linear_evaluation(const VectorStateType &data, const StateType &value) const
+  {
+    unsigned int hint = _abscissa.size();
+    return this->linear_evaluation(data,value,hint);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType, typename VectorStateType>
+  inline
+  const CoeffType InterpolationGrid<CoeffType,VectorCoeffType>::linear_evaluation(const VectorStateType &data, const StateType &value,
+                                                                                 unsigned int &hint) const
+  {
+    antioch_assert_equal_to(data.size(),_abscissa.size());
+
+    if(!this->before(_abscissa.front(),value))return data.front();
+    if(!this->before(value,_abscissa.back()))return data.back();
+
+    const unsigned int iz = this->floor_index(value,hint);
+    const CoeffType a = (data[iz + 1] - data[iz]) / (_abscissa[iz + 1] - _abscissa[iz]);
+    return data[iz] + a * (value - _abscissa[iz]);
+  }
+
+}
+
+#endif
@@ -22,26 +22,33 @@
 //-----------------------------------------------------------------------el-
 
 #ifndef PLANET_MATH_FUNCTIONS_H
-#define PLANET_MATH_CUNCTIONS_H
+#define PLANET_MATH_FUNCTIONS_H
+
+//C++
+#include <algorithm>
+#include <functional>
 
 namespace Planet 
 {
   namespace Functions
   {
      /*!
-      * looking for index
+      * looking for index, binary search on a monotonic grid (increasing or
+      * decreasing), alt.size() - 1 if value is not within the grid.
+      * See InterpolationGrid for repeated lookups on the same grid.
       */
     template<typename CoeffType, typename VectorCoeffType>
     inline
     unsigned int find_floor_index(const VectorCoeffType &alt, const CoeffType &value)
     {
-      unsigned int iz;
-      for(iz = 0; iz < alt.size() - 1; iz++)
-      {
-         if((alt[iz] <= value && alt[iz + 1] >  value) ||
-            (alt[iz] >  value && alt[iz + 1] <= value))break;
-      }
-      return iz;
+      // first abscissa after value, strictly above for an increasing grid,
+      // below or equal for a decreasing grid
+      typename VectorCoeffType::const_iterator it = (alt.back() >= alt.front())?
+                        std::upper_bound(alt.begin(),alt.end(),value):
+                        std::lower_bound(alt.begin(),alt.end(),value,std::greater<typename VectorCoeffType::value_type>());
+      const unsigned int after = it - alt.begin();
+      if(after == 0 || after == alt.size())return alt.size() - 1;
+      return after - 1;
     }
 
     /*!
@@ -77,7 +84,7 @@ namespace Planet
     CoeffType linear_evaluation_dz(const VectorCoeffType &alt, const VectorCoeffType &data, const CoeffType &value)
     {
       unsigned int iz = find_floor_index(alt,value);
-      return (data[iz + 1] - data[iz]) / (alt[iz] - alt[iz + 1]);
+      return (data[iz + 1] - data[iz]) / (alt[iz + 1] - alt[iz]);
     }
 
   } // end namespace Functions
@@ -0,0 +1,296 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_MONOTONE_CUBIC_INTERPOLATION_H
+#define PLANET_MONOTONE_CUBIC_INTERPOLATION_H
+
+//Antioch
+#include "antioch/antioch_asserts.h"
+
+//Planet
+#include "planet/interpolation_grid.h"
+
+//C++
+#include <vector>
+#include <cmath>
+
+namespace Planet
+{
+  /*!\class MonotoneCubicInterpolation
+   *
+   * Piecewise cubic Hermite interpolation of a tabulated profile, the
+   * polynomial coefficients of each interval are computed once:
+   *
+   *   y(z) = y_i + t (c1_i + t (c2_i + t c3_i)),  t = z - z_i
+   *
+   * Value and derivative are continuous at the nodes. From the data only,
+   * the node slopes are the monotone ones of Fritsch and Carlson (PCHIP):
+   * no overshoot, the interpolant is monotone where the data are. The slopes
+   * can also be given, to resample an interpolant on another grid.
+   *
+   * Constant out of the grid (zero derivative), as the linear evaluation.
+   */
+  template<typename CoeffType, typename VectorCoeffType>
+  class MonotoneCubicInterpolation
+  {
+      private:
+        //! no default constructor
+        MonotoneCubicInterpolation(){antioch_error();return;}
+
+        InterpolationGrid<CoeffType,VectorCoeffType> _grid;
+        VectorCoeffType _values;
+        //! coefficients of the intervals, size() - 1 each
+        VectorCoeffType _c1;
+        VectorCoeffType _c2;
+        VectorCoeffType _c3;
+
+        //! PCHIP node slopes
+        void monotone_slopes(VectorCoeffType &slopes) const;
+
+        //! coefficients from the node slopes
+        void build_coefficients(const VectorCoeffType &slopes);
+
+        //! interval of z, false if out of the grid
+        template<typename StateType>
+        bool interval(const StateType &z, unsigned int &hint, unsigned int &iz) const;
+
+      public:
+        //! monotone slopes
+        MonotoneCubicInterpolation(const VectorCoeffType &abscissa, const VectorCoeffType &values);
+        //! given slopes
+        MonotoneCubicInterpolation(const VectorCoeffType &abscissa, const VectorCoeffType &values, const VectorCoeffType &slopes);
+        ~MonotoneCubicInterpolation();
+
+        //!\return abscissa
+        const VectorCoeffType &abscissa() const;
+
+        //!\return tabulated values
+        const VectorCoeffType &values() const;
+
+        //!\return value at z
+        template<typename StateType>
+        const CoeffType evaluation(const StateType &z) const;
+
+        //!\return derivative at z
+        template<typename StateType>
+        const CoeffType evaluation_dz(const StateType &z) const;
+
+        //! value and derivative at z, one lookup
+        template<typename StateType>
+        void evaluation_and_dz(const StateType &z, CoeffType &value, CoeffType &dvalue_dz) const;
+
+        //! value and derivative at z, lookup from hint, updated
+        template<typename StateType>
+        void evaluation_and_dz(const StateType &z, CoeffType &value, CoeffType &dvalue_dz, unsigned int &hint) const;
+  };
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::MonotoneCubicInterpolation(const VectorCoeffType &abscissa,
+                                                                                   const VectorCoeffType &values):
+    _grid(abscissa),
+    _values(values)
+  {
+    antioch_assert_equal_to(abscissa.size(),values.size());
+
+    VectorCoeffType slopes;
+    this->monotone_slopes(slopes);
+    this->build_coefficients(slopes);
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::MonotoneCubicInterpolation(const VectorCoeffType &abscissa,
+                                                                                   const VectorCoeffType &values,
+                                                                                   const VectorCoeffType &slopes):
+    _grid(abscissa),
+    _values(values)
+  {
+    antioch_assert_equal_to(abscissa.size(),values.size());
+    antioch_assert_equal_to(abscissa.size(),slopes.size());
+
+    this->build_coefficients(slopes);
+
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::~MonotoneCubicInterpolation()
+  {
+    return;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::monotone_slopes(VectorCoeffType &slopes) const
+  {
+    const VectorCoeffType &z = _grid.abscissa();
+    const unsigned int n = z.size();
+    slopes.resize(n,0.L);
+
+    VectorCoeffType h(n - 1);
+    VectorCoeffType m(n - 1);
+    for(unsigned int i = 0; i < n - 1; i++)
+    {
+      h[i] = z[i + 1] - z[i];
+      m[i] = (_values[i + 1] - _values[i]) / h[i];
+    }
+
+    if(n == 2)
+    {
+      slopes[0] = m[0];
+      slopes[1] = m[0];
+      return;
+    }
+
+// interior: weighted harmonic mean of the secants, zero at extrema
+    for(unsigned int i = 1; i < n - 1; i++)
+    {
+      if(m[i - 1] * m[i] <= CoeffType(0.L))continue;
+      const CoeffType w1 = CoeffType(2.L) * h[i] + h[i - 1];
+      const CoeffType w2 = h[i] + CoeffType(2.L) * h[i - 1];
+      slopes[i] = (w1 + w2) / (w1 / m[i - 1] + w2 / m[i]);
+    }
+
+// ends: three points formula, limited to keep the shape
+    for(unsigned int end = 0; end < 2; end++)
+    {
+      const unsigned int i0 = (end == 0)?0:n - 2;
+      const unsigned int i1 = (end == 0)?1:n - 3;
+      CoeffType d = ((CoeffType(2.L) * h[i0] + h[i1]) * m[i0] - h[i0] * m[i1]) / (h[i0] + h[i1]);
+      if(d * m[i0] <= CoeffType(0.L))
+      {
+        d = 0.L;
+      }else if(m[i0] * m[i1] <= CoeffType(0.L) && std::abs(d) > CoeffType(3.L) * std::abs(m[i0]))
+      {
+        d = CoeffType(3.L) * m[i0];
+      }
+      slopes[(end == 0)?0:n - 1] = d;
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  void MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::build_coefficients(const VectorCoeffType &slopes)
+  {
+    const VectorCoeffType &z = _grid.abscissa();
+    const unsigned int n = z.size();
+    _c1.resize(n - 1);
+    _c2.resize(n - 1);
+    _c3.resize(n - 1);
+    for(unsigned int i = 0; i < n - 1; i++)
+    {
+      const CoeffType h = z[i + 1] - z[i];
+      const CoeffType m = (_values[i + 1] - _values[i]) / h;
+      _c1[i] = slopes[i];
+      _c2[i] = (CoeffType(3.L) * m - CoeffType(2.L) * slopes[i] - slopes[i + 1]) / h;
+      _c3[i] = (slopes[i] + slopes[i + 1] - CoeffType(2.L) * m) / (h * h);
+    }
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::abscissa() const
+  {
+    return _grid.abscissa();
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  inline
+  const VectorCoeffType &MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::values() const
+  {
+    return _values;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  bool MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::interval(const StateType &z, unsigned int &hint, unsigned int &iz) const
+  {
+    const VectorCoeffType &alt = _grid.abscissa();
+    iz = _grid.floor_index(z,hint);
+
+// out of the grid: before the first node or after the last one,
+// in the direction of the grid
+    const CoeffType first = alt[1] - alt[0];
+    if(iz == 0 && (z - alt[0]) * first < CoeffType(0.L))return false;
+    if(iz == alt.size() - 2 && (z - alt.back()) * first > CoeffType(0.L))return false;
+
+    return true;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  const CoeffType MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::evaluation(const StateType &z) const
+  {
+    CoeffType value, dvalue_dz;
+    this->evaluation_and_dz(z,value,dvalue_dz);
+    return value;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  const CoeffType MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::evaluation_dz(const StateType &z) const
+  {
+    CoeffType value, dvalue_dz;
+    this->evaluation_and_dz(z,value,dvalue_dz);
+    return dvalue_dz;
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  void MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::evaluation_and_dz(const StateType &z, CoeffType &value, CoeffType &dvalue_dz) const
+  {
+    unsigned int hint = _grid.size();
+    this->evaluation_and_dz(z,value,dvalue_dz,hint);
+  }
+
+  template<typename CoeffType, typename VectorCoeffType>
+  template<typename StateType>
+  inline
+  void MonotoneCubicInterpolation<CoeffType,VectorCoeffType>::evaluation_and_dz(const StateType &z, CoeffType &value,
+                                                                               CoeffType &dvalue_dz, unsigned int &hint) const
+  {
+    unsigned int iz;
+    if(!this->interval(z,hint,iz))
+    {
+      const VectorCoeffType &alt = _grid.abscissa();
+      value = ((z - alt[0]) * (alt[1] - alt[0]) < CoeffType(0.L))?_values.front():_values.back();
+      dvalue_dz = 0.L;
+      return;
+    }
+
+    const CoeffType t = z - _grid.abscissa()[iz];
+    value     = _values[iz] + t * (_c1[iz] + t * (_c2[iz] + t * _c3[iz]));
+    dvalue_dz = _c1[iz] + t * (CoeffType(2.L) * _c2[iz] + CoeffType(3.L) * t * _c3[iz]);
+  }
+
+}
+
+#endif
@@ -0,0 +1,220 @@
+//-----------------------------------------------------------------------bl-
+//--------------------------------------------------------------------------
+//
+// Planet - An atmospheric code for planetary bodies, adapted to Titan
+//
+// Copyright (C) 2013 The PECOS Development Team
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the Version 2.1 GNU Lesser General
+// Public License as published by the Free Software Foundation.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc. 51 Franklin Street, Fifth Floor,
+// Boston, MA  02110-1301  USA
+//
+//-----------------------------------------------------------------------el-
+
+#ifndef PLANET_TEST_METHANE_MECHANISM_H
+#define PLANET_TEST_METHANE_MECHANISM_H
+
+//Antioch
+#include "antioch/physical_constants.h"
+#include "antioch/kinetics_parsing.h"
+#include "antioch/reaction_parsing.h"
+#include "antioch/reaction_set.h"
+
+//C++
+#include <vector>
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <iomanip>
+
+//! Shared fixture of the kinetics tests: a small methane mechanism
+//! (N2, CH4, CH3, H, H2, C2H6) with one elementary reaction of each
+//! molecularity and two falloff reactions, and an N2+ ionic chemistry.
+
+template<typename Scalar>
+int check_test(Scalar theory, Scalar cal, const std::string &words, Scalar tol = std::numeric_limits<Scalar>::epsilon() * 100.)
+{
+  Scalar test = (theory-cal);
+  if(theory != 0.)test = std::abs(test/theory);
+  if(std::abs(test) < tol)return 0;
+  std::cout << std::scientific << std::setprecision(20)
+            << "failed test: " << words << "\n"
+            << "theory: " << theory
+            << "\ncalculated: " << cal
+            << "\ndifference: " << test
+            << "\ntolerance: " << tol << std::endl;
+  return 1;
+}
+
+template<typename Scalar>
+void add_reaction(const std::string &equation,
+                  const std::vector<std::string> &reactants, const std::vector<unsigned int> &stoi_reac,
+                  const std::vector<std::string> &products,  const std::vector<unsigned int> &stoi_prod,
+                  const std::vector<std::vector<Scalar> > &rates,
+                  Antioch::ReactionSet<Scalar> &reaction_set)
+{
+   const Antioch::ChemicalMixture<Scalar>& chem_mixture = reaction_set.chemical_mixture();
+   Antioch::KineticsModel::KineticsModel kineticsModel(Antioch::KineticsModel::KOOIJ);
+   Antioch::ReactionType::ReactionType reactionType((rates.size() == 1)?Antioch::ReactionType::ELEMENTARY:
+                                                                        Antioch::ReactionType::LINDEMANN_FALLOFF);
+
+   Antioch::Reaction<Scalar> * reaction = Antioch::build_reaction<Scalar>(chem_mixture.n_species(), equation, false, reactionType, kineticsModel);
+   for(unsigned int i = 0; i < rates.size(); i++)
+   {
+      reaction->add_forward_rate(Antioch::build_rate<Scalar,std::vector<Scalar> >(rates[i],kineticsModel));
+   }
+   for(unsigned int ir = 0; ir < reactants.size(); ir++)
+   {
+     reaction->add_reactant(reactants[ir],chem_mixture.active_species_name_map().find(reactants[ir])->second,stoi_reac[ir]);
+   }
+   for(unsigned int ip = 0; ip < products.size(); ip++)
+   {
+     reaction->add_product(products[ip],chem_mixture.active_species_name_map().find(products[ip])->second,stoi_prod[ip]);
+   }
+   reaction_set.add_reaction(reaction);
+}
+
+template<typename Scalar>
+std::vector<Scalar> kooij(Scalar Cf, Scalar beta, Scalar Ea)
+{
+   std::vector<Scalar> rate;
+   rate.push_back(Cf);
+   rate.push_back(beta);
+   rate.push_back(Ea);
+   rate.push_back(1.L); //Tref
+   rate.push_back(Antioch::Constants::R_universal<Scalar>()*1e-3); //scale (R in J/mol/K)
+   return rate;
+}
+
+//! species of the mechanism, in this order
+inline void methane_neutrals(std::vector<std::string> &neutrals)
+{
+  neutrals.push_back("N2");
+  neutrals.push_back("CH4");
+  neutrals.push_back("CH3");
+  neutrals.push_back("H");
+  neutrals.push_back("H2");
+  neutrals.push_back("C2H6");
+}
+
+//! densities of the species of methane_neutrals() at sample i
+template<typename Scalar>
+void methane_densities(unsigned int i, std::vector<Scalar> &densities)
+{
+  densities.push_back(1e13L / (i + 1)); //N2
+  densities.push_back(2e11L / (i + 1)); //CH4
+  densities.push_back(3e6L  * (i + 1)); //CH3
+  densities.push_back(1e7L  * (i + 1)); //H
+  densities.push_back(5e9L  / (i + 1)); //H2
+  densities.push_back(4e8L  / (i + 1)); //C2H6
+}
+
+//! H + CH3 -> CH4, falloff
+template<typename Scalar>
+void add_methyl_recombination(Antioch::ReactionSet<Scalar> &reaction_set)
+{
+  std::vector<std::string> r,p;
+  std::vector<unsigned int> sr,sp;
+  std::vector<std::vector<Scalar> > rates;
+  r.push_back("H");  sr.push_back(1);
+  r.push_back("CH3");sr.push_back(1);
+  p.push_back("CH4");sp.push_back(1);
+  rates.push_back(kooij<Scalar>(6.2e-18L,-5.L,0.L));
+  rates.push_back(kooij<Scalar>(3.5e-10L,0.L,0.L));
+  add_reaction("H + CH3 -> CH4",r,sr,p,sp,rates,reaction_set);
+}
+
+//! the four reactions, in this order:
+//! 0: H + CH4 -> CH3 + H2
+//! 1: CH3 + CH3 -> C2H6, falloff
+//! 2: H + CH3 -> CH4, falloff
+//! 3: H + H -> H2
+template<typename Scalar>
+void add_methane_reactions(Antioch::ReactionSet<Scalar> &reaction_set)
+{
+  std::vector<std::string> r,p;
+  std::vector<unsigned int> sr,sp;
+  std::vector<std::vector<Scalar> > rates;
+
+  r.push_back("H");  sr.push_back(1);
+  r.push_back("CH4");sr.push_back(1);
+  p.push_back("CH3");sp.push_back(1);
+  p.push_back("H2"); sp.push_back(1);
+  rates.push_back(kooij<Scalar>(2.2e-20L,3.L,36.7L));
+  add_reaction("H + CH4 -> CH3 + H2",r,sr,p,sp,rates,reaction_set);
+
+  r.clear();sr.clear();p.clear();sp.clear();rates.clear();
+  r.push_back("CH3");sr.push_back(2);
+  p.push_back("C2H6");sp.push_back(1);
+  rates.push_back(kooij<Scalar>(1.7e-17L,-6.2L,4.3L));
+  rates.push_back(kooij<Scalar>(6e-11L,0.L,0.L));
+  add_reaction("CH3 + CH3 -> C2H6",r,sr,p,sp,rates,reaction_set);
+
+  add_methyl_recombination(reaction_set);
+
+  r.clear();sr.clear();p.clear();sp.clear();rates.clear();
+  r.push_back("H");  sr.push_back(2);
+  p.push_back("H2"); sp.push_back(1);
+  rates.push_back(kooij<Scalar>(1.5e-29L,-1.3L,0.L));
+  add_reaction("H + H -> H2",r,sr,p,sp,rates,reaction_set);
+}
+
+//! the ionic system: methane_neutrals() and N2+, in this order
+inline void methane_ions(std::vector<std::string> &ions)
+{
+  methane_neutrals(ions);
+  ions.push_back("N2+");
+}
+
+//! N2+ produced from N2, lost on CH4 and H2, and recombined: a few Newton
+//! iterations, about one ion per cm3 (absolute convergence threshold)
+template<typename Scalar>
+void add_nitrogen_ion_reactions(Antioch::ReactionSet<Scalar> &reaction_set)
+{
+  std::vector<std::string> r,p;
+  std::vector<unsigned int> sr,sp;
+  std::vector<std::vector<Scalar> > rates;
+
+  r.push_back("N2"); sr.push_back(1);
+  r.push_back("H2"); sr.push_back(1);
+  p.push_back("N2+");sp.push_back(1);
+  p.push_back("H2"); sp.push_back(1);
+  rates.push_back(kooij<Scalar>(4e-21L,0.L,0.L));
+  add_reaction("N2 + H2 -> N2+ + H2",r,sr,p,sp,rates,reaction_set);
+
+  r.clear();sr.clear();p.clear();sp.clear();rates.clear();
+  r.push_back("N2+");sr.push_back(1);
+  r.push_back("CH4");sr.push_back(1);
+  p.push_back("N2"); sp.push_back(1);
+  p.push_back("CH3");sp.push_back(1);
+  p.push_back("H");  sp.push_back(1);
+  rates.push_back(kooij<Scalar>(1e-9L,0.L,0.L));
+  add_reaction("N2+ + CH4 -> N2 + CH3 + H",r,sr,p,sp,rates,reaction_set);
+
+  r.clear();sr.clear();p.clear();sp.clear();rates.clear();
+  r.push_back("N2+");sr.push_back(1);
+  r.push_back("H2"); sr.push_back(1);
+  p.push_back("N2"); sp.push_back(1);
+  p.push_back("H");  sp.push_back(2);
+  rates.push_back(kooij<Scalar>(1e-10L,0.L,0.L));
+  add_reaction("N2+ + H2 -> N2 + H + H",r,sr,p,sp,rates,reaction_set);
+
+  r.clear();sr.clear();p.clear();sp.clear();rates.clear();
+  r.push_back("N2+");sr.push_back(2);
+  p.push_back("N2"); sp.push_back(2);
+  rates.push_back(kooij<Scalar>(50.L,0.L,0.L));
+  add_reaction("N2+ + N2+ -> N2 + N2",r,sr,p,sp,rates,reaction_set);
+}
+
+#endif